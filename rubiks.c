@@ -30,33 +30,37 @@
 #include <time.h>
 #include <sys/time.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rubiks.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS true
+#else
+#define HAVE_X86_KERNELS false
+#endif
 
+#ifndef LOGGING
 #define LOGGING true
-#define NUM_CUBES 1
+#endif
+#define NUM_CUBES 1 // cubes to scramble and solve, unless --cubes says otherwise
+#define CUBE_CHUNK 65536 // cubes held in memory at once, unless --chunk says otherwise
 
 char colors[] = "BYOWRG";
 
-// facing white with blue top:
-enum { BLU, YEL, ORG, WHT, RED, GRN };
-enum { UP, BACK, LEFT, FRONT, RIGHT, DOWN };
+// faces, colors, moves and cube_t are in rubiks.h, the library API
 
-// move list
-enum { ROTU, ROTUI, ROTB, ROTBI, ROTL, ROTLI, ROTF, ROTFI, ROTR, ROTRI, ROTD, ROTDI };
-
-typedef struct {
-	int tile[3][3];
-} face_t;
-
-typedef struct {
-	face_t face[6];
-	unsigned int totalMoves; // keep track of total moves
-	// and moves for each function
-	unsigned int solveGreenCrossMoves;
-	unsigned int solveGreenCornersMoves;
-	unsigned int solveMiddleEdgesMoves;
-	unsigned int solveBlueCrossMoves;
-	unsigned int alignBlueCornersMoves;
-} cube_t;
+// the vector move kernels read and write facelets in 8 byte pieces, which spills into the two padding bytes
+// after facelet 53. make sure those really are padding.
+_Static_assert(offsetof(cube_t, totalMoves) >= 56, "cube_t facelets must be followed by padding");
 
 typedef struct {
 	int faceid1;
@@ -133,1921 +137,7121 @@ enum {
 	BLUECROSSSTATECROSS
 };
 
-cube_t cube[NUM_CUBES];
+// the cube array holds one chunk of the batch at a time; it's allocated once at startup and every chunk
+// reuses it, so memory stays flat however many cubes are solved
+cube_t *cube = NULL;
+int cube_capacity = 0;
+
+// Reference Rotators
+// These turn a face the slow and obvious way, one tile at a time. They are only run once, on a cube whose
+// facelets are labelled with their own positions, to build the move tables used by abs_rot_indrot.
 
 // Face Rotators
-void cwface(int index, int face)
+void cwface(face_t *faces, int face)
 {
 	// utility function to rotate an absolute face clockwise: does not affect side tiles
 	face_t save;
 	
 	// buffer the face
-	memcpy(&save, &cube[index].face[face], sizeof(face_t));
+	memcpy(&save, &faces[face], sizeof(face_t));
 	
 	// set the cube face to the buffer, rotated. Center tile does not change as it just rotates on its own axis.
-	cube[index].face[face].tile[0][0] = save.tile[2][0];
-	cube[index].face[face].tile[0][1] = save.tile[1][0];
-	cube[index].face[face].tile[0][2] = save.tile[0][0];
-	cube[index].face[face].tile[1][0] = save.tile[2][1];
-	cube[index].face[face].tile[1][2] = save.tile[0][1];
-	cube[index].face[face].tile[2][0] = save.tile[2][2];
-	cube[index].face[face].tile[2][1] = save.tile[1][2];
-	cube[index].face[face].tile[2][2] = save.tile[0][2];
-	
-	// bump move pointer
-	cube[index].totalMoves++;
+	faces[face].tile[0][0] = save.tile[2][0];
+	faces[face].tile[0][1] = save.tile[1][0];
+	faces[face].tile[0][2] = save.tile[0][0];
+	faces[face].tile[1][0] = save.tile[2][1];
+	faces[face].tile[1][2] = save.tile[0][1];
+	faces[face].tile[2][0] = save.tile[2][2];
+	faces[face].tile[2][1] = save.tile[1][2];
+	faces[face].tile[2][2] = save.tile[0][2];
 }
 
-void ccwface(int index, int face)
+void ccwface(face_t *faces, int face)
 {
 	// utility function to rotate an absolute face counterclockwise: does not affect side tiles
 	face_t save;
 	
 	// buffer the face
-	memcpy(&save, &cube[index].face[face], sizeof(face_t));
+	memcpy(&save, &faces[face], sizeof(face_t));
 	
 	// set the cube face to the buffer, rotated. Center tile does not change as it just rotates on its own axis.
-	cube[index].face[face].tile[0][0] = save.tile[0][2];
-	cube[index].face[face].tile[0][1] = save.tile[1][2];
-	cube[index].face[face].tile[0][2] = save.tile[2][2];
-	cube[index].face[face].tile[1][0] = save.tile[0][1];
-	cube[index].face[face].tile[1][2] = save.tile[2][1];
-	cube[index].face[face].tile[2][0] = save.tile[0][0];
-	cube[index].face[face].tile[2][1] = save.tile[1][0];
-	cube[index].face[face].tile[2][2] = save.tile[2][0];
-	
-	// bump move pointer
-	cube[index].totalMoves++;
+	faces[face].tile[0][0] = save.tile[0][2];
+	faces[face].tile[0][1] = save.tile[1][2];
+	faces[face].tile[0][2] = save.tile[2][2];
+	faces[face].tile[1][0] = save.tile[0][1];
+	faces[face].tile[1][2] = save.tile[2][1];
+	faces[face].tile[2][0] = save.tile[0][0];
+	faces[face].tile[2][1] = save.tile[1][0];
+	faces[face].tile[2][2] = save.tile[2][0];
 }
 
-// Absolute Rotate functions
-void abs_rotf(int index)
+// Reference side rotators
+void ref_rotf(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: front\n");
-	
-	cwface(index, FRONT);
+	cwface(faces, FRONT);
 	// buffer the upside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[UP].tile[2][i];
+		savetile[i] = faces[UP].tile[2][i];
 	// preform the rotation of side tiles
-	cube[index].face[UP].tile[2][0] = cube[index].face[LEFT].tile[2][2];
-	cube[index].face[UP].tile[2][1] = cube[index].face[LEFT].tile[1][2];
-	cube[index].face[UP].tile[2][2] = cube[index].face[LEFT].tile[0][2];
-	cube[index].face[LEFT].tile[0][2] = cube[index].face[DOWN].tile[0][0];
-	cube[index].face[LEFT].tile[1][2] = cube[index].face[DOWN].tile[0][1];
-	cube[index].face[LEFT].tile[2][2] = cube[index].face[DOWN].tile[0][2];
-	cube[index].face[DOWN].tile[0][0] = cube[index].face[RIGHT].tile[2][0];
-	cube[index].face[DOWN].tile[0][1] = cube[index].face[RIGHT].tile[1][0];
-	cube[index].face[DOWN].tile[0][2] = cube[index].face[RIGHT].tile[0][0];
-	cube[index].face[RIGHT].tile[0][0] = savetile[0];
-	cube[index].face[RIGHT].tile[1][0] = savetile[1];
-	cube[index].face[RIGHT].tile[2][0] = savetile[2];
-}
-
-void abs_rotfi(int index)
+	faces[UP].tile[2][0] = faces[LEFT].tile[2][2];
+	faces[UP].tile[2][1] = faces[LEFT].tile[1][2];
+	faces[UP].tile[2][2] = faces[LEFT].tile[0][2];
+	faces[LEFT].tile[0][2] = faces[DOWN].tile[0][0];
+	faces[LEFT].tile[1][2] = faces[DOWN].tile[0][1];
+	faces[LEFT].tile[2][2] = faces[DOWN].tile[0][2];
+	faces[DOWN].tile[0][0] = faces[RIGHT].tile[2][0];
+	faces[DOWN].tile[0][1] = faces[RIGHT].tile[1][0];
+	faces[DOWN].tile[0][2] = faces[RIGHT].tile[0][0];
+	faces[RIGHT].tile[0][0] = savetile[0];
+	faces[RIGHT].tile[1][0] = savetile[1];
+	faces[RIGHT].tile[2][0] = savetile[2];
+}
+
+void ref_rotfi(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: front inverted\n");
-	
-	ccwface(index, FRONT);
+	ccwface(faces, FRONT);
 	// buffer the upside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[UP].tile[2][i];
+		savetile[i] = faces[UP].tile[2][i];
 	// preform the rotation of side tiles
-	cube[index].face[UP].tile[2][0] = cube[index].face[RIGHT].tile[0][0];
-	cube[index].face[UP].tile[2][1] = cube[index].face[RIGHT].tile[1][0];
-	cube[index].face[UP].tile[2][2] = cube[index].face[RIGHT].tile[2][0];
-	cube[index].face[RIGHT].tile[0][0] = cube[index].face[DOWN].tile[0][2];
-	cube[index].face[RIGHT].tile[1][0] = cube[index].face[DOWN].tile[0][1];
-	cube[index].face[RIGHT].tile[2][0] = cube[index].face[DOWN].tile[0][0];
-	cube[index].face[DOWN].tile[0][0] = cube[index].face[LEFT].tile[0][2];
-	cube[index].face[DOWN].tile[0][1] = cube[index].face[LEFT].tile[1][2];
-	cube[index].face[DOWN].tile[0][2] = cube[index].face[LEFT].tile[2][2];
-	cube[index].face[LEFT].tile[0][2] = savetile[2];
-	cube[index].face[LEFT].tile[1][2] = savetile[1];
-	cube[index].face[LEFT].tile[2][2] = savetile[0];
-}
-
-void abs_rotb(int index)
+	faces[UP].tile[2][0] = faces[RIGHT].tile[0][0];
+	faces[UP].tile[2][1] = faces[RIGHT].tile[1][0];
+	faces[UP].tile[2][2] = faces[RIGHT].tile[2][0];
+	faces[RIGHT].tile[0][0] = faces[DOWN].tile[0][2];
+	faces[RIGHT].tile[1][0] = faces[DOWN].tile[0][1];
+	faces[RIGHT].tile[2][0] = faces[DOWN].tile[0][0];
+	faces[DOWN].tile[0][0] = faces[LEFT].tile[0][2];
+	faces[DOWN].tile[0][1] = faces[LEFT].tile[1][2];
+	faces[DOWN].tile[0][2] = faces[LEFT].tile[2][2];
+	faces[LEFT].tile[0][2] = savetile[2];
+	faces[LEFT].tile[1][2] = savetile[1];
+	faces[LEFT].tile[2][2] = savetile[0];
+}
+
+void ref_rotb(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: back\n");
-	
-	cwface(index, BACK);
+	cwface(faces, BACK);
 	// buffer the upside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[UP].tile[0][i];
+		savetile[i] = faces[UP].tile[0][i];
 	// preform the rotation of side tiles
-	cube[index].face[UP].tile[0][0] = cube[index].face[RIGHT].tile[0][2];
-	cube[index].face[UP].tile[0][1] = cube[index].face[RIGHT].tile[1][2];
-	cube[index].face[UP].tile[0][2] = cube[index].face[RIGHT].tile[2][2];
-	cube[index].face[RIGHT].tile[0][2] = cube[index].face[DOWN].tile[2][2];
-	cube[index].face[RIGHT].tile[1][2] = cube[index].face[DOWN].tile[2][1];
-	cube[index].face[RIGHT].tile[2][2] = cube[index].face[DOWN].tile[2][0];
-	cube[index].face[DOWN].tile[2][0] = cube[index].face[LEFT].tile[0][0];
-	cube[index].face[DOWN].tile[2][1] = cube[index].face[LEFT].tile[1][0];
-	cube[index].face[DOWN].tile[2][2] = cube[index].face[LEFT].tile[2][0];
-	cube[index].face[LEFT].tile[0][0] = savetile[2];
-	cube[index].face[LEFT].tile[1][0] = savetile[1];
-	cube[index].face[LEFT].tile[2][0] = savetile[0];
-}
-
-void abs_rotbi(int index)
+	faces[UP].tile[0][0] = faces[RIGHT].tile[0][2];
+	faces[UP].tile[0][1] = faces[RIGHT].tile[1][2];
+	faces[UP].tile[0][2] = faces[RIGHT].tile[2][2];
+	faces[RIGHT].tile[0][2] = faces[DOWN].tile[2][2];
+	faces[RIGHT].tile[1][2] = faces[DOWN].tile[2][1];
+	faces[RIGHT].tile[2][2] = faces[DOWN].tile[2][0];
+	faces[DOWN].tile[2][0] = faces[LEFT].tile[0][0];
+	faces[DOWN].tile[2][1] = faces[LEFT].tile[1][0];
+	faces[DOWN].tile[2][2] = faces[LEFT].tile[2][0];
+	faces[LEFT].tile[0][0] = savetile[2];
+	faces[LEFT].tile[1][0] = savetile[1];
+	faces[LEFT].tile[2][0] = savetile[0];
+}
+
+void ref_rotbi(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: back inverted\n");
-	
-	ccwface(index, BACK);
+	ccwface(faces, BACK);
 	// buffer the upside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[UP].tile[0][i];
+		savetile[i] = faces[UP].tile[0][i];
 	// preform the rotation of side tiles
-	cube[index].face[UP].tile[0][0] = cube[index].face[LEFT].tile[2][0];
-	cube[index].face[UP].tile[0][1] = cube[index].face[LEFT].tile[1][0];
-	cube[index].face[UP].tile[0][2] = cube[index].face[LEFT].tile[0][0];
-	cube[index].face[LEFT].tile[0][0] = cube[index].face[DOWN].tile[2][0];
-	cube[index].face[LEFT].tile[1][0] = cube[index].face[DOWN].tile[2][1];
-	cube[index].face[LEFT].tile[2][0] = cube[index].face[DOWN].tile[2][2];
-	cube[index].face[DOWN].tile[2][0] = cube[index].face[RIGHT].tile[2][2];
-	cube[index].face[DOWN].tile[2][1] = cube[index].face[RIGHT].tile[1][2];
-	cube[index].face[DOWN].tile[2][2] = cube[index].face[RIGHT].tile[0][2];
-	cube[index].face[RIGHT].tile[0][2] = savetile[0];
-	cube[index].face[RIGHT].tile[1][2] = savetile[1];
-	cube[index].face[RIGHT].tile[2][2] = savetile[2];
-}
-
-void abs_rotr(int index)
+	faces[UP].tile[0][0] = faces[LEFT].tile[2][0];
+	faces[UP].tile[0][1] = faces[LEFT].tile[1][0];
+	faces[UP].tile[0][2] = faces[LEFT].tile[0][0];
+	faces[LEFT].tile[0][0] = faces[DOWN].tile[2][0];
+	faces[LEFT].tile[1][0] = faces[DOWN].tile[2][1];
+	faces[LEFT].tile[2][0] = faces[DOWN].tile[2][2];
+	faces[DOWN].tile[2][0] = faces[RIGHT].tile[2][2];
+	faces[DOWN].tile[2][1] = faces[RIGHT].tile[1][2];
+	faces[DOWN].tile[2][2] = faces[RIGHT].tile[0][2];
+	faces[RIGHT].tile[0][2] = savetile[0];
+	faces[RIGHT].tile[1][2] = savetile[1];
+	faces[RIGHT].tile[2][2] = savetile[2];
+}
+
+void ref_rotr(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: right\n");
-	
-	cwface(index, RIGHT);
+	cwface(faces, RIGHT);
 	// buffer the upside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[UP].tile[i][2];
+		savetile[i] = faces[UP].tile[i][2];
 	// preform the rotation of side tiles
-	cube[index].face[UP].tile[0][2] = cube[index].face[FRONT].tile[0][2];
-	cube[index].face[UP].tile[1][2] = cube[index].face[FRONT].tile[1][2];
-	cube[index].face[UP].tile[2][2] = cube[index].face[FRONT].tile[2][2];
-	cube[index].face[FRONT].tile[0][2] = cube[index].face[DOWN].tile[0][2];
-	cube[index].face[FRONT].tile[1][2] = cube[index].face[DOWN].tile[1][2];
-	cube[index].face[FRONT].tile[2][2] = cube[index].face[DOWN].tile[2][2];
-	cube[index].face[DOWN].tile[0][2] = cube[index].face[BACK].tile[2][0];
-	cube[index].face[DOWN].tile[1][2] = cube[index].face[BACK].tile[1][0];
-	cube[index].face[DOWN].tile[2][2] = cube[index].face[BACK].tile[0][0];
-	cube[index].face[BACK].tile[0][0] = savetile[2];
-	cube[index].face[BACK].tile[1][0] = savetile[1];
-	cube[index].face[BACK].tile[2][0] = savetile[0];
-}
-
-void abs_rotri(int index)
+	faces[UP].tile[0][2] = faces[FRONT].tile[0][2];
+	faces[UP].tile[1][2] = faces[FRONT].tile[1][2];
+	faces[UP].tile[2][2] = faces[FRONT].tile[2][2];
+	faces[FRONT].tile[0][2] = faces[DOWN].tile[0][2];
+	faces[FRONT].tile[1][2] = faces[DOWN].tile[1][2];
+	faces[FRONT].tile[2][2] = faces[DOWN].tile[2][2];
+	faces[DOWN].tile[0][2] = faces[BACK].tile[2][0];
+	faces[DOWN].tile[1][2] = faces[BACK].tile[1][0];
+	faces[DOWN].tile[2][2] = faces[BACK].tile[0][0];
+	faces[BACK].tile[0][0] = savetile[2];
+	faces[BACK].tile[1][0] = savetile[1];
+	faces[BACK].tile[2][0] = savetile[0];
+}
+
+void ref_rotri(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: right inverted\n");
-	
-	ccwface(index, RIGHT);
+	ccwface(faces, RIGHT);
 	// buffer the upside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[UP].tile[i][2];
+		savetile[i] = faces[UP].tile[i][2];
 	// preform the rotation of side tiles
-	cube[index].face[UP].tile[0][2] = cube[index].face[BACK].tile[2][0];
-	cube[index].face[UP].tile[1][2] = cube[index].face[BACK].tile[1][0];
-	cube[index].face[UP].tile[2][2] = cube[index].face[BACK].tile[0][0];
-	cube[index].face[BACK].tile[0][0] = cube[index].face[DOWN].tile[2][2];
-	cube[index].face[BACK].tile[1][0] = cube[index].face[DOWN].tile[1][2];
-	cube[index].face[BACK].tile[2][0] = cube[index].face[DOWN].tile[0][2];
-	cube[index].face[DOWN].tile[0][2] = cube[index].face[FRONT].tile[0][2];
-	cube[index].face[DOWN].tile[1][2] = cube[index].face[FRONT].tile[1][2];
-	cube[index].face[DOWN].tile[2][2] = cube[index].face[FRONT].tile[2][2];
-	cube[index].face[FRONT].tile[0][2] = savetile[0];
-	cube[index].face[FRONT].tile[1][2] = savetile[1];
-	cube[index].face[FRONT].tile[2][2] = savetile[2];
-}
-
-void abs_rotl(int index)
+	faces[UP].tile[0][2] = faces[BACK].tile[2][0];
+	faces[UP].tile[1][2] = faces[BACK].tile[1][0];
+	faces[UP].tile[2][2] = faces[BACK].tile[0][0];
+	faces[BACK].tile[0][0] = faces[DOWN].tile[2][2];
+	faces[BACK].tile[1][0] = faces[DOWN].tile[1][2];
+	faces[BACK].tile[2][0] = faces[DOWN].tile[0][2];
+	faces[DOWN].tile[0][2] = faces[FRONT].tile[0][2];
+	faces[DOWN].tile[1][2] = faces[FRONT].tile[1][2];
+	faces[DOWN].tile[2][2] = faces[FRONT].tile[2][2];
+	faces[FRONT].tile[0][2] = savetile[0];
+	faces[FRONT].tile[1][2] = savetile[1];
+	faces[FRONT].tile[2][2] = savetile[2];
+}
+
+void ref_rotl(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: left\n");
-	
-	cwface(index, LEFT);
+	cwface(faces, LEFT);
 	// buffer the upside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[UP].tile[i][0];
+		savetile[i] = faces[UP].tile[i][0];
 	// preform the rotation of side tiles
-	cube[index].face[UP].tile[0][0] = cube[index].face[BACK].tile[2][2];
-	cube[index].face[UP].tile[1][0] = cube[index].face[BACK].tile[1][2];
-	cube[index].face[UP].tile[2][0] = cube[index].face[BACK].tile[0][2];
-	cube[index].face[BACK].tile[0][2] = cube[index].face[DOWN].tile[2][0];
-	cube[index].face[BACK].tile[1][2] = cube[index].face[DOWN].tile[1][0];
-	cube[index].face[BACK].tile[2][2] = cube[index].face[DOWN].tile[0][0];
-	cube[index].face[DOWN].tile[0][0] = cube[index].face[FRONT].tile[0][0];
-	cube[index].face[DOWN].tile[1][0] = cube[index].face[FRONT].tile[1][0];
-	cube[index].face[DOWN].tile[2][0] = cube[index].face[FRONT].tile[2][0];
-	cube[index].face[FRONT].tile[0][0] = savetile[0];
-	cube[index].face[FRONT].tile[1][0] = savetile[1];
-	cube[index].face[FRONT].tile[2][0] = savetile[2];
-}
-
-void abs_rotli(int index)
+	faces[UP].tile[0][0] = faces[BACK].tile[2][2];
+	faces[UP].tile[1][0] = faces[BACK].tile[1][2];
+	faces[UP].tile[2][0] = faces[BACK].tile[0][2];
+	faces[BACK].tile[0][2] = faces[DOWN].tile[2][0];
+	faces[BACK].tile[1][2] = faces[DOWN].tile[1][0];
+	faces[BACK].tile[2][2] = faces[DOWN].tile[0][0];
+	faces[DOWN].tile[0][0] = faces[FRONT].tile[0][0];
+	faces[DOWN].tile[1][0] = faces[FRONT].tile[1][0];
+	faces[DOWN].tile[2][0] = faces[FRONT].tile[2][0];
+	faces[FRONT].tile[0][0] = savetile[0];
+	faces[FRONT].tile[1][0] = savetile[1];
+	faces[FRONT].tile[2][0] = savetile[2];
+}
+
+void ref_rotli(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: left inverted\n");
-	
-	ccwface(index, LEFT);
+	ccwface(faces, LEFT);
 	// buffer the upside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[UP].tile[i][0];
+		savetile[i] = faces[UP].tile[i][0];
 	// preform the rotation of side tiles
-	cube[index].face[UP].tile[0][0] = cube[index].face[FRONT].tile[0][0];
-	cube[index].face[UP].tile[1][0] = cube[index].face[FRONT].tile[1][0];
-	cube[index].face[UP].tile[2][0] = cube[index].face[FRONT].tile[2][0];
-	cube[index].face[FRONT].tile[0][0] = cube[index].face[DOWN].tile[0][0];
-	cube[index].face[FRONT].tile[1][0] = cube[index].face[DOWN].tile[1][0];
-	cube[index].face[FRONT].tile[2][0] = cube[index].face[DOWN].tile[2][0];
-	cube[index].face[DOWN].tile[0][0] = cube[index].face[BACK].tile[2][2];
-	cube[index].face[DOWN].tile[1][0] = cube[index].face[BACK].tile[1][2];
-	cube[index].face[DOWN].tile[2][0] = cube[index].face[BACK].tile[0][2];
-	cube[index].face[BACK].tile[0][2] = savetile[2];
-	cube[index].face[BACK].tile[1][2] = savetile[1];
-	cube[index].face[BACK].tile[2][2] = savetile[0];
-}
-
-void abs_rotu(int index)
+	faces[UP].tile[0][0] = faces[FRONT].tile[0][0];
+	faces[UP].tile[1][0] = faces[FRONT].tile[1][0];
+	faces[UP].tile[2][0] = faces[FRONT].tile[2][0];
+	faces[FRONT].tile[0][0] = faces[DOWN].tile[0][0];
+	faces[FRONT].tile[1][0] = faces[DOWN].tile[1][0];
+	faces[FRONT].tile[2][0] = faces[DOWN].tile[2][0];
+	faces[DOWN].tile[0][0] = faces[BACK].tile[2][2];
+	faces[DOWN].tile[1][0] = faces[BACK].tile[1][2];
+	faces[DOWN].tile[2][0] = faces[BACK].tile[0][2];
+	faces[BACK].tile[0][2] = savetile[2];
+	faces[BACK].tile[1][2] = savetile[1];
+	faces[BACK].tile[2][2] = savetile[0];
+}
+
+void ref_rotu(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: up\n");
-	
-	cwface(index, UP);
+	cwface(faces, UP);
 	// buffer the frontside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[FRONT].tile[0][i];
+		savetile[i] = faces[FRONT].tile[0][i];
 	// preform the rotation of side tiles
-	cube[index].face[FRONT].tile[0][0] = cube[index].face[RIGHT].tile[0][0];
-	cube[index].face[FRONT].tile[0][1] = cube[index].face[RIGHT].tile[0][1];
-	cube[index].face[FRONT].tile[0][2] = cube[index].face[RIGHT].tile[0][2];
-	cube[index].face[RIGHT].tile[0][0] = cube[index].face[BACK].tile[0][0];
-	cube[index].face[RIGHT].tile[0][1] = cube[index].face[BACK].tile[0][1];
-	cube[index].face[RIGHT].tile[0][2] = cube[index].face[BACK].tile[0][2];
-	cube[index].face[BACK].tile[0][0] = cube[index].face[LEFT].tile[0][0];
-	cube[index].face[BACK].tile[0][1] = cube[index].face[LEFT].tile[0][1];
-	cube[index].face[BACK].tile[0][2] = cube[index].face[LEFT].tile[0][2];
-	cube[index].face[LEFT].tile[0][0] = savetile[0];
-	cube[index].face[LEFT].tile[0][1] = savetile[1];
-	cube[index].face[LEFT].tile[0][2] = savetile[2];
-}
-
-void abs_rotui(int index)
+	faces[FRONT].tile[0][0] = faces[RIGHT].tile[0][0];
+	faces[FRONT].tile[0][1] = faces[RIGHT].tile[0][1];
+	faces[FRONT].tile[0][2] = faces[RIGHT].tile[0][2];
+	faces[RIGHT].tile[0][0] = faces[BACK].tile[0][0];
+	faces[RIGHT].tile[0][1] = faces[BACK].tile[0][1];
+	faces[RIGHT].tile[0][2] = faces[BACK].tile[0][2];
+	faces[BACK].tile[0][0] = faces[LEFT].tile[0][0];
+	faces[BACK].tile[0][1] = faces[LEFT].tile[0][1];
+	faces[BACK].tile[0][2] = faces[LEFT].tile[0][2];
+	faces[LEFT].tile[0][0] = savetile[0];
+	faces[LEFT].tile[0][1] = savetile[1];
+	faces[LEFT].tile[0][2] = savetile[2];
+}
+
+void ref_rotui(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: up inverted\n");
-	
-	ccwface(index, UP);
+	ccwface(faces, UP);
 	// buffer the frontside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[FRONT].tile[0][i];
+		savetile[i] = faces[FRONT].tile[0][i];
 	// preform the rotation of side tiles
-	cube[index].face[FRONT].tile[0][0] = cube[index].face[LEFT].tile[0][0];
-	cube[index].face[FRONT].tile[0][1] = cube[index].face[LEFT].tile[0][1];
-	cube[index].face[FRONT].tile[0][2] = cube[index].face[LEFT].tile[0][2];
-	cube[index].face[LEFT].tile[0][0] = cube[index].face[BACK].tile[0][0];
-	cube[index].face[LEFT].tile[0][1] = cube[index].face[BACK].tile[0][1];
-	cube[index].face[LEFT].tile[0][2] = cube[index].face[BACK].tile[0][2];
-	cube[index].face[BACK].tile[0][0] = cube[index].face[RIGHT].tile[0][0];
-	cube[index].face[BACK].tile[0][1] = cube[index].face[RIGHT].tile[0][1];
-	cube[index].face[BACK].tile[0][2] = cube[index].face[RIGHT].tile[0][2];
-	cube[index].face[RIGHT].tile[0][0] = savetile[0];
-	cube[index].face[RIGHT].tile[0][1] = savetile[1];
-	cube[index].face[RIGHT].tile[0][2] = savetile[2];
-}
-
-void abs_rotd(int index)
+	faces[FRONT].tile[0][0] = faces[LEFT].tile[0][0];
+	faces[FRONT].tile[0][1] = faces[LEFT].tile[0][1];
+	faces[FRONT].tile[0][2] = faces[LEFT].tile[0][2];
+	faces[LEFT].tile[0][0] = faces[BACK].tile[0][0];
+	faces[LEFT].tile[0][1] = faces[BACK].tile[0][1];
+	faces[LEFT].tile[0][2] = faces[BACK].tile[0][2];
+	faces[BACK].tile[0][0] = faces[RIGHT].tile[0][0];
+	faces[BACK].tile[0][1] = faces[RIGHT].tile[0][1];
+	faces[BACK].tile[0][2] = faces[RIGHT].tile[0][2];
+	faces[RIGHT].tile[0][0] = savetile[0];
+	faces[RIGHT].tile[0][1] = savetile[1];
+	faces[RIGHT].tile[0][2] = savetile[2];
+}
+
+void ref_rotd(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: down\n");
-	
-	cwface(index, DOWN);
+	cwface(faces, DOWN);
 	// buffer the frontside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[FRONT].tile[2][i];
+		savetile[i] = faces[FRONT].tile[2][i];
 	// preform the rotation of side tiles
-	cube[index].face[FRONT].tile[2][0] = cube[index].face[LEFT].tile[2][0];
-	cube[index].face[FRONT].tile[2][1] = cube[index].face[LEFT].tile[2][1];
-	cube[index].face[FRONT].tile[2][2] = cube[index].face[LEFT].tile[2][2];
-	cube[index].face[LEFT].tile[2][0] = cube[index].face[BACK].tile[2][0];
-	cube[index].face[LEFT].tile[2][1] = cube[index].face[BACK].tile[2][1];
-	cube[index].face[LEFT].tile[2][2] = cube[index].face[BACK].tile[2][2];
-	cube[index].face[BACK].tile[2][0] = cube[index].face[RIGHT].tile[2][0];
-	cube[index].face[BACK].tile[2][1] = cube[index].face[RIGHT].tile[2][1];
-	cube[index].face[BACK].tile[2][2] = cube[index].face[RIGHT].tile[2][2];
-	cube[index].face[RIGHT].tile[2][0] = savetile[0];
-	cube[index].face[RIGHT].tile[2][1] = savetile[1];
-	cube[index].face[RIGHT].tile[2][2] = savetile[2];
-}
-
-void abs_rotdi(int index)
+	faces[FRONT].tile[2][0] = faces[LEFT].tile[2][0];
+	faces[FRONT].tile[2][1] = faces[LEFT].tile[2][1];
+	faces[FRONT].tile[2][2] = faces[LEFT].tile[2][2];
+	faces[LEFT].tile[2][0] = faces[BACK].tile[2][0];
+	faces[LEFT].tile[2][1] = faces[BACK].tile[2][1];
+	faces[LEFT].tile[2][2] = faces[BACK].tile[2][2];
+	faces[BACK].tile[2][0] = faces[RIGHT].tile[2][0];
+	faces[BACK].tile[2][1] = faces[RIGHT].tile[2][1];
+	faces[BACK].tile[2][2] = faces[RIGHT].tile[2][2];
+	faces[RIGHT].tile[2][0] = savetile[0];
+	faces[RIGHT].tile[2][1] = savetile[1];
+	faces[RIGHT].tile[2][2] = savetile[2];
+}
+
+void ref_rotdi(face_t *faces)
 {
-	if (LOGGING)
-		printf("rotate: down inverted\n");
-	
-	ccwface(index, DOWN);
+	ccwface(faces, DOWN);
 	// buffer the frontside tiles
 	int savetile[3];
 	for (int i = 0; i < 3; i++)
-		savetile[i] = cube[index].face[FRONT].tile[2][i];
+		savetile[i] = faces[FRONT].tile[2][i];
 	// preform the rotation of side tiles
-	cube[index].face[FRONT].tile[2][0] = cube[index].face[RIGHT].tile[2][0];
-	cube[index].face[FRONT].tile[2][1] = cube[index].face[RIGHT].tile[2][1];
-	cube[index].face[FRONT].tile[2][2] = cube[index].face[RIGHT].tile[2][2];
-	cube[index].face[RIGHT].tile[2][0] = cube[index].face[BACK].tile[2][0];
-	cube[index].face[RIGHT].tile[2][1] = cube[index].face[BACK].tile[2][1];
-	cube[index].face[RIGHT].tile[2][2] = cube[index].face[BACK].tile[2][2];
-	cube[index].face[BACK].tile[2][0] = cube[index].face[LEFT].tile[2][0];
-	cube[index].face[BACK].tile[2][1] = cube[index].face[LEFT].tile[2][1];
-	cube[index].face[BACK].tile[2][2] = cube[index].face[LEFT].tile[2][2];
-	cube[index].face[LEFT].tile[2][0] = savetile[0];
-	cube[index].face[LEFT].tile[2][1] = savetile[1];
-	cube[index].face[LEFT].tile[2][2] = savetile[2];
+	faces[FRONT].tile[2][0] = faces[RIGHT].tile[2][0];
+	faces[FRONT].tile[2][1] = faces[RIGHT].tile[2][1];
+	faces[FRONT].tile[2][2] = faces[RIGHT].tile[2][2];
+	faces[RIGHT].tile[2][0] = faces[BACK].tile[2][0];
+	faces[RIGHT].tile[2][1] = faces[BACK].tile[2][1];
+	faces[RIGHT].tile[2][2] = faces[BACK].tile[2][2];
+	faces[BACK].tile[2][0] = faces[LEFT].tile[2][0];
+	faces[BACK].tile[2][1] = faces[LEFT].tile[2][1];
+	faces[BACK].tile[2][2] = faces[LEFT].tile[2][2];
+	faces[LEFT].tile[2][0] = savetile[0];
+	faces[LEFT].tile[2][1] = savetile[1];
+	faces[LEFT].tile[2][2] = savetile[2];
 }
 
-// Absolute Indexed Rotate
-void abs_rot_indrot(int index, int rottype)
+void (*ref_rotators[12])(face_t *faces) = {
+	ref_rotu, ref_rotui, ref_rotb, ref_rotbi, ref_rotl, ref_rotli,
+	ref_rotf, ref_rotfi, ref_rotr, ref_rotri, ref_rotd, ref_rotdi
+};
+
+// Besides the 12 quarter turns, every fixed sequence in the macro catalog (below) gets a permutation of its
+// own, numbered from MACRO_BASE, so the kernels can apply a whole sequence in one pass
+#define MAX_SEQUENCES 128
+#define MACRO_BASE 12
+#define NUM_PERMS (MACRO_BASE + MAX_SEQUENCES)
+
+// move_table[m][i] is the facelet whose tile lands on facelet i when permutation m is applied
+unsigned char move_table[NUM_PERMS][NUM_FACELETS];
+
+// a quarter turn only moves 20 of the 54 facelets; move_dst/move_src list just the move_moved[m] facelets a
+// permutation touches, for applying moves quickly
+#define MOVED_FACELETS 20
+unsigned char move_dst[NUM_PERMS][NUM_FACELETS];
+unsigned char move_src[NUM_PERMS][NUM_FACELETS];
+unsigned char move_moved[NUM_PERMS];
+
+// the macro catalog; see Macro Moves
+#define MAX_SEQUENCE_MOVES 16
+#define SEQ_NONE -1 // the empty sequence
+
+typedef struct {
+	const char *text;
+	unsigned char moves[MAX_SEQUENCE_MOVES];
+	int length;
+} move_seq_t;
+
+move_seq_t sequences[MAX_SEQUENCES];
+int num_sequences = 0;
+
+const char *rotnames[12] = {
+	"up", "up inverted", "back", "back inverted", "left", "left inverted",
+	"front", "front inverted", "right", "right inverted", "down", "down inverted"
+};
+
+// Fill in move_dst/move_src for permutation m from its move table
+void list_moved_facelets(int m)
 {
-	switch (rottype)
+	int moved = 0;
+	for (int i = 0; i < NUM_FACELETS; i++)
 	{
-		case ROTU:	abs_rotu(index);	break;
-		case ROTUI:	abs_rotui(index);	break;
-		case ROTB:	abs_rotb(index);	break;
-		case ROTBI:	abs_rotbi(index);	break;
-		case ROTL:	abs_rotl(index);	break;
-		case ROTLI:	abs_rotli(index);	break;
-		case ROTF:	abs_rotf(index);	break;
-		case ROTFI:	abs_rotfi(index);	break;
-		case ROTR:	abs_rotr(index);	break;
-		case ROTRI:	abs_rotri(index);	break;
-		case ROTD:	abs_rotd(index);	break;
-		case ROTDI:	abs_rotdi(index);	break;
-		default: printf("Unknown rotation type!\n"); exit(-1); break;
+		if (move_table[m][i] != i)
+		{
+			move_dst[m][moved] = i;
+			move_src[m][moved] = move_table[m][i];
+			moved++;
+		}
 	}
+	move_moved[m] = moved;
 }
 
-// Locate a 2-block on the cube; return a block2pair index
-int locate_2block(int index, int color1, int color2)
+// Build the move tables by running each reference rotator over a cube labelled with facelet positions
+void init_move_tables(void)
 {
-	int i;
+	cube_t label;
 	
-	for (i = 0; i < 12; i++)
+	for (int m = ROTU; m <= ROTDI; m++)
 	{
-		// okay... block2pairs describes 12 pairs of adjoining tiles that form the 2-edged blocks on the cube.
-		// we're iterating through the list of pairs to see if each tile contains either color1 or color2.
-		if (((cube[index].face[block2pairs[i].faceid1].tile[block2pairs[i].tilex1][block2pairs[i].tiley1] == color1) &&
-			(cube[index].face[block2pairs[i].faceid2].tile[block2pairs[i].tilex2][block2pairs[i].tiley2] == color2)) ||
-			((cube[index].face[block2pairs[i].faceid1].tile[block2pairs[i].tilex1][block2pairs[i].tiley1] == color2) &&
-			 (cube[index].face[block2pairs[i].faceid2].tile[block2pairs[i].tilex2][block2pairs[i].tiley2] == color1)))
-			break;
+		for (int i = 0; i < NUM_FACELETS; i++)
+			label.facelet[i] = i;
+		ref_rotators[m](label.face);
+		memcpy(move_table[m], label.facelet, NUM_FACELETS);
+		list_moved_facelets(m);
 	}
+}
+
+// Move Kernels
+// A move is just a byte permutation of the 54 facelets, so it can be done with vector shuffles. The
+// kernel is picked at startup from what the CPU supports; every kernel gives exactly the same result.
+// Kernels take any permutation number, so they apply macro moves as well as quarter turns.
+typedef void (*move_kernel_t)(unsigned char *facelet, int rottype);
+
+void move_kernel_scalar(unsigned char *facelet, int rottype)
+{
+	// permute the facelets through the move table, touching only the ones that move
+	unsigned char save[NUM_FACELETS];
+	const unsigned char *dst = move_dst[rottype];
+	const unsigned char *src = move_src[rottype];
+	int moved = move_moved[rottype];
+	memcpy(save, facelet, NUM_FACELETS);
+	for (int i = 0; i < moved; i++)
+		facelet[dst[i]] = save[src[i]];
+}
+
+#if HAVE_X86_KERNELS
+// pshufb only shuffles within 16 bytes, so each 16 byte chunk of the result is gathered from each of the four
+// source chunks in turn. ssse3_mask[m][d][k] picks the bytes of destination chunk d that come from source
+// chunk k; every other lane is 0x80, which pshufb zeroes.
+_Alignas(64) unsigned char ssse3_mask[NUM_PERMS][4][4][16];
+
+// the same idea at 32 bytes: avx2_mask[m][d][k] shuffles source chunk k (broadcast to both lanes) into
+// destination half d
+_Alignas(64) unsigned char avx2_mask[NUM_PERMS][2][4][32];
+
+// vpermb permutes all 64 bytes across lanes in one go
+_Alignas(64) unsigned char vbmi_index[NUM_PERMS][64];
+
+// facelets 0..53 plus the two padding bytes, as the dwords that avx2 masked loads and stores operate on
+#define AVX2_HIGH_DWORDS 6
+#define VBMI_FACELET_MASK ((1ULL << NUM_FACELETS) - 1)
+
+void init_simd_mask(int m)
+{
+	// extend the move table over the padding bytes as the identity
+	unsigned char src[64];
+	for (int i = 0; i < 64; i++)
+		src[i] = (i < NUM_FACELETS) ? move_table[m][i] : i;
 	
-	return i;
+	for (int d = 0; d < 4; d++)
+		for (int k = 0; k < 4; k++)
+			for (int j = 0; j < 16; j++)
+				ssse3_mask[m][d][k][j] = (src[d * 16 + j] / 16 == k) ? (src[d * 16 + j] % 16) : 0x80;
+	
+	for (int d = 0; d < 2; d++)
+		for (int k = 0; k < 4; k++)
+			for (int j = 0; j < 32; j++)
+				avx2_mask[m][d][k][j] = (src[d * 32 + j] / 16 == k) ? (src[d * 32 + j] % 16) : 0x80;
+	
+	memcpy(vbmi_index[m], src, 64);
 }
 
-// find a 3-block on the cube, return a block3triplet index
-int locate_3block(int index, int color1, int color2, int color3)
+// macros interned before this runs get their masks here, later ones as they're interned
+void init_simd_masks(void)
 {
-	int i;
+	for (int m = 0; m < MACRO_BASE + num_sequences; m++)
+		init_simd_mask(m);
+}
+
+__attribute__((target("ssse3")))
+void move_kernel_ssse3(unsigned char *facelet, int rottype)
+{
+	__m128i src[4];
 	
-	for (i = 0; i < 8; i++)
+	src[0] = _mm_loadu_si128((const __m128i *)facelet);
+	src[1] = _mm_loadu_si128((const __m128i *)(facelet + 16));
+	src[2] = _mm_loadu_si128((const __m128i *)(facelet + 32));
+	src[3] = _mm_loadl_epi64((const __m128i *)(facelet + 48));
+	
+	__m128i dst[4];
+	for (int d = 0; d < 4; d++)
 	{
-		// same deal as above except we are matching 3 colors.
-		if (((cube[index].face[block3triplets[i].faceid1].tile[block3triplets[i].tilex1][block3triplets[i].tiley1] == color1) ||
-			(cube[index].face[block3triplets[i].faceid1].tile[block3triplets[i].tilex1][block3triplets[i].tiley1] == color2) ||
-			(cube[index].face[block3triplets[i].faceid1].tile[block3triplets[i].tilex1][block3triplets[i].tiley1] == color3)) &&
-			((cube[index].face[block3triplets[i].faceid2].tile[block3triplets[i].tilex2][block3triplets[i].tiley2] == color1) ||
-			 (cube[index].face[block3triplets[i].faceid2].tile[block3triplets[i].tilex2][block3triplets[i].tiley2] == color2) ||
-			 (cube[index].face[block3triplets[i].faceid2].tile[block3triplets[i].tilex2][block3triplets[i].tiley2] == color3)) &&
-			((cube[index].face[block3triplets[i].faceid3].tile[block3triplets[i].tilex3][block3triplets[i].tiley3] == color1) ||
-			 (cube[index].face[block3triplets[i].faceid3].tile[block3triplets[i].tilex3][block3triplets[i].tiley3] == color2) ||
-			 (cube[index].face[block3triplets[i].faceid3].tile[block3triplets[i].tilex3][block3triplets[i].tiley3] == color3)))
-			break;
+		dst[d] = _mm_shuffle_epi8(src[0], _mm_load_si128((const __m128i *)ssse3_mask[rottype][d][0]));
+		for (int k = 1; k < 4; k++)
+			dst[d] = _mm_or_si128(dst[d], _mm_shuffle_epi8(src[k], _mm_load_si128((const __m128i *)ssse3_mask[rottype][d][k])));
 	}
 	
-	return i;
+	_mm_storeu_si128((__m128i *)facelet, dst[0]);
+	_mm_storeu_si128((__m128i *)(facelet + 16), dst[1]);
+	_mm_storeu_si128((__m128i *)(facelet + 32), dst[2]);
+	_mm_storel_epi64((__m128i *)(facelet + 48), dst[3]);
 }
 
-void solve_green_cross(int index)
+__attribute__((target("avx2")))
+void move_kernel_avx2(unsigned char *facelet, int rottype)
 {
-	if (LOGGING)
-		printf("solve_green_cross: solving green cross:\n");
+	const __m256i high_mask = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+	__m256i low = _mm256_loadu_si256((const __m256i *)facelet);
+	__m256i high = _mm256_maskload_epi32((const int *)(facelet + 32), high_mask);
+	
+	// broadcast each 16 byte source chunk to both lanes, since vpshufb can't cross lanes either
+	__m256i src[4];
+	src[0] = _mm256_permute2x128_si256(low, low, 0x00);
+	src[1] = _mm256_permute2x128_si256(low, low, 0x11);
+	src[2] = _mm256_permute2x128_si256(high, high, 0x00);
+	src[3] = _mm256_permute2x128_si256(high, high, 0x11);
+	
+	__m256i dst[2];
+	for (int d = 0; d < 2; d++)
+	{
+		dst[d] = _mm256_shuffle_epi8(src[0], _mm256_load_si256((const __m256i *)avx2_mask[rottype][d][0]));
+		for (int k = 1; k < 4; k++)
+			dst[d] = _mm256_or_si256(dst[d], _mm256_shuffle_epi8(src[k], _mm256_load_si256((const __m256i *)avx2_mask[rottype][d][k])));
+	}
+	
+	_mm256_storeu_si256((__m256i *)facelet, dst[0]);
+	_mm256_maskstore_epi32((int *)(facelet + 32), high_mask, dst[1]);
+}
 
-	// find the green/white block
-	int gw2blockloc = locate_2block(index, GRN, WHT);
-	if (LOGGING)
-		printf("solve_green_cross: solve GRN/WHT: 2-block found at block2pair #%d.\n", gw2blockloc);
-	// swing it around to position GREENCROSSFRONT
-	switch (gw2blockloc)
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+void move_kernel_vbmi(unsigned char *facelet, int rottype)
+{
+	__m512i state = _mm512_maskz_loadu_epi8(VBMI_FACELET_MASK, facelet);
+	__m512i index = _mm512_load_si512((const void *)vbmi_index[rottype]);
+	_mm512_mask_storeu_epi8(facelet, VBMI_FACELET_MASK, _mm512_permutexvar_epi8(index, state));
+}
+#endif
+
+typedef struct {
+	const char *name;
+	move_kernel_t fn;
+	bool supported;
+} move_kernel_info_t;
+
+// in order of preference, worst first
+move_kernel_info_t move_kernels[] = {
+	{ "scalar", move_kernel_scalar, true },
+#if HAVE_X86_KERNELS
+	{ "ssse3", move_kernel_ssse3, false },
+	{ "avx2", move_kernel_avx2, false },
+	{ "vbmi", move_kernel_vbmi, false },
+#endif
+};
+
+#define NUM_MOVE_KERNELS (int)(sizeof(move_kernels) / sizeof(move_kernels[0]))
+
+move_kernel_t move_kernel = move_kernel_scalar;
+const char *move_kernel_name = "scalar";
+
+// Probe the CPU and select the best move kernel it can run
+void init_move_kernel(void)
+{
+#if HAVE_X86_KERNELS
+	init_simd_masks();
+	__builtin_cpu_init();
+	move_kernels[1].supported = __builtin_cpu_supports("ssse3");
+	move_kernels[2].supported = __builtin_cpu_supports("avx2");
+	move_kernels[3].supported = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+		__builtin_cpu_supports("avx512vbmi");
+#endif
+	for (int k = 0; k < NUM_MOVE_KERNELS; k++)
 	{
-		case GREENCROSSFRONT:
-			// in the right spot, no need to do anything
-			break;
-		case GREENCROSSLEFT:
-			abs_rotd(index);
-			break;
-		case GREENCROSSBACK:
-			abs_rotd(index);
-			abs_rotd(index);
-			break;
-		case GREENCROSSRIGHT:
-			abs_rotdi(index);
-			break;
-		case MIDDLEFRONTLEFT:
-			abs_rotfi(index);
-			break;
-		case MIDDLEBACKLEFT:
-			abs_rotli(index);
-			abs_rotd(index);
-			break;
-		case MIDDLEBACKRIGHT:
-			abs_rotr(index);
-			abs_rotdi(index);
-			break;
-		case MIDDLEFRONTRIGHT:
-			abs_rotf(index);
-			break;
-		case BLUECROSSFRONT:
-			abs_rotf(index);
-			abs_rotf(index);
-			break;
-		case BLUECROSSLEFT:
-			abs_rotl(index);
-			abs_rotl(index);
-			abs_rotd(index);
-			break;
-		case BLUECROSSBACK:
-			abs_rotu(index);
-			abs_rotu(index);
-			abs_rotf(index);
-			abs_rotf(index);
-			break;
-		case BLUECROSSRIGHT:
-			abs_rotri(index);
-			abs_rotri(index);
-			abs_rotdi(index);
+		if (move_kernels[k].supported)
+		{
+			move_kernel = move_kernels[k].fn;
+			move_kernel_name = move_kernels[k].name;
+		}
 	}
-	// check if the GRN/WHT piece is inverted; if it is, fUlu it
-	if (cube[index].face[DOWN].tile[0][1] == WHT)
+}
+
+// Force a particular move kernel; returns false if it doesn't exist or the CPU can't run it
+bool select_move_kernel(const char *name)
+{
+	for (int k = 0; k < NUM_MOVE_KERNELS; k++)
 	{
-		if (LOGGING)
-			printf("solve_green_cross: solve GRN/WHT: fUlu\n");
-		abs_rotfi(index);
-		abs_rotd(index);
-		abs_rotri(index);
-		abs_rotdi(index);
+		if ((strcmp(move_kernels[k].name, name) == 0) && move_kernels[k].supported)
+		{
+			move_kernel = move_kernels[k].fn;
+			move_kernel_name = move_kernels[k].name;
+			return true;
+		}
 	}
+	return false;
+}
 
-	// find the green/orange block
-	int go2blockloc = locate_2block(index, GRN, ORG);
-	if (LOGGING)
-		printf("solve_green_cross: solve GRN/ORG: 2-block found at block2pair #%d.\n", go2blockloc);
-	// swing it around to position GREENCROSSLEFT
-	switch (go2blockloc)
+// Macro Moves
+// Fixed move sequences are written in the same shorthand as the comments, e.g. "Fi D Ri Di", and interned
+// into a catalog at startup. Interning composes the sequence into a single facelet permutation, numbered
+// MACRO_BASE + its catalog number, that every move kernel can apply in one pass; the moves are still credited
+// one by one to the move counters.
+const char *move_notation[12] = { "U", "Ui", "B", "Bi", "L", "Li", "F", "Fi", "R", "Ri", "D", "Di" };
+
+// Look up a sequence in the catalog, adding it if it's new. The empty sequence is SEQ_NONE.
+int intern_sequence(const char *text)
+{
+	for (int i = 0; i < num_sequences; i++)
+		if (strcmp(sequences[i].text, text) == 0)
+			return i;
+	
+	move_seq_t seq;
+	seq.text = text;
+	seq.length = 0;
+	const char *p = text;
+	while (*p != '\0')
 	{
-		// not going to be at pos 0 since we solved GRN/WHT already
-		case GREENCROSSLEFT:
-			// do nothing, its in the right place
-			break;
-		case GREENCROSSBACK:
-			abs_rotbi(index);
-			abs_rotli(index);
-			break;
-		case GREENCROSSRIGHT:
-			abs_rotri(index);
-			abs_rotb(index);
-			abs_rotb(index);
-			abs_rotli(index);
-			break;
-		case MIDDLEFRONTLEFT:
-			abs_rotl(index);
-			break;
-		case MIDDLEBACKLEFT:
-			abs_rotli(index);
-			break;
-		case MIDDLEBACKRIGHT:
-			abs_rotb(index);
-			abs_rotui(index);
-			abs_rotl(index);
-			abs_rotl(index);
-			break;
-		case MIDDLEFRONTRIGHT:
-			abs_rotr(index);
-			abs_rotu(index);
-			abs_rotu(index);
-			abs_rotl(index);
-			abs_rotl(index);
-			break;
-		case BLUECROSSFRONT:
-			abs_rotu(index);
-			abs_rotl(index);
-			abs_rotl(index);
-			break;
-		case BLUECROSSLEFT:
-			abs_rotl(index);
-			abs_rotl(index);
-			break;
-		case BLUECROSSBACK:
-			abs_rotui(index);
-			abs_rotl(index);
-			abs_rotl(index);
-			break;
-		case BLUECROSSRIGHT:
-			abs_rotu(index);
-			abs_rotu(index);
-			abs_rotl(index);
-			abs_rotl(index);
-			break;			
+		if (*p == ' ')
+		{
+			p++;
+			continue;
+		}
+		int len = 1 + (p[1] == 'i');
+		int m;
+		for (m = ROTU; m <= ROTDI; m++)
+			if ((strncmp(p, move_notation[m], len) == 0) && (move_notation[m][len] == '\0'))
+				break;
+		if ((m > ROTDI) || (seq.length == MAX_SEQUENCE_MOVES))
+		{
+			printf("Bad move sequence \"%s\"!\n", text);
+			exit(-1);
+		}
+		seq.moves[seq.length++] = m;
+		p += len;
 	}
-	// check if the GRN/ORG piece is inverted; if it is, fUlu it
-	if (cube[index].face[DOWN].tile[1][0] == ORG)
+	
+	if (seq.length == 0)
+		return SEQ_NONE;
+	if (num_sequences == MAX_SEQUENCES)
 	{
-		if (LOGGING)
-			printf("solve_green_cross: solve GRN/ORG: fUlu\n");
-		abs_rotli(index);
-		abs_rotd(index);
-		abs_rotfi(index);
-		abs_rotdi(index);
+		printf("Too many move sequences!\n");
+		exit(-1);
 	}
-
-	// find the green/red block
-	int gr2blockloc = locate_2block(index, GRN, RED);
-	if (LOGGING)
-		printf("solve_green_cross: solve GRN/RED: 2-block found at block2pair #%d.\n", gr2blockloc);
-	// swing it around to position 3
-	switch (gr2blockloc)
+	sequences[num_sequences] = seq;
+	
+	// compose the moves: applying m after p takes facelet i from p's facelet move_table[m][i]
+	int perm = MACRO_BASE + num_sequences;
+	for (int i = 0; i < NUM_FACELETS; i++)
+		move_table[perm][i] = i;
+	for (int k = 0; k < seq.length; k++)
 	{
-		// not going to be at pos 0 or 1 since we solved GRN/WHT and GRN/ORG already
-		case GREENCROSSBACK:
-			abs_rotb(index);
-			abs_rotr(index);
-			break;
-		case GREENCROSSRIGHT:
-			// nothing to do
-			break;
-		case MIDDLEFRONTLEFT:
-			abs_rotli(index);
-			abs_rotui(index);
-			abs_rotl(index);
-			abs_rotui(index);
-			abs_rotri(index);
-			abs_rotri(index);
-			break;
-		case MIDDLEBACKLEFT:
-			abs_rotbi(index);
-			abs_rotu(index);
-			abs_rotri(index);
-			abs_rotri(index);
-			break;
-		case MIDDLEBACKRIGHT:
-			abs_rotr(index);
-			break;
-		case MIDDLEFRONTRIGHT:
-			abs_rotri(index);
-			break;
-		case BLUECROSSFRONT:
-			abs_rotui(index);
-			abs_rotri(index);
-			abs_rotri(index);
-			break;
-		case BLUECROSSLEFT:
-			abs_rotui(index);
-			abs_rotui(index);
-			abs_rotri(index);
-			abs_rotri(index);
-			break;
-		case BLUECROSSBACK:
-			abs_rotu(index);
-			abs_rotri(index);
-			abs_rotri(index);
-			break;
-		case BLUECROSSRIGHT:
-			abs_rotri(index);
-			abs_rotri(index);
-			break;
+		unsigned char composed[NUM_FACELETS];
+		for (int i = 0; i < NUM_FACELETS; i++)
+			composed[i] = move_table[perm][move_table[seq.moves[k]][i]];
+		memcpy(move_table[perm], composed, NUM_FACELETS);
 	}
-	// check if the GRN/RED piece is inverted; if it is, fUlu it
-	if (cube[index].face[DOWN].tile[1][2] == RED)
+	list_moved_facelets(perm);
+#if HAVE_X86_KERNELS
+	init_simd_mask(perm);
+#endif
+	return num_sequences++;
+}
+
+// The named algorithms the stage functions use
+enum {
+	MACRO_FLIP_GRN_WHT, MACRO_FLIP_GRN_ORG, MACRO_FLIP_GRN_RED, MACRO_FLIP_GRN_YEL,
+	MACRO_RDRD_GRN_ORG_WHT, MACRO_RDRD_GRN_ORG_YEL, MACRO_RDRD_GRN_YEL_RED, MACRO_RDRD_GRN_WHT_RED,
+	MACRO_LAY_LEFT_FRONT, MACRO_LAY_RIGHT_BACK, MACRO_LAY_LEFT_BACK, MACRO_LAY_RIGHT_FRONT,
+	MACRO_LAY_WHT_ORG_INVERTED, MACRO_LAY_WHT_RED_INVERTED, MACRO_LAY_YEL_ORG_INVERTED, MACRO_LAY_YEL_RED_INVERTED,
+	MACRO_CROSS_FRONT, MACRO_CROSS_RIGHT, MACRO_CROSS_LEFT, MACRO_CROSS_BACK,
+	MACRO_CROSS_SWAP, MACRO_CROSS_PARITY,
+	MACRO_CYCLE_FRONT_LEFT, MACRO_CYCLE_BACK_LEFT, MACRO_CYCLE_BACK_RIGHT, MACRO_CYCLE_FRONT_RIGHT,
+	MACRO_TWIST_LEFT, MACRO_TWIST_BACK, MACRO_TWIST_RIGHT, MACRO_TWIST_FRONT,
+	NUM_MACROS
+};
+
+const char *macro_text[NUM_MACROS] = {
+	"Fi D Ri Di", "Li D Fi Di", "Ri D Bi Di", "Bi D Li Di",
+	"Li Ui L U", "Bi Ui B U", "Ri Ui R U", "Fi Ui F U",
+	"Ui Li U L U F Ui Fi", "U L Ui Li Ui Bi U B", "Ui Ri U R U B Ui Bi", "U R Ui Ri Ui Fi U F",
+	"U U F Ui Fi Ui Li U L", "Ui Ui Fi U F U R Ui Ri", "Ui Ui Bi U B U L Ui Li", "U U B Ui Bi Ui Ri U R",
+	"F R U Ri Ui Fi", "R B U Bi Ui Ri", "L F U Fi Ui Li", "B L U Li Ui Bi",
+	"R U Ri U R U U Ri", "F U Fi U F U U Fi",
+	"U F Ui Bi U Fi Ui B", "U L Ui Ri U Li Ui R", "U B Ui Fi U Bi Ui F", "U R Ui Li U Ri Ui L",
+	"Fi Di F D", "Li Di L D", "Bi Di B D", "Ri Di R D"
+};
+
+int macro_seq[NUM_MACROS];
+
+void init_macro_moves(void)
+{
+	for (int i = 0; i < NUM_MACROS; i++)
+		macro_seq[i] = intern_sequence(macro_text[i]);
+}
+
+
+// Solution Recording
+// With recording on, every move a solver makes is also written to the cube's recording arena as a 4 bit
+// code (the Moves enum value), two to a byte. Each stage of a cube's solve is one span of the arena, so
+// solution->stage[s] marks exactly where stage s begins and ends. Arenas hand out big chunks and only ever
+// append, so there is no allocation per cube; the spans stay valid until the arena is reset or freed. The
+// batch driver gives each of its threads an arena, and frees them all with free_move_arenas.
+#define ARENA_CHUNK_BYTES (1 << 20)
+
+typedef struct move_chunk {
+	struct move_chunk *next;
+	size_t size; // bytes
+	unsigned char bytes[];
+} move_chunk_t;
+
+struct move_arena {
+	struct move_arena *next; // every driver thread's arena, for freeing
+	move_chunk_t *chunk; // the chunk being filled; older ones hang off its next
+	size_t used; // nibbles used in chunk
+	size_t capacity; // nibbles in chunk
+	size_t span_start; // nibble where the open span began
+};
+
+bool record_solutions = false;
+solution_t *solutions = NULL; // one per cube array slot
+_Thread_local move_arena_t *thread_arena = NULL; // this thread's arena
+
+move_arena_t *all_arenas = NULL;
+pthread_mutex_t all_arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+
+move_chunk_t *move_chunk_create(size_t size, move_chunk_t *next)
+{
+	move_chunk_t *chunk = malloc(sizeof(move_chunk_t) + size);
+	if (chunk == NULL)
 	{
-		if (LOGGING)
-			printf("solve_green_cross: solve GRN/RED: fUlu\n");
-		abs_rotri(index);
-		abs_rotd(index);
-		abs_rotbi(index);
-		abs_rotdi(index);
+		printf("Unable to allocate move arena!\n");
+		exit(-1);
 	}
+	chunk->next = next;
+	chunk->size = size;
+	return chunk;
+}
 
-	// find the green/yellow block
-	int gy2blockloc = locate_2block(index, GRN, YEL);
-	if (LOGGING)
-		printf("solve_green_cross: solve GRN/YEL: 2-block found at block2pair #%d.\n", gy2blockloc);
-	// swing it around to position 2
-	switch (gy2blockloc)
+// Make a new, empty arena, for one thread's use
+move_arena_t *move_arena_create(void)
+{
+	move_arena_t *arena = calloc(1, sizeof(move_arena_t));
+	if (arena == NULL)
 	{
-			// not going to be at pos 0, 1 or 3
-		case GREENCROSSBACK:
-			// nothing to do
-			break;
-		case MIDDLEFRONTLEFT:
-			abs_rotli(index);
-			abs_rotu(index);
-			abs_rotl(index);
-			abs_rotb(index);
-			abs_rotb(index);
-			break;
-		case MIDDLEBACKLEFT:
-			abs_rotb(index);
-			break;
-		case MIDDLEBACKRIGHT:
-			abs_rotbi(index);
-			break;
-		case MIDDLEFRONTRIGHT:
-			abs_rotr(index);
-			abs_rotui(index);
-			abs_rotri(index);
-			abs_rotb(index);
-			abs_rotb(index);
-			break;
-		case BLUECROSSFRONT:
-			abs_rotu(index);
-			abs_rotu(index);
-			abs_rotb(index);
-			abs_rotb(index);
-			break;
-		case BLUECROSSLEFT:
-			abs_rotu(index);
-			abs_rotb(index);
-			abs_rotb(index);
-			break;
-		case BLUECROSSBACK:
-			abs_rotb(index);
-			abs_rotb(index);
-			break;
-		case BLUECROSSRIGHT:
-			abs_rotui(index);
-			abs_rotb(index);
-			abs_rotb(index);
-			break;
+		printf("Unable to allocate move arena!\n");
+		exit(-1);
 	}
-	// check if the GRN/YEL piece is inverted; if it is, fUlu it
-	if (cube[index].face[DOWN].tile[2][1] == YEL)
+	arena->chunk = move_chunk_create(ARENA_CHUNK_BYTES, NULL);
+	arena->capacity = ARENA_CHUNK_BYTES * 2;
+	return arena;
+}
+
+// Forget everything recorded in an arena, keeping its newest chunk to fill again
+void move_arena_reset(move_arena_t *arena)
+{
+	while (arena->chunk->next != NULL)
 	{
-		if (LOGGING)
-			printf("solve_green_cross: solve GRN/YEL: fUlu\n");
-		abs_rotbi(index);
-		abs_rotd(index);
-		abs_rotli(index);
-		abs_rotdi(index);
+		move_chunk_t *chunk = arena->chunk->next;
+		arena->chunk->next = chunk->next;
+		free(chunk);
 	}
+	arena->used = 0;
+	arena->span_start = 0;
+}
 
-	cube[index].solveGreenCrossMoves = cube[index].totalMoves;
-	
-	if (LOGGING)
-		printf("solve_green_cross: solved green cross.\n");
+void move_arena_free(move_arena_t *arena)
+{
+	while (arena->chunk != NULL)
+	{
+		move_chunk_t *chunk = arena->chunk;
+		arena->chunk = chunk->next;
+		free(chunk);
+	}
+	free(arena);
 }
 
-void solve_green_corners(int index)
+// Make the calling driver thread's arena
+void create_thread_arena(void)
 {
-	// find the green/orange/white block
-	int gow3blockloc = locate_3block(index, GRN, ORG, WHT);
-	if (LOGGING)
-		printf("solve_green_corners: solve GRN/ORG/WHT: 3-block found at block3triplet #%d.\n", gow3blockloc);
-	// swing it around to either positions 0 or 4 (GREENCORNERFRONTLEFT or BLUECORNERFRONTLEFT)
-	switch (gow3blockloc)
+	thread_arena = move_arena_create();
+	pthread_mutex_lock(&all_arenas_lock);
+	thread_arena->next = all_arenas;
+	all_arenas = thread_arena;
+	pthread_mutex_unlock(&all_arenas_lock);
+}
+
+// Free every driver thread's arena, and with them every recorded solution
+void free_move_arenas(void)
+{
+	while (all_arenas != NULL)
 	{
-		case GREENCORNERFRONTLEFT:
-			// cool, nothing to do
-			break;
-		case GREENCORNERBACKLEFT:
-			abs_rotbi(index);
-			abs_rotui(index);
-			abs_rotb(index);
-			break;
-		case GREENCORNERBACKRIGHT:
-			abs_rotb(index);
-			abs_rotu(index);
-			abs_rotu(index);
-			abs_rotbi(index);
-			break;
-		case GREENCORNERFRONTRIGHT:
-			abs_rotr(index);
-			abs_rotu(index);
-			abs_rotri(index);
-			break;
-		case BLUECORNERFRONTLEFT:
-			// this position is cool too
-			break;
-		case BLUECORNERBACKLEFT:
-			abs_rotui(index);
-			break;
-		case BLUECORNERBACKRIGHT:
-			abs_rotui(index);
-			abs_rotui(index);
-			break;
-		case BLUECORNERFRONTRIGHT:
-			abs_rotu(index);
-			break;
+		move_arena_t *arena = all_arenas;
+		all_arenas = arena->next;
+		move_arena_free(arena);
 	}
-	// rdRD the cube up to 6 times to get the piece in place
-	for (int i = 0; i < 6; i++)
+}
+
+// The chunk is full: start a fresh one, carrying over the open span so it stays contiguous
+void move_arena_grow(move_arena_t *arena)
+{
+	size_t span_bytes = (arena->used - arena->span_start + 1) / 2;
+	size_t size = (span_bytes * 2 > ARENA_CHUNK_BYTES) ? span_bytes * 2 : ARENA_CHUNK_BYTES;
+	move_chunk_t *chunk = move_chunk_create(size, arena->chunk);
+	memcpy(chunk->bytes, arena->chunk->bytes + arena->span_start / 2, span_bytes);
+	arena->chunk = chunk;
+	arena->used -= arena->span_start;
+	arena->span_start = 0;
+	arena->capacity = size * 2;
+}
+
+static inline void move_arena_put(move_arena_t *arena, int move)
+{
+	if (arena->used == arena->capacity)
+		move_arena_grow(arena);
+	unsigned char *byte = &arena->chunk->bytes[arena->used / 2];
+	if (arena->used & 1)
+		*byte |= move << 4;
+	else
+		*byte = move;
+	arena->used++;
+}
+
+// Spans start on a byte boundary
+void move_arena_begin_span(move_arena_t *arena)
+{
+	arena->used = (arena->used + 1) & ~(size_t)1;
+	arena->span_start = arena->used;
+}
+
+void move_arena_end_span(move_arena_t *arena, move_span_t *span)
+{
+	span->bytes = arena->chunk->bytes + arena->span_start / 2;
+	span->length = arena->used - arena->span_start;
+}
+
+// Unpack move i of a span
+static inline int move_span_get(const move_span_t *span, unsigned int i)
+{
+	return (span->bytes[i / 2] >> ((i & 1) * 4)) & 0x0f;
+}
+
+// Number of moves in a solution, over all stages
+unsigned int solution_length(const solution_t *solution)
+{
+	unsigned int length = 0;
+	for (int s = 0; s < 5; s++)
+		length += solution->stage[s].length;
+	return length;
+}
+
+// Unpack the moves of stage s of a solution into moves, returning how many there were
+unsigned int solution_stage_moves(const solution_t *solution, int stage, unsigned char *moves)
+{
+	const move_span_t *span = &solution->stage[stage];
+	for (unsigned int i = 0; i < span->length; i++)
+		moves[i] = move_span_get(span, i);
+	return span->length;
+}
+
+// Write a solution as one line of move shorthand, with a / between stages
+void write_solution(FILE *out, const solution_t *solution)
+{
+	for (int s = 0; s < 5; s++)
 	{
-		// check to see if we got it
-		if ((cube[index].face[FRONT].tile[2][0] == WHT) &&
-			(cube[index].face[LEFT].tile[2][2] == ORG) &&
-			(cube[index].face[DOWN].tile[0][0] == GRN))
-			break;
-		if (LOGGING)
-			printf("solve_green_corners: solve GRN/ORG/WHT: rdRD\n");
-		// rdRD the cube
-		abs_rotli(index);
-		abs_rotui(index);
-		abs_rotl(index);
-		abs_rotu(index);
+		const move_span_t *span = &solution->stage[s];
+		if (s > 0)
+			fputs(" /", out);
+		for (unsigned int i = 0; i < span->length; i++)
+		{
+			if ((s > 0) || (i > 0))
+				fputc(' ', out);
+			fputs(move_notation[move_span_get(span, i)], out);
+		}
 	}
+	fputc('\n', out);
+}
 
-	// find the green/orange/yellow block
-	int goy3blockloc = locate_3block(index, GRN, ORG, YEL);
-	if (LOGGING)
-		printf("solve_green_corners: solve GRN/ORG/YEL: 3-block found at block3triplet #%d.\n", goy3blockloc);
-	// swing it around to either positions 1 or 5 (GREENCORNERBACKLEFT or BLUECORNERBACKLEFT)
-	switch (goy3blockloc)
+// Peephole Optimizer
+// Stages are applied back to back, so recorded solutions have waste like "U Ui", "U U U", or a stage's
+// closing U turns meeting the next stage's opening ones. peephole_pass makes one pass over a move list, keeping
+// a stack of face turns: a turn of the same face as the top of the stack merges into it (cancelling if it comes
+// to nothing), and since turns of opposite faces commute, a turn can also merge past one opposite face turn
+// into the same face below it. A merged turn stays in the stage of its first move; half turns are written
+// back as two quarter turns.
+#define MAX_SOLUTION_MOVES 1024
+
+bool optimize_solutions = false;
+
+const int opposite_face[6] = { DOWN, FRONT, RIGHT, BACK, LEFT, UP };
+
+// a move of a solution, tagged with the stage it's credited to
+typedef struct {
+	unsigned char move;
+	unsigned char stage;
+} staged_move_t;
+
+typedef struct {
+	unsigned char face;
+	unsigned char quarters; // clockwise quarter turns, 1 to 3
+	unsigned char stage;
+} face_turn_t;
+
+// Merge quarters clockwise quarter turns into turn t of the stack; returns false if they cancel out
+static inline bool merge_turn(face_turn_t *t, int quarters)
+{
+	t->quarters = (t->quarters + quarters) & 3;
+	return t->quarters != 0;
+}
+
+// Optimize n moves in place, returning how many are left
+int peephole_pass(staged_move_t *moves, int n)
+{
+	face_turn_t turns[MAX_SOLUTION_MOVES];
+	int num_turns = 0;
+	
+	for (int i = 0; i < n; i++)
 	{
-		case GREENCORNERBACKLEFT:
-			// nothing to do
-			break;
-		case GREENCORNERBACKRIGHT:
-			abs_rotb(index);
-			abs_rotu(index);
-			abs_rotbi(index);
-			abs_rotu(index);
-			abs_rotu(index);
-			break;
-		case GREENCORNERFRONTRIGHT:
-			abs_rotr(index);
-			abs_rotui(index);
-			abs_rotui(index);
-			abs_rotri(index);
-			break;
-		case BLUECORNERFRONTLEFT:
-			abs_rotu(index);
-			break;
-		case BLUECORNERBACKLEFT:
-			// nothing to do
-			break;
-		case BLUECORNERBACKRIGHT:
-			abs_rotui(index);
-			break;
-		case BLUECORNERFRONTRIGHT:
-			abs_rotu(index);
-			abs_rotu(index);
-			break;
+		int face = moves[i].move / 2;
+		int quarters = (moves[i].move & 1) ? 3 : 1;
+		
+		if ((num_turns > 0) && (turns[num_turns - 1].face == face))
+		{
+			if (!merge_turn(&turns[num_turns - 1], quarters))
+				num_turns--;
+		}
+		else if ((num_turns > 1) && (turns[num_turns - 1].face == opposite_face[face]) && (turns[num_turns - 2].face == face))
+		{
+			if (!merge_turn(&turns[num_turns - 2], quarters))
+			{
+				turns[num_turns - 2] = turns[num_turns - 1];
+				num_turns--;
+			}
+		}
+		else
+		{
+			turns[num_turns].face = face;
+			turns[num_turns].quarters = quarters;
+			turns[num_turns].stage = moves[i].stage;
+			num_turns++;
+		}
 	}
-	// rdRD the cube up to 6 times to get the piece in place
-	for (int i = 0; i < 6; i++)
+	
+	n = 0;
+	for (int t = 0; t < num_turns; t++)
 	{
-		// check to see if we got it
-		if ((cube[index].face[BACK].tile[2][2] == YEL) &&
-			(cube[index].face[LEFT].tile[2][0] == ORG) &&
-			(cube[index].face[DOWN].tile[2][0] == GRN))
-			break;
-		if (LOGGING)
-			printf("solve_green_corners: solve GRN/ORG/YEL: rdRD\n");
-		// rdRD the cube
-		abs_rotbi(index);
-		abs_rotui(index);
-		abs_rotb(index);
-		abs_rotu(index);
+		int move = turns[t].face * 2 + ((turns[t].quarters == 3) ? 1 : 0);
+		for (int q = (turns[t].quarters == 2) ? 2 : 1; q > 0; q--)
+		{
+			moves[n].move = move;
+			moves[n].stage = turns[t].stage;
+			n++;
+		}
 	}
+	return n;
+}
 
-	// find the green/yellow/red block
-	int gyr3blockloc = locate_3block(index, GRN, YEL, RED);
-	if (LOGGING)
-		printf("solve_green_corners: solve GRN/YEL/RED: 3-block found at block3triplet #%d.\n", gyr3blockloc);
-	// swing it around to either positions 2 or 6 (GREENCORNERBACKRIGHT or BLUECORNERBACKRIGHT)
-	switch (gyr3blockloc)
+// Cubie Representation
+// Besides the facelets, a cube can be described by where each of its 8 corner and 12 edge pieces sits and how
+// it is turned. Pieces and slots are both numbered by their home position:
+enum { URF, UFL, ULB, UBR, DFR, DLF, DBL, DRB };
+enum { UR, UF, UL, UB, DR, DF, DL, DB, FR, FL, BL, BR };
+
+// Each piece has a reference sticker: the up/down colored sticker of a corner, and the up/down (or, for the
+// middle edges, front/back) colored sticker of an edge. A piece's location is slot * 3 + twist for corners and
+// slot * 2 + flip for edges, where twist/flip is which of the slot's facelets (in the order listed below) the
+// reference sticker is on. Locations are 5 bits each, so all corners pack into one 64-bit word and all edges
+// into another; finding a piece is a shift and a mask.
+#define CORNER_LOCS 24
+#define EDGE_LOCS 24
+#define CUBIE_BITS 5
+#define CUBIE_MASK 31
+
+#define FACELET(face, row, col) ((face) * 9 + (row) * 3 + (col))
+
+// facelets of each corner slot, clockwise starting with the up/down facelet
+const unsigned char corner_facelet[8][3] = {
+	{ FACELET(UP, 2, 2), FACELET(RIGHT, 0, 0), FACELET(FRONT, 0, 2) },
+	{ FACELET(UP, 2, 0), FACELET(FRONT, 0, 0), FACELET(LEFT, 0, 2) },
+	{ FACELET(UP, 0, 0), FACELET(LEFT, 0, 0), FACELET(BACK, 0, 2) },
+	{ FACELET(UP, 0, 2), FACELET(BACK, 0, 0), FACELET(RIGHT, 0, 2) },
+	{ FACELET(DOWN, 0, 2), FACELET(FRONT, 2, 2), FACELET(RIGHT, 2, 0) },
+	{ FACELET(DOWN, 0, 0), FACELET(LEFT, 2, 2), FACELET(FRONT, 2, 0) },
+	{ FACELET(DOWN, 2, 0), FACELET(BACK, 2, 2), FACELET(LEFT, 2, 0) },
+	{ FACELET(DOWN, 2, 2), FACELET(RIGHT, 2, 2), FACELET(BACK, 2, 0) }
+};
+
+// facelets of each edge slot, up/down (or front/back) facelet first
+const unsigned char edge_facelet[12][2] = {
+	{ FACELET(UP, 1, 2), FACELET(RIGHT, 0, 1) },
+	{ FACELET(UP, 2, 1), FACELET(FRONT, 0, 1) },
+	{ FACELET(UP, 1, 0), FACELET(LEFT, 0, 1) },
+	{ FACELET(UP, 0, 1), FACELET(BACK, 0, 1) },
+	{ FACELET(DOWN, 1, 2), FACELET(RIGHT, 2, 1) },
+	{ FACELET(DOWN, 0, 1), FACELET(FRONT, 2, 1) },
+	{ FACELET(DOWN, 1, 0), FACELET(LEFT, 2, 1) },
+	{ FACELET(DOWN, 2, 1), FACELET(BACK, 2, 1) },
+	{ FACELET(FRONT, 1, 2), FACELET(RIGHT, 1, 0) },
+	{ FACELET(FRONT, 1, 0), FACELET(LEFT, 1, 2) },
+	{ FACELET(BACK, 1, 2), FACELET(LEFT, 1, 0) },
+	{ FACELET(BACK, 1, 0), FACELET(RIGHT, 1, 2) }
+};
+
+// colors of each piece, in the same order as the facelets of its home slot. a face's color has the same
+// number as the face, so a piece's colors are just the faces of its home facelets.
+unsigned char corner_color[8][3];
+unsigned char edge_color[12][2];
+
+// piece with a given set of colors, indexed by a bitmask of the colors
+signed char corner_by_colors[64];
+signed char edge_by_colors[64];
+
+// where a piece's reference sticker ends up after a move, or after a catalog sequence (at MACRO_BASE + its
+// number). init_cubie_tables fills these in for every sequence interned by then, which takes in the macros;
+// sequences interned later need an init_cubie_move of their own.
+unsigned char corner_move[NUM_PERMS][CORNER_LOCS];
+unsigned char edge_move[NUM_PERMS][EDGE_LOCS];
+
+// which corner/edge location each facelet is, or -1
+signed char corner_loc_of[NUM_FACELETS];
+signed char edge_loc_of[NUM_FACELETS];
+
+// block3triplets/block2pairs index of each slot, so cubie lookups answer in the solver's terms
+signed char block3_of_slot[8];
+signed char block2_of_slot[12];
+
+cubie_t solved_cubie;
+
+static inline int cubie_corner(const cubie_t *c, int piece)
+{
+	return (c->corners >> (piece * CUBIE_BITS)) & CUBIE_MASK;
+}
+
+static inline int cubie_edge(const cubie_t *c, int piece)
+{
+	return (c->edges >> (piece * CUBIE_BITS)) & CUBIE_MASK;
+}
+
+static inline void cubie_set_corner(cubie_t *c, int piece, int loc)
+{
+	c->corners = (c->corners & ~((uint64_t)CUBIE_MASK << (piece * CUBIE_BITS))) | ((uint64_t)loc << (piece * CUBIE_BITS));
+}
+
+static inline void cubie_set_edge(cubie_t *c, int piece, int loc)
+{
+	c->edges = (c->edges & ~((uint64_t)CUBIE_MASK << (piece * CUBIE_BITS))) | ((uint64_t)loc << (piece * CUBIE_BITS));
+}
+
+// Derive the cubie move tables of permutation m from its facelet move table
+void init_cubie_move(int m)
+{
+	// a reference sticker on facelet move_table[m][q] lands on facelet q
+	for (int q = 0; q < NUM_FACELETS; q++)
 	{
-		case GREENCORNERBACKRIGHT:
-			// nothing to do
-			break;
-		case GREENCORNERFRONTRIGHT:
-			abs_rotr(index);
-			abs_rotu(index);
-			abs_rotu(index);
-			abs_rotri(index);
-			abs_rotu(index);
-			break;
-		case BLUECORNERFRONTLEFT:
-			abs_rotu(index);
-			abs_rotu(index);
-			break;
-		case BLUECORNERBACKLEFT:
-			abs_rotu(index);
-			break;
-		case BLUECORNERBACKRIGHT:
-			// nothing to do
-			break;
-		case BLUECORNERFRONTRIGHT:
-			abs_rotui(index);
-			break;
+		int p = move_table[m][q];
+		if (corner_loc_of[p] >= 0)
+			corner_move[m][corner_loc_of[p]] = corner_loc_of[q];
+		if (edge_loc_of[p] >= 0)
+			edge_move[m][edge_loc_of[p]] = edge_loc_of[q];
 	}
-	// rdRD the cube up to 6 times to get the piece in place
-	for (int i = 0; i < 6; i++)
+}
+
+// Derive the cubie tables from the facelet definitions above and the facelet move tables
+void init_cubie_tables(void)
+{
+	memset(corner_by_colors, -1, sizeof(corner_by_colors));
+	memset(edge_by_colors, -1, sizeof(edge_by_colors));
+	
+	solved_cubie.corners = 0;
+	solved_cubie.edges = 0;
+	for (int p = URF; p <= DRB; p++)
 	{
-		// check to see if we got it
-		if ((cube[index].face[BACK].tile[2][0] == YEL) &&
-			(cube[index].face[RIGHT].tile[2][2] == RED) &&
-			(cube[index].face[DOWN].tile[2][2] == GRN))
-			break;
-		if (LOGGING)
-			printf("solve_green_corners: solve GRN/YEL/RED: rdRD\n");
-		// rdRD the cube
-		abs_rotri(index);
-		abs_rotui(index);
-		abs_rotr(index);
-		abs_rotu(index);
+		int mask = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			corner_color[p][k] = corner_facelet[p][k] / 9;
+			mask |= 1 << corner_color[p][k];
+		}
+		corner_by_colors[mask] = p;
+		cubie_set_corner(&solved_cubie, p, p * 3);
 	}
-
-	// find the green/white/red block
-	int gwr3blockloc = locate_3block(index, GRN, WHT, RED);
-	if (LOGGING)
-		printf("solve_green_corners: solve GRN/WHT/RED: 3-block found at block3triplet #%d.\n", gwr3blockloc);
-	// swing it around to either positions 3 or 7 (GREENCORNERFRONTRIGHT or BLUECORNERFRONTRIGHT)
-	switch (gwr3blockloc)
+	for (int p = UR; p <= BR; p++)
 	{
-		case GREENCORNERFRONTRIGHT:
-			// nothing to do
-			break;
-		case BLUECORNERFRONTLEFT:
-			abs_rotui(index);
-			break;
-		case BLUECORNERBACKLEFT:
-			abs_rotu(index);
-			abs_rotu(index);
-			break;
-		case BLUECORNERBACKRIGHT:
-			abs_rotu(index);
-			break;
-		case BLUECORNERFRONTRIGHT:
-			// nothing to do
-			break;
+		int mask = 0;
+		for (int k = 0; k < 2; k++)
+		{
+			edge_color[p][k] = edge_facelet[p][k] / 9;
+			mask |= 1 << edge_color[p][k];
+		}
+		edge_by_colors[mask] = p;
+		cubie_set_edge(&solved_cubie, p, p * 2);
 	}
-	// rdRD the cube up to 6 times to get the piece in place
-	for (int i = 0; i < 6; i++)
+	
+	memset(corner_loc_of, -1, sizeof(corner_loc_of));
+	memset(edge_loc_of, -1, sizeof(edge_loc_of));
+	for (int s = URF; s <= DRB; s++)
+		for (int t = 0; t < 3; t++)
+			corner_loc_of[corner_facelet[s][t]] = s * 3 + t;
+	for (int s = UR; s <= BR; s++)
+		for (int f = 0; f < 2; f++)
+			edge_loc_of[edge_facelet[s][f]] = s * 2 + f;
+	
+	for (int m = ROTU; m < MACRO_BASE + num_sequences; m++)
+		init_cubie_move(m);
+	
+	for (int i = 0; i < 8; i++)
 	{
-		// check to see if we got it
-		if ((cube[index].face[FRONT].tile[2][2] == WHT) &&
-			(cube[index].face[RIGHT].tile[2][0] == RED) &&
-			(cube[index].face[DOWN].tile[0][2] == GRN))
-			break;
-		if (LOGGING)
-			printf("solve_green_corners: solve GRN/WHT/RED: rdRD\n");
-		// rdRD the cube
-		abs_rotfi(index);
-		abs_rotui(index);
-		abs_rotf(index);
-		abs_rotu(index);
+		int mask = (1 << block3triplets[i].faceid1) | (1 << block3triplets[i].faceid2) | (1 << block3triplets[i].faceid3);
+		block3_of_slot[corner_by_colors[mask]] = i;
+	}
+	for (int i = 0; i < 12; i++)
+	{
+		int mask = (1 << block2pairs[i].faceid1) | (1 << block2pairs[i].faceid2);
+		block2_of_slot[edge_by_colors[mask]] = i;
 	}
+}
+
+// Apply a move to a cubie cube
+void cubie_move(cubie_t *c, int rottype)
+{
+	uint64_t corners = 0;
+	uint64_t edges = 0;
 	
-	cube[index].solveGreenCornersMoves = cube[index].totalMoves - cube[index].solveGreenCrossMoves;
+	for (int p = URF; p <= DRB; p++)
+		corners |= (uint64_t)corner_move[rottype][cubie_corner(c, p)] << (p * CUBIE_BITS);
+	for (int p = UR; p <= BR; p++)
+		edges |= (uint64_t)edge_move[rottype][cubie_edge(c, p)] << (p * CUBIE_BITS);
 	
-	if (LOGGING)
-		printf("solve_green_corners: solved green corners and bottom stack of cube.\n");
+	c->corners = corners;
+	c->edges = edges;
 }
 
-void solve_middle_edges(int index)
+// parity of a permutation given as an array
+static int permutation_parity(const int *perm, int n)
 {
-	if (LOGGING)
-		printf("solve_middle_edges: solving middle edges:\n");
+	int parity = 0;
 	
-	// locate WHT/ORG piece
-	int wo2blockloc = locate_2block(index, WHT, ORG);
-	if (LOGGING)
-		printf("solve_middle_edges: solve WHT/ORG: 2-block found at block2pair #%d.\n", wo2blockloc);
-	// if it's not magically in place, then we need to process it
-	if (!((cube[index].face[FRONT].tile[1][0] == WHT) && (cube[index].face[LEFT].tile[1][2] == ORG)))
+	for (int i = 0; i < n; i++)
+		for (int j = i + 1; j < n; j++)
+			if (perm[i] > perm[j])
+				parity ^= 1;
+	return parity;
+}
+
+// Convert facelets to cubies. Returns false if the facelets don't describe a reachable cube.
+bool facelets_to_cubie(const unsigned char *facelet, cubie_t *c)
+{
+	int corner_slot[8];
+	int edge_slot[12];
+	int twist = 0;
+	int flip = 0;
+	uint64_t seen = 0;
+	
+	// every tile must be a color, and the solver assumes the centers never move
+	for (int i = 0; i < NUM_FACELETS; i++)
+		if (facelet[i] >= 6)
+			return false;
+	for (int f = 0; f < 6; f++)
+		if (facelet[FACELET(f, 1, 1)] != f)
+			return false;
+	
+	c->corners = 0;
+	c->edges = 0;
+	for (int s = URF; s <= DRB; s++)
 	{
-		// if the desired block is in the middle stack, we need to get it up top.
-		if ((wo2blockloc >= MIDDLEFRONTLEFT) && (wo2blockloc <= MIDDLEFRONTRIGHT))
-		{
+		int t;
+		for (t = 0; t < 3; t++)
+			if ((facelet[corner_facelet[s][t]] == BLU) || (facelet[corner_facelet[s][t]] == GRN))
+				break;
+		if (t == 3)
+			return false;
+		int mask = 0;
+		for (int k = 0; k < 3; k++)
+			mask |= 1 << facelet[corner_facelet[s][k]];
+		int p = corner_by_colors[mask];
+		// the colors must also run clockwise in the piece's order, or the sticker is on backwards
+		if ((p < 0) || (facelet[corner_facelet[s][(t + 1) % 3]] != corner_color[p][1]) || (seen & (1ULL << p)))
+			return false;
+		seen |= 1ULL << p;
+		cubie_set_corner(c, p, s * 3 + t);
+		corner_slot[p] = s;
+		twist += t;
+	}
+	
+	seen = 0;
+	for (int s = UR; s <= BR; s++)
+	{
+		int mask = (1 << facelet[edge_facelet[s][0]]) | (1 << facelet[edge_facelet[s][1]]);
+		int p = edge_by_colors[mask];
+		if ((p < 0) || (seen & (1ULL << p)))
+			return false;
+		seen |= 1ULL << p;
+		int f = (facelet[edge_facelet[s][0]] == edge_color[p][0]) ? 0 : 1;
+		cubie_set_edge(c, p, s * 2 + f);
+		edge_slot[p] = s;
+		flip += f;
+	}
+	
+	// twists and flips must cancel out, and corners and edges must be permuted with the same parity
+	if ((twist % 3 != 0) || (flip % 2 != 0) || (permutation_parity(corner_slot, 8) != permutation_parity(edge_slot, 12)))
+		return false;
+	
+	return true;
+}
+
+// Convert cubies to facelets
+void cubie_to_facelets(const cubie_t *c, unsigned char *facelet)
+{
+	for (int f = 0; f < 6; f++)
+		facelet[FACELET(f, 1, 1)] = f;
+	
+	for (int p = URF; p <= DRB; p++)
+	{
+		int loc = cubie_corner(c, p);
+		for (int k = 0; k < 3; k++)
+			facelet[corner_facelet[loc / 3][(loc % 3 + k) % 3]] = corner_color[p][k];
+	}
+	for (int p = UR; p <= BR; p++)
+	{
+		int loc = cubie_edge(c, p);
+		for (int k = 0; k < 2; k++)
+			facelet[edge_facelet[loc / 2][(loc % 2 + k) % 2]] = edge_color[p][k];
+	}
+}
+
+// Cubie equivalents of locate_2block/locate_3block: one table read instead of a scan
+int cubie_locate_2block(const cubie_t *c, int color1, int color2)
+{
+	return block2_of_slot[cubie_edge(c, edge_by_colors[(1 << color1) | (1 << color2)]) / 2];
+}
+
+int cubie_locate_3block(const cubie_t *c, int color1, int color2, int color3)
+{
+	return block3_of_slot[cubie_corner(c, corner_by_colors[(1 << color1) | (1 << color2) | (1 << color3)]) / 3];
+}
+
+// Stage predicates
+static inline bool cubie_corner_home(const cubie_t *c, int piece)
+{
+	return cubie_corner(c, piece) == piece * 3;
+}
+
+static inline bool cubie_edge_home(const cubie_t *c, int piece)
+{
+	return cubie_edge(c, piece) == piece * 2;
+}
+
+bool cubie_green_cross_solved(const cubie_t *c)
+{
+	return cubie_edge_home(c, DR) && cubie_edge_home(c, DF) && cubie_edge_home(c, DL) && cubie_edge_home(c, DB);
+}
+
+bool cubie_green_corners_solved(const cubie_t *c)
+{
+	return cubie_corner_home(c, DFR) && cubie_corner_home(c, DLF) && cubie_corner_home(c, DBL) && cubie_corner_home(c, DRB);
+}
+
+bool cubie_middle_edges_solved(const cubie_t *c)
+{
+	return cubie_edge_home(c, FR) && cubie_edge_home(c, FL) && cubie_edge_home(c, BL) && cubie_edge_home(c, BR);
+}
+
+// same answer as identify_blue_cross_state
+int cubie_blue_cross_state(const cubie_t *c)
+{
+	// a blue tile shows on top of an up edge slot when an up edge sits there unflipped
+	bool up[12] = { false };
+	for (int p = UR; p <= UB; p++)
+	{
+		int loc = cubie_edge(c, p);
+		if ((loc % 2 == 0) && (loc / 2 <= UB))
+			up[loc / 2] = true;
+	}
+	
+	if (up[UB] && up[UL] && up[UR] && up[UF])
+		return BLUECROSSSTATECROSS;
+	if (up[UL] && up[UR])
+		return BLUECROSSSTATELINEH;
+	if (up[UB] && up[UF])
+		return BLUECROSSSTATELINEV;
+	if (up[UL] && up[UF])
+		return BLUECROSSSTATELFRONTLEFT;
+	if (up[UL] && up[UB])
+		return BLUECROSSSTATELBACKLEFT;
+	if (up[UB] && up[UR])
+		return BLUECROSSSTATELBACKRIGHT;
+	if (up[UR] && up[UF])
+		return BLUECROSSSTATELFRONTRIGHT;
+	return BLUECROSSSTATENONE;
+}
+
+// same answer as check_blue_corner_alignment, for a block3triplets corner tag
+bool cubie_blue_corner_aligned(const cubie_t *c, int corner)
+{
+	int slot = corner_by_colors[(1 << block3triplets[corner].faceid1) | (1 << block3triplets[corner].faceid2) | (1 << block3triplets[corner].faceid3)];
+	return cubie_corner_home(c, slot);
+}
+
+bool cubie_solved(const cubie_t *c)
+{
+	return (c->corners == solved_cubie.corners) && (c->edges == solved_cubie.edges);
+}
+
+// Table Files
+// Tables that take a while to build (the sliding window's short sequence table, the last layer table, the
+// two-phase and optimal tables) can be kept under --tables DIR, one file per table set. The first run builds a
+// set and saves it; later runs map the file read only instead of building it again, so every process on the
+// machine shares one copy in the page cache and starts in milliseconds. A file is a 64 byte header naming its
+// table set, the layout version and a checksum, then the size of each part, then the parts themselves, each on
+// its own page. A file that doesn't match in every respect is rebuilt and replaced; a new file is written
+// under a temporary name and renamed into place, so other processes only ever see a whole one.
+#define TABLES_MAGIC "RBXTABLE"
+#define TABLES_VERSION 1 // bump when the contents or layout of any table set change
+#define TABLE_ALIGN 4096
+
+typedef struct {
+	char magic[8];
+	char name[24]; // the table set
+	uint32_t version;
+	uint32_t parts;
+	uint64_t checksum; // of the part sizes and the parts
+	unsigned char reserved[16];
+} table_header_t;
+
+_Static_assert(sizeof(table_header_t) == 64, "table file headers are 64 bytes");
+
+// a part of a table set: the pointer to aim at it, and its size in bytes
+typedef struct {
+	void **table;
+	size_t size;
+} table_part_t;
+
+const char *table_dir = NULL; // --tables, or NULL to build every table at startup
+
+void use_table_dir(const char *dir)
+{
+	table_dir = dir;
+}
+
+static uint64_t table_checksum(uint64_t h, const unsigned char *bytes, size_t size)
+{
+	size_t i;
+	for (i = 0; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		h = (h ^ word) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	for (; i < size; i++)
+		h = (h ^ bytes[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+static size_t table_align(size_t offset)
+{
+	return (offset + TABLE_ALIGN - 1) & ~(size_t)(TABLE_ALIGN - 1);
+}
+
+static void table_path(char *path, size_t size, const char *name)
+{
+	if ((size_t)snprintf(path, size, "%s/%s.tbl", table_dir, name) >= size)
+	{
+		printf("Table directory path is too long!\n");
+		exit(-1);
+	}
+}
+
+// Point the parts at the mapped table file of set name, if there's a good one; returns false if it has to be
+// built
+bool map_tables(const char *name, const table_part_t *parts, int num_parts)
+{
+	if (table_dir == NULL)
+		return false;
+	
+	char path[4096];
+	table_path(path, sizeof(path), name);
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(table_header_t) + num_parts * sizeof(uint64_t)))
+	{
+		close(fd);
+		return false;
+	}
+	unsigned char *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+	
+	const table_header_t *header = (const table_header_t *)map;
+	const uint64_t *sizes = (const uint64_t *)(header + 1);
+	bool good = (memcmp(header->magic, TABLES_MAGIC, 8) == 0) && (strncmp(header->name, name, sizeof(header->name)) == 0) &&
+		(header->version == TABLES_VERSION) && (header->parts == (uint32_t)num_parts);
+	size_t offset = table_align(sizeof(table_header_t) + num_parts * sizeof(uint64_t));
+	for (int p = 0; good && (p < num_parts); p++)
+	{
+		good = (sizes[p] == parts[p].size) && (offset + parts[p].size <= (size_t)st.st_size);
+		offset = table_align(offset + parts[p].size);
+	}
+	if (good)
+	{
+		uint64_t h = table_checksum(0, (const unsigned char *)sizes, num_parts * sizeof(uint64_t));
+		offset = table_align(sizeof(table_header_t) + num_parts * sizeof(uint64_t));
+		for (int p = 0; p < num_parts; p++)
+		{
+			h = table_checksum(h, map + offset, parts[p].size);
+			offset = table_align(offset + parts[p].size);
+		}
+		good = (h == header->checksum);
+	}
+	if (!good)
+	{
+		munmap(map, st.st_size);
+		return false;
+	}
+	
+#ifdef MADV_HUGEPAGE
+	// big tables are read at random; huge pages, where the kernel backs file mappings with them, save TLB misses
+	madvise(map, st.st_size, MADV_HUGEPAGE);
+#endif
+	offset = table_align(sizeof(table_header_t) + num_parts * sizeof(uint64_t));
+	for (int p = 0; p < num_parts; p++)
+	{
+		*parts[p].table = map + offset;
+		offset = table_align(offset + parts[p].size);
+	}
+	return true;
+}
+
+// Save freshly built tables as the table file of set name, if there's a table directory
+void save_tables(const char *name, const table_part_t *parts, int num_parts)
+{
+	if (table_dir == NULL)
+		return;
+	
+	char path[4096], temp[4200];
+	table_path(path, sizeof(path), name);
+	snprintf(temp, sizeof(temp), "%s.%d", path, (int)getpid());
+	FILE *out = fopen(temp, "wb");
+	if (out == NULL)
+	{
+		printf("Unable to open %s for writing!\n", temp);
+		exit(-1);
+	}
+	
+	table_header_t header;
+	uint64_t sizes[num_parts];
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TABLES_MAGIC, 8);
+	strncpy(header.name, name, sizeof(header.name) - 1);
+	header.version = TABLES_VERSION;
+	header.parts = num_parts;
+	for (int p = 0; p < num_parts; p++)
+		sizes[p] = parts[p].size;
+	header.checksum = table_checksum(0, (const unsigned char *)sizes, sizeof(sizes));
+	for (int p = 0; p < num_parts; p++)
+		header.checksum = table_checksum(header.checksum, *parts[p].table, parts[p].size);
+	
+	static const unsigned char padding[TABLE_ALIGN];
+	bool ok = (fwrite(&header, sizeof(header), 1, out) == 1) && (fwrite(sizes, sizeof(sizes), 1, out) == 1);
+	size_t offset = sizeof(header) + sizeof(sizes);
+	for (int p = 0; ok && (p < num_parts); p++)
+	{
+		size_t pad = table_align(offset) - offset;
+		ok = (fwrite(padding, 1, pad, out) == pad) && (fwrite(*parts[p].table, 1, parts[p].size, out) == parts[p].size);
+		offset += pad + parts[p].size;
+	}
+	if ((fclose(out) != 0) || !ok || (rename(temp, path) != 0))
+	{
+		printf("Unable to write %s!\n", path);
+		exit(-1);
+	}
+}
+
+// Short Sequence Table
+// For the sliding window optimizer and the fast path, a breadth first search from the solved cube finds every
+// position within short_table_depth quarter turns and stores its distance in an open addressing hash table
+// keyed on the cubie state. A stretch of a solution whose net effect is in the table at a shorter distance
+// can be swapped for a shortest sequence, which is recovered by stepping back down the distances. The table
+// is read only once built, so workers share it.
+#define MAX_WINDOW_DEPTH 7
+#define WINDOW_SLACK 3 // stretches up to window_depth + WINDOW_SLACK moves long are looked up
+#define WINDOW_LENGTH (MAX_WINDOW_DEPTH + WINDOW_SLACK)
+
+int window_depth = 0; // zero if the window optimizer is off
+int short_table_depth = 0; // zero if there's no table
+
+// edges in the low 60 bits and the distance above them; corners is never 0 for a real cube, so it marks an
+// empty slot
+typedef struct {
+	uint64_t edges_distance;
+	uint64_t corners;
+} short_entry_t;
+
+short_entry_t *short_table = NULL;
+uint64_t short_table_mask;
+unsigned long short_table_entries = 0;
+
+static inline uint64_t cubie_hash(const cubie_t *c)
+{
+	uint64_t h = (c->corners * 0x9e3779b97f4a7c15ULL) ^ c->edges;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	return h ^ (h >> 32);
+}
+
+// Distance of position c from solved, or -1 if it's further than short_table_depth
+static inline int short_table_lookup(const cubie_t *c, uint64_t hash)
+{
+	for (uint64_t slot = hash & short_table_mask; ; slot = (slot + 1) & short_table_mask)
+	{
+		const short_entry_t *e = &short_table[slot];
+		if (e->corners == 0)
+			return -1;
+		if ((e->corners == c->corners) && ((e->edges_distance & ((1ULL << 60) - 1)) == c->edges))
+			return (int)(e->edges_distance >> 60);
+	}
+}
+
+// Add c at distance; returns false if it was already there
+bool short_table_insert(const cubie_t *c, int distance)
+{
+	for (uint64_t slot = cubie_hash(c) & short_table_mask; ; slot = (slot + 1) & short_table_mask)
+	{
+		short_entry_t *e = &short_table[slot];
+		if (e->corners == 0)
+		{
+			e->corners = c->corners;
+			e->edges_distance = c->edges | ((uint64_t)distance << 60);
+			short_table_entries++;
+			return true;
+		}
+		if ((e->corners == c->corners) && ((e->edges_distance & ((1ULL << 60) - 1)) == c->edges))
+			return false;
+	}
+}
+
+void init_short_table(int depth)
+{
+	// positions within 0..7 quarter turns: 1, 13, 127, 1195, 11206, 105046, 983926, 9205558
+	static const unsigned long reachable[MAX_WINDOW_DEPTH + 1] = { 1, 13, 127, 1195, 11206, 105046, 983926, 9205558 };
+	uint64_t slots = 1;
+	while (slots < reachable[depth] * 2)
+		slots <<= 1;
+	short_table_mask = slots - 1;
+	short_table_depth = depth;
+	
+	char name[16];
+	snprintf(name, sizeof(name), "window-%d", depth);
+	table_part_t parts[1] = { { (void **)&short_table, slots * sizeof(short_entry_t) } };
+	if (map_tables(name, parts, 1))
+	{
+		short_table_entries = reachable[depth];
+		return;
+	}
+	
+	short_table = calloc(slots, sizeof(short_entry_t));
+	cubie_t *frontier = malloc(reachable[depth] * sizeof(cubie_t));
+	if ((short_table == NULL) || (frontier == NULL))
+	{
+		printf("Unable to allocate the short sequence table!\n");
+		exit(-1);
+	}
+	
+	// frontier[begin..end) holds the positions at distance d; their children at d + 1 are appended after them
+	short_table_insert(&solved_cubie, 0);
+	frontier[0] = solved_cubie;
+	unsigned long begin = 0, end = 1;
+	for (int d = 0; d < depth; d++)
+	{
+		unsigned long next = end;
+		for (unsigned long i = begin; i < end; i++)
+		{
+			for (int m = ROTU; m <= ROTDI; m++)
+			{
+				cubie_t c = frontier[i];
+				cubie_move(&c, m);
+				if (short_table_insert(&c, d + 1))
+				{
+					if (next == reachable[depth])
+					{
+						printf("Short sequence table search found too many positions!\n");
+						exit(-1);
+					}
+					frontier[next++] = c;
+				}
+			}
+		}
+		begin = end;
+		end = next;
+	}
+	free(frontier);
+	save_tables(name, parts, 1);
+}
+
+// the move that undoes each move
+static inline int inverse_move(int move)
+{
+	return move ^ 1;
+}
+
+// Write a shortest sequence reaching c (at distance) into moves, last move first found
+void short_table_sequence(cubie_t c, int distance, unsigned char *moves)
+{
+	while (distance > 0)
+	{
+		// some move steps back to distance - 1; that move is the last one of the sequence
+		int m;
+		for (m = ROTU; m <= ROTDI; m++)
+		{
+			cubie_t back = c;
+			cubie_move(&back, inverse_move(m));
+			if (short_table_lookup(&back, cubie_hash(&back)) == distance - 1)
+			{
+				c = back;
+				break;
+			}
+		}
+		moves[--distance] = m;
+	}
+}
+
+// Slide a window over n moves, replacing each stretch that has a shorter equivalent by a shortest one (taking
+// the biggest saving at each starting point). Returns how many moves are left.
+int window_pass(staged_move_t *moves, int n)
+{
+	int out = 0;
+	int i = 0;
+	
+	while (i < n)
+	{
+		// the net effect of moves[i..j] for each window length, hashed and prefetched up front
+		cubie_t effect[WINDOW_LENGTH];
+		uint64_t hash[WINDOW_LENGTH];
+		int lengths = (n - i < window_depth + WINDOW_SLACK) ? n - i : window_depth + WINDOW_SLACK;
+		cubie_t c = solved_cubie;
+		for (int l = 0; l < lengths; l++)
+		{
+			cubie_move(&c, moves[i + l].move);
+			effect[l] = c;
+			hash[l] = cubie_hash(&c);
+			__builtin_prefetch(&short_table[hash[l] & short_table_mask]);
+		}
+		
+		int best_length = 0, best_distance = 0;
+		for (int l = 1; l < lengths; l++)
+		{
+			int distance = short_table_lookup(&effect[l], hash[l]);
+			if ((distance >= 0) && (l + 1 - distance > best_length - best_distance))
+			{
+				best_length = l + 1;
+				best_distance = distance;
+			}
+		}
+		
+		if (best_length == 0)
+		{
+			moves[out++] = moves[i++];
+			continue;
+		}
+		
+		// out <= i and the replacement is shorter, so this never overwrites moves not yet read
+		unsigned char replacement[MAX_WINDOW_DEPTH];
+		int stage = moves[i].stage;
+		short_table_sequence(effect[best_length - 1], best_distance, replacement);
+		for (int k = 0; k < best_distance; k++)
+		{
+			moves[out].move = replacement[k];
+			moves[out].stage = stage;
+			out++;
+		}
+		i += best_length;
+	}
+	return out;
+}
+
+// Optimize a recorded solution: peephole, then the window optimizer if it's on and a final peephole for what
+// the replacements line up. The result is written as new spans of arena and replaces the solution's.
+void optimize_solution(solution_t *solution, move_arena_t *arena)
+{
+	staged_move_t moves[MAX_SOLUTION_MOVES];
+	int n = 0;
+	
+	for (int s = 0; s < 5; s++)
+	{
+		const move_span_t *span = &solution->stage[s];
+		if (n + span->length > MAX_SOLUTION_MOVES)
+		{
+			printf("Solution too long to optimize!\n");
+			exit(-1);
+		}
+		for (unsigned int i = 0; i < span->length; i++)
+		{
+			moves[n].move = move_span_get(span, i);
+			moves[n].stage = s;
+			n++;
+		}
+	}
+	
+	n = peephole_pass(moves, n);
+	if (window_depth > 0)
+	{
+		n = window_pass(moves, n);
+		n = peephole_pass(moves, n);
+	}
+	
+	// the moves are still in stage order
+	int i = 0;
+	for (int s = 0; s < 5; s++)
+	{
+		move_arena_begin_span(arena);
+		for (; (i < n) && (moves[i].stage == s); i++)
+			move_arena_put(arena, moves[i].move);
+		move_arena_end_span(arena, &solution->stage[s]);
+	}
+}
+
+// Absolute Indexed Rotate
+void abs_rot_indrot(cube_t *c, int rottype)
+{
+	if ((rottype < ROTU) || (rottype > ROTDI))
+	{
+		printf("Unknown rotation type!\n");
+		exit(-1);
+	}
+	
+	if (LOGGING)
+		printf("rotate: %s\n", rotnames[rottype]);
+	
+	move_kernel(c->facelet, rottype);
+	if (c->indexed)
+		cubie_move(&c->pieces, rottype);
+	if (c->recording != NULL)
+		move_arena_put(c->recording, rottype);
+	
+	// bump move pointer
+	c->totalMoves++;
+}
+
+// Absolute Rotate functions
+void abs_rotu(cube_t *c)	{ abs_rot_indrot(c, ROTU); }
+void abs_rotui(cube_t *c)	{ abs_rot_indrot(c, ROTUI); }
+void abs_rotb(cube_t *c)	{ abs_rot_indrot(c, ROTB); }
+void abs_rotbi(cube_t *c)	{ abs_rot_indrot(c, ROTBI); }
+void abs_rotl(cube_t *c)	{ abs_rot_indrot(c, ROTL); }
+void abs_rotli(cube_t *c)	{ abs_rot_indrot(c, ROTLI); }
+void abs_rotf(cube_t *c)	{ abs_rot_indrot(c, ROTF); }
+void abs_rotfi(cube_t *c)	{ abs_rot_indrot(c, ROTFI); }
+void abs_rotr(cube_t *c)	{ abs_rot_indrot(c, ROTR); }
+void abs_rotri(cube_t *c)	{ abs_rot_indrot(c, ROTRI); }
+void abs_rotd(cube_t *c)	{ abs_rot_indrot(c, ROTD); }
+void abs_rotdi(cube_t *c)	{ abs_rot_indrot(c, ROTDI); }
+
+// Apply a whole catalog sequence in one pass, crediting each of its moves
+void abs_rot_sequence(cube_t *c, int seq)
+{
+	if ((seq < 0) || (seq >= num_sequences))
+	{
+		printf("Unknown move sequence!\n");
+		exit(-1);
+	}
+	
+	if (LOGGING)
+		for (int i = 0; i < sequences[seq].length; i++)
+			printf("rotate: %s\n", rotnames[sequences[seq].moves[i]]);
+	
+	move_kernel(c->facelet, MACRO_BASE + seq);
+	if (c->indexed)
+		cubie_move(&c->pieces, MACRO_BASE + seq);
+	if (c->recording != NULL)
+		for (int i = 0; i < sequences[seq].length; i++)
+			move_arena_put(c->recording, sequences[seq].moves[i]);
+	
+	c->totalMoves += sequences[seq].length;
+}
+
+void abs_macro(cube_t *c, int macro)	{ abs_rot_sequence(c, macro_seq[macro]); }
+
+// Piece Index
+// With --index, a cube carries its cubie state along with its facelets, and every move steps it through
+// corner_move/edge_move as well, one table read per piece. locate_2block and locate_3block are then a table
+// read instead of a scan of all 12 edges or 8 corners.
+bool piece_index = false;
+
+void index_pieces(cube_t *c)
+{
+	c->indexed = facelets_to_cubie(c->facelet, &c->pieces);
+}
+
+// Flattened Locate
+// block2pairs and block3triplets are flattened at startup into the facelet numbers of each piece's tiles.
+// A piece is then matched by its set of colors, one bit per color, rather than tile by tile: the 2-block
+// or 3-block is the one whose tiles' bits OR together to the bits of the colors asked for. With a vector
+// move kernel in use, all 12 edges (or 8 corners) are gathered with pshufb and compared in one go, and the
+// first match comes from the compare mask's lowest set bit.
+unsigned char block2_facelet[12][2];
+unsigned char block3_facelet[8][3];
+
+#if HAVE_X86_KERNELS
+// locate2_mask[t][k] gathers tile t of every edge from 16 byte chunk k of the facelets, like ssse3_mask;
+// lanes 12-15 (and 8-15 of locate3_mask) are unused
+_Alignas(16) unsigned char locate2_mask[2][4][16];
+_Alignas(16) unsigned char locate3_mask[3][4][16];
+#endif
+
+void init_locate_tables(void)
+{
+	for (int i = 0; i < 12; i++)
+	{
+		block2_facelet[i][0] = FACELET(block2pairs[i].faceid1, block2pairs[i].tilex1, block2pairs[i].tiley1);
+		block2_facelet[i][1] = FACELET(block2pairs[i].faceid2, block2pairs[i].tilex2, block2pairs[i].tiley2);
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		block3_facelet[i][0] = FACELET(block3triplets[i].faceid1, block3triplets[i].tilex1, block3triplets[i].tiley1);
+		block3_facelet[i][1] = FACELET(block3triplets[i].faceid2, block3triplets[i].tilex2, block3triplets[i].tiley2);
+		block3_facelet[i][2] = FACELET(block3triplets[i].faceid3, block3triplets[i].tilex3, block3triplets[i].tiley3);
+	}
+	
+#if HAVE_X86_KERNELS
+	memset(locate2_mask, 0x80, sizeof(locate2_mask));
+	memset(locate3_mask, 0x80, sizeof(locate3_mask));
+	for (int k = 0; k < 4; k++)
+	{
+		for (int i = 0; i < 12; i++)
+			for (int t = 0; t < 2; t++)
+				if (block2_facelet[i][t] / 16 == k)
+					locate2_mask[t][k][i] = block2_facelet[i][t] % 16;
+		for (int i = 0; i < 8; i++)
+			for (int t = 0; t < 3; t++)
+				if (block3_facelet[i][t] / 16 == k)
+					locate3_mask[t][k][i] = block3_facelet[i][t] % 16;
+	}
+#endif
+}
+
+#if HAVE_X86_KERNELS
+// Gather the colors of one tile of every piece into the lanes of a vector, as color bits
+__attribute__((target("ssse3")))
+static inline __m128i gather_color_bits(const __m128i src[4], const unsigned char mask[4][16])
+{
+	const __m128i color_bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	__m128i tiles = _mm_shuffle_epi8(src[0], _mm_load_si128((const __m128i *)mask[0]));
+	for (int k = 1; k < 4; k++)
+		tiles = _mm_or_si128(tiles, _mm_shuffle_epi8(src[k], _mm_load_si128((const __m128i *)mask[k])));
+	return _mm_shuffle_epi8(color_bit, tiles);
+}
+
+__attribute__((target("ssse3")))
+static inline void load_facelet_chunks(const unsigned char *facelet, __m128i src[4])
+{
+	src[0] = _mm_loadu_si128((const __m128i *)facelet);
+	src[1] = _mm_loadu_si128((const __m128i *)(facelet + 16));
+	src[2] = _mm_loadu_si128((const __m128i *)(facelet + 32));
+	src[3] = _mm_loadl_epi64((const __m128i *)(facelet + 48));
+}
+
+__attribute__((target("ssse3")))
+int locate_2block_ssse3(const unsigned char *facelet, int key)
+{
+	__m128i src[4];
+	load_facelet_chunks(facelet, src);
+	__m128i keys = _mm_or_si128(gather_color_bits(src, locate2_mask[0]), gather_color_bits(src, locate2_mask[1]));
+	int found = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8(key))) & 0x0fff;
+	return (found != 0) ? __builtin_ctz(found) : 12;
+}
+
+__attribute__((target("ssse3")))
+int locate_3block_ssse3(const unsigned char *facelet, int key)
+{
+	__m128i src[4];
+	load_facelet_chunks(facelet, src);
+	__m128i keys = _mm_or_si128(gather_color_bits(src, locate3_mask[0]), gather_color_bits(src, locate3_mask[1]));
+	keys = _mm_or_si128(keys, gather_color_bits(src, locate3_mask[2]));
+	int found = _mm_movemask_epi8(_mm_cmpeq_epi8(keys, _mm_set1_epi8(key))) & 0x00ff;
+	return (found != 0) ? __builtin_ctz(found) : 8;
+}
+#endif
+
+// Locate a 2-block on the cube; return a block2pair index
+int locate_2block(cube_t *c, int color1, int color2)
+{
+	int i;
+	int key = (1 << color1) | (1 << color2);
+	
+	if (c->indexed)
+		return cubie_locate_2block(&c->pieces, color1, color2);
+#if HAVE_X86_KERNELS
+	// the vector kernels all need at least ssse3
+	if (move_kernel != move_kernel_scalar)
+		return locate_2block_ssse3(c->facelet, key);
+#endif
+	
+	for (i = 0; i < 12; i++)
+	{
+		// okay... block2pairs describes 12 pairs of adjoining tiles that form the 2-edged blocks on the cube.
+		// we're iterating through the list of pairs to see if the tiles are color1 and color2, either way round.
+		if (((1 << c->facelet[block2_facelet[i][0]]) | (1 << c->facelet[block2_facelet[i][1]])) == key)
+			break;
+	}
+	
+	return i;
+}
+
+// find a 3-block on the cube, return a block3triplet index
+int locate_3block(cube_t *c, int color1, int color2, int color3)
+{
+	int i;
+	int key = (1 << color1) | (1 << color2) | (1 << color3);
+	
+	if (c->indexed)
+		return cubie_locate_3block(&c->pieces, color1, color2, color3);
+#if HAVE_X86_KERNELS
+	if (move_kernel != move_kernel_scalar)
+		return locate_3block_ssse3(c->facelet, key);
+#endif
+	
+	for (i = 0; i < 8; i++)
+	{
+		// same deal as above except we are matching 3 colors.
+		if (((1 << c->facelet[block3_facelet[i][0]]) | (1 << c->facelet[block3_facelet[i][1]]) |
+			(1 << c->facelet[block3_facelet[i][2]])) == key)
+			break;
+	}
+	
+	return i;
+}
+
+// Green Cross Table
+// With --green-cross, the green cross stage doesn't bring its four edges in one at a time. The cross is just
+// where the four green edges are and which way up: 12 * 11 * 10 * 9 slot orders times 16 flips, 190080
+// arrangements in all. At startup a breadth first search from the solved cross over the 12 quarter turns finds
+// the fewest moves to solve each one, and the table keeps the turn that starts that solution; the stage looks
+// the cross up and turns as the table says until it's solved, at most 9 quarter turns. The search only steps
+// four edge locations through edge_move, so it takes milliseconds and isn't worth a table file.
+#define CROSS_INDEXES (12 * 11 * 10 * 9 * 16)
+#define CROSS_SOLVED 254
+#define CROSS_NONE 255
+
+bool green_cross_table = false;
+unsigned char *cross_next = NULL; // by cross_index: the turn to make next, or CROSS_SOLVED
+
+// the green edges, in the order the index lists them
+const unsigned char cross_edges[4] = { DF, DL, DR, DB };
+
+// Index of the cross whose green edges are at locations loc
+static inline int cross_index(const unsigned char loc[4])
+{
+	int slots = 0, flips = 0;
+	for (int k = 0; k < 4; k++)
+	{
+		// number each slot among the ones the earlier edges left free
+		int slot = loc[k] / 2;
+		int free_rank = slot;
+		for (int j = 0; j < k; j++)
+			free_rank -= (loc[j] / 2 < slot);
+		slots = slots * (12 - k) + free_rank;
+		flips = flips * 2 + loc[k] % 2;
+	}
+	return slots * 16 + flips;
+}
+
+// The locations of the green edges of the cross with index i
+static void cross_locs(int i, unsigned char loc[4])
+{
+	int flips = i % 16;
+	int slots = i / 16;
+	int free_rank[4];
+	for (int k = 3; k >= 0; k--)
+	{
+		free_rank[k] = slots % (12 - k);
+		slots /= 12 - k;
+	}
+	bool taken[12] = { false };
+	for (int k = 0; k < 4; k++)
+	{
+		int slot = 0;
+		for (int r = free_rank[k]; taken[slot] || (r > 0); slot++)
+			if (!taken[slot])
+				r--;
+		taken[slot] = true;
+		loc[k] = slot * 2 + ((flips >> (3 - k)) & 1);
+	}
+}
+
+static inline void cross_state(const cubie_t *c, unsigned char loc[4])
+{
+	for (int k = 0; k < 4; k++)
+		loc[k] = cubie_edge(c, cross_edges[k]);
+}
+
+void init_green_cross_table(void)
+{
+	unsigned char *distance = malloc(CROSS_INDEXES);
+	cross_next = malloc(CROSS_INDEXES);
+	if ((distance == NULL) || (cross_next == NULL))
+	{
+		printf("Unable to allocate the green cross table!\n");
+		exit(-1);
+	}
+	memset(distance, 0xff, CROSS_INDEXES);
+	memset(cross_next, CROSS_NONE, CROSS_INDEXES);
+	unsigned char loc[4];
+	cross_state(&solved_cubie, loc);
+	int solved = cross_index(loc);
+	distance[solved] = 0;
+	cross_next[solved] = CROSS_SOLVED;
+	
+	// a distance at a time; the way back from a cross reached by a turn starts with the opposite turn
+	int reached = 1;
+	for (int d = 0; reached > 0; d++)
+	{
+		reached = 0;
+		for (int i = 0; i < CROSS_INDEXES; i++)
+		{
+			if (distance[i] != d)
+				continue;
+			cross_locs(i, loc);
+			for (int q = ROTU; q <= ROTDI; q++)
+			{
+				unsigned char next[4];
+				for (int k = 0; k < 4; k++)
+					next[k] = edge_move[q][loc[k]];
+				int j = cross_index(next);
+				if (distance[j] == 0xff)
+				{
+					distance[j] = d + 1;
+					cross_next[j] = inverse_move(q);
+					reached++;
+				}
+			}
+		}
+	}
+	free(distance);
+	
+	for (int i = 0; i < CROSS_INDEXES; i++)
+	{
+		if (cross_next[i] == CROSS_NONE)
+		{
+			printf("Green cross arrangement %d isn't reachable!\n", i);
+			exit(-1);
+		}
+	}
+}
+
+// The turn to make next on a cube whose green edges are at loc, or -1 once the cross is solved
+static inline int cross_step(const unsigned char loc[4])
+{
+	int q = cross_next[cross_index(loc)];
+	return (q == CROSS_SOLVED) ? -1 : q;
+}
+
+// Turn c as the table says until its green cross is solved
+void walk_green_cross(cube_t *c)
+{
+	cubie_t state;
+	if (c->indexed)
+		state = c->pieces;
+	else
+		facelets_to_cubie(c->facelet, &state);
+	unsigned char loc[4];
+	cross_state(&state, loc);
+	
+	for (int q = cross_step(loc); q >= 0; q = cross_step(loc))
+	{
+		abs_rot_indrot(c, q);
+		for (int k = 0; k < 4; k++)
+			loc[k] = edge_move[q][loc[k]];
+	}
+}
+
+void solve_green_cross(cube_t *c)
+{
+	if (LOGGING)
+		printf("solve_green_cross: solving green cross:\n");
+	
+	if (green_cross_table)
+	{
+		walk_green_cross(c);
+		c->solveGreenCrossMoves = c->totalMoves;
+		if (LOGGING)
+			printf("solve_green_cross: solved green cross.\n");
+		return;
+	}
+
+	// find the green/white block
+	int gw2blockloc = locate_2block(c, GRN, WHT);
+	if (LOGGING)
+		printf("solve_green_cross: solve GRN/WHT: 2-block found at block2pair #%d.\n", gw2blockloc);
+	// swing it around to position GREENCROSSFRONT
+	switch (gw2blockloc)
+	{
+		case GREENCROSSFRONT:
+			// in the right spot, no need to do anything
+			break;
+		case GREENCROSSLEFT:
+			abs_rotd(c);
+			break;
+		case GREENCROSSBACK:
+			abs_rotd(c);
+			abs_rotd(c);
+			break;
+		case GREENCROSSRIGHT:
+			abs_rotdi(c);
+			break;
+		case MIDDLEFRONTLEFT:
+			abs_rotfi(c);
+			break;
+		case MIDDLEBACKLEFT:
+			abs_rotli(c);
+			abs_rotd(c);
+			break;
+		case MIDDLEBACKRIGHT:
+			abs_rotr(c);
+			abs_rotdi(c);
+			break;
+		case MIDDLEFRONTRIGHT:
+			abs_rotf(c);
+			break;
+		case BLUECROSSFRONT:
+			abs_rotf(c);
+			abs_rotf(c);
+			break;
+		case BLUECROSSLEFT:
+			abs_rotl(c);
+			abs_rotl(c);
+			abs_rotd(c);
+			break;
+		case BLUECROSSBACK:
+			abs_rotu(c);
+			abs_rotu(c);
+			abs_rotf(c);
+			abs_rotf(c);
+			break;
+		case BLUECROSSRIGHT:
+			abs_rotri(c);
+			abs_rotri(c);
+			abs_rotdi(c);
+	}
+	// check if the GRN/WHT piece is inverted; if it is, fUlu it
+	if (c->face[DOWN].tile[0][1] == WHT)
+	{
+		if (LOGGING)
+			printf("solve_green_cross: solve GRN/WHT: fUlu\n");
+		abs_macro(c, MACRO_FLIP_GRN_WHT);
+	}
+
+	// find the green/orange block
+	int go2blockloc = locate_2block(c, GRN, ORG);
+	if (LOGGING)
+		printf("solve_green_cross: solve GRN/ORG: 2-block found at block2pair #%d.\n", go2blockloc);
+	// swing it around to position GREENCROSSLEFT
+	switch (go2blockloc)
+	{
+		// not going to be at pos 0 since we solved GRN/WHT already
+		case GREENCROSSLEFT:
+			// do nothing, its in the right place
+			break;
+		case GREENCROSSBACK:
+			abs_rotbi(c);
+			abs_rotli(c);
+			break;
+		case GREENCROSSRIGHT:
+			abs_rotri(c);
+			abs_rotb(c);
+			abs_rotb(c);
+			abs_rotli(c);
+			break;
+		case MIDDLEFRONTLEFT:
+			abs_rotl(c);
+			break;
+		case MIDDLEBACKLEFT:
+			abs_rotli(c);
+			break;
+		case MIDDLEBACKRIGHT:
+			abs_rotb(c);
+			abs_rotui(c);
+			abs_rotl(c);
+			abs_rotl(c);
+			break;
+		case MIDDLEFRONTRIGHT:
+			abs_rotr(c);
+			abs_rotu(c);
+			abs_rotu(c);
+			abs_rotl(c);
+			abs_rotl(c);
+			break;
+		case BLUECROSSFRONT:
+			abs_rotu(c);
+			abs_rotl(c);
+			abs_rotl(c);
+			break;
+		case BLUECROSSLEFT:
+			abs_rotl(c);
+			abs_rotl(c);
+			break;
+		case BLUECROSSBACK:
+			abs_rotui(c);
+			abs_rotl(c);
+			abs_rotl(c);
+			break;
+		case BLUECROSSRIGHT:
+			abs_rotu(c);
+			abs_rotu(c);
+			abs_rotl(c);
+			abs_rotl(c);
+			break;			
+	}
+	// check if the GRN/ORG piece is inverted; if it is, fUlu it
+	if (c->face[DOWN].tile[1][0] == ORG)
+	{
+		if (LOGGING)
+			printf("solve_green_cross: solve GRN/ORG: fUlu\n");
+		abs_macro(c, MACRO_FLIP_GRN_ORG);
+	}
+
+	// find the green/red block
+	int gr2blockloc = locate_2block(c, GRN, RED);
+	if (LOGGING)
+		printf("solve_green_cross: solve GRN/RED: 2-block found at block2pair #%d.\n", gr2blockloc);
+	// swing it around to position 3
+	switch (gr2blockloc)
+	{
+		// not going to be at pos 0 or 1 since we solved GRN/WHT and GRN/ORG already
+		case GREENCROSSBACK:
+			abs_rotb(c);
+			abs_rotr(c);
+			break;
+		case GREENCROSSRIGHT:
+			// nothing to do
+			break;
+		case MIDDLEFRONTLEFT:
+			abs_rotli(c);
+			abs_rotui(c);
+			abs_rotl(c);
+			abs_rotui(c);
+			abs_rotri(c);
+			abs_rotri(c);
+			break;
+		case MIDDLEBACKLEFT:
+			abs_rotbi(c);
+			abs_rotu(c);
+			abs_rotri(c);
+			abs_rotri(c);
+			break;
+		case MIDDLEBACKRIGHT:
+			abs_rotr(c);
+			break;
+		case MIDDLEFRONTRIGHT:
+			abs_rotri(c);
+			break;
+		case BLUECROSSFRONT:
+			abs_rotui(c);
+			abs_rotri(c);
+			abs_rotri(c);
+			break;
+		case BLUECROSSLEFT:
+			abs_rotui(c);
+			abs_rotui(c);
+			abs_rotri(c);
+			abs_rotri(c);
+			break;
+		case BLUECROSSBACK:
+			abs_rotu(c);
+			abs_rotri(c);
+			abs_rotri(c);
+			break;
+		case BLUECROSSRIGHT:
+			abs_rotri(c);
+			abs_rotri(c);
+			break;
+	}
+	// check if the GRN/RED piece is inverted; if it is, fUlu it
+	if (c->face[DOWN].tile[1][2] == RED)
+	{
+		if (LOGGING)
+			printf("solve_green_cross: solve GRN/RED: fUlu\n");
+		abs_macro(c, MACRO_FLIP_GRN_RED);
+	}
+
+	// find the green/yellow block
+	int gy2blockloc = locate_2block(c, GRN, YEL);
+	if (LOGGING)
+		printf("solve_green_cross: solve GRN/YEL: 2-block found at block2pair #%d.\n", gy2blockloc);
+	// swing it around to position 2
+	switch (gy2blockloc)
+	{
+			// not going to be at pos 0, 1 or 3
+		case GREENCROSSBACK:
+			// nothing to do
+			break;
+		case MIDDLEFRONTLEFT:
+			abs_rotli(c);
+			abs_rotu(c);
+			abs_rotl(c);
+			abs_rotb(c);
+			abs_rotb(c);
+			break;
+		case MIDDLEBACKLEFT:
+			abs_rotb(c);
+			break;
+		case MIDDLEBACKRIGHT:
+			abs_rotbi(c);
+			break;
+		case MIDDLEFRONTRIGHT:
+			abs_rotr(c);
+			abs_rotui(c);
+			abs_rotri(c);
+			abs_rotb(c);
+			abs_rotb(c);
+			break;
+		case BLUECROSSFRONT:
+			abs_rotu(c);
+			abs_rotu(c);
+			abs_rotb(c);
+			abs_rotb(c);
+			break;
+		case BLUECROSSLEFT:
+			abs_rotu(c);
+			abs_rotb(c);
+			abs_rotb(c);
+			break;
+		case BLUECROSSBACK:
+			abs_rotb(c);
+			abs_rotb(c);
+			break;
+		case BLUECROSSRIGHT:
+			abs_rotui(c);
+			abs_rotb(c);
+			abs_rotb(c);
+			break;
+	}
+	// check if the GRN/YEL piece is inverted; if it is, fUlu it
+	if (c->face[DOWN].tile[2][1] == YEL)
+	{
+		if (LOGGING)
+			printf("solve_green_cross: solve GRN/YEL: fUlu\n");
+		abs_macro(c, MACRO_FLIP_GRN_YEL);
+	}
+
+	c->solveGreenCrossMoves = c->totalMoves;
+	
+	if (LOGGING)
+		printf("solve_green_cross: solved green cross.\n");
+}
+
+void solve_green_corners(cube_t *c)
+{
+	// find the green/orange/white block
+	int gow3blockloc = locate_3block(c, GRN, ORG, WHT);
+	if (LOGGING)
+		printf("solve_green_corners: solve GRN/ORG/WHT: 3-block found at block3triplet #%d.\n", gow3blockloc);
+	// swing it around to either positions 0 or 4 (GREENCORNERFRONTLEFT or BLUECORNERFRONTLEFT)
+	switch (gow3blockloc)
+	{
+		case GREENCORNERFRONTLEFT:
+			// cool, nothing to do
+			break;
+		case GREENCORNERBACKLEFT:
+			abs_rotbi(c);
+			abs_rotui(c);
+			abs_rotb(c);
+			break;
+		case GREENCORNERBACKRIGHT:
+			abs_rotb(c);
+			abs_rotu(c);
+			abs_rotu(c);
+			abs_rotbi(c);
+			break;
+		case GREENCORNERFRONTRIGHT:
+			abs_rotr(c);
+			abs_rotu(c);
+			abs_rotri(c);
+			break;
+		case BLUECORNERFRONTLEFT:
+			// this position is cool too
+			break;
+		case BLUECORNERBACKLEFT:
+			abs_rotui(c);
+			break;
+		case BLUECORNERBACKRIGHT:
+			abs_rotui(c);
+			abs_rotui(c);
+			break;
+		case BLUECORNERFRONTRIGHT:
+			abs_rotu(c);
+			break;
+	}
+	// rdRD the cube up to 6 times to get the piece in place
+	for (int i = 0; i < 6; i++)
+	{
+		// check to see if we got it
+		if ((c->face[FRONT].tile[2][0] == WHT) &&
+			(c->face[LEFT].tile[2][2] == ORG) &&
+			(c->face[DOWN].tile[0][0] == GRN))
+			break;
+		if (LOGGING)
+			printf("solve_green_corners: solve GRN/ORG/WHT: rdRD\n");
+		// rdRD the cube
+		abs_macro(c, MACRO_RDRD_GRN_ORG_WHT);
+	}
+
+	// find the green/orange/yellow block
+	int goy3blockloc = locate_3block(c, GRN, ORG, YEL);
+	if (LOGGING)
+		printf("solve_green_corners: solve GRN/ORG/YEL: 3-block found at block3triplet #%d.\n", goy3blockloc);
+	// swing it around to either positions 1 or 5 (GREENCORNERBACKLEFT or BLUECORNERBACKLEFT)
+	switch (goy3blockloc)
+	{
+		case GREENCORNERBACKLEFT:
+			// nothing to do
+			break;
+		case GREENCORNERBACKRIGHT:
+			abs_rotb(c);
+			abs_rotu(c);
+			abs_rotbi(c);
+			abs_rotu(c);
+			abs_rotu(c);
+			break;
+		case GREENCORNERFRONTRIGHT:
+			abs_rotr(c);
+			abs_rotui(c);
+			abs_rotui(c);
+			abs_rotri(c);
+			break;
+		case BLUECORNERFRONTLEFT:
+			abs_rotu(c);
+			break;
+		case BLUECORNERBACKLEFT:
+			// nothing to do
+			break;
+		case BLUECORNERBACKRIGHT:
+			abs_rotui(c);
+			break;
+		case BLUECORNERFRONTRIGHT:
+			abs_rotu(c);
+			abs_rotu(c);
+			break;
+	}
+	// rdRD the cube up to 6 times to get the piece in place
+	for (int i = 0; i < 6; i++)
+	{
+		// check to see if we got it
+		if ((c->face[BACK].tile[2][2] == YEL) &&
+			(c->face[LEFT].tile[2][0] == ORG) &&
+			(c->face[DOWN].tile[2][0] == GRN))
+			break;
+		if (LOGGING)
+			printf("solve_green_corners: solve GRN/ORG/YEL: rdRD\n");
+		// rdRD the cube
+		abs_macro(c, MACRO_RDRD_GRN_ORG_YEL);
+	}
+
+	// find the green/yellow/red block
+	int gyr3blockloc = locate_3block(c, GRN, YEL, RED);
+	if (LOGGING)
+		printf("solve_green_corners: solve GRN/YEL/RED: 3-block found at block3triplet #%d.\n", gyr3blockloc);
+	// swing it around to either positions 2 or 6 (GREENCORNERBACKRIGHT or BLUECORNERBACKRIGHT)
+	switch (gyr3blockloc)
+	{
+		case GREENCORNERBACKRIGHT:
+			// nothing to do
+			break;
+		case GREENCORNERFRONTRIGHT:
+			abs_rotr(c);
+			abs_rotu(c);
+			abs_rotu(c);
+			abs_rotri(c);
+			abs_rotu(c);
+			break;
+		case BLUECORNERFRONTLEFT:
+			abs_rotu(c);
+			abs_rotu(c);
+			break;
+		case BLUECORNERBACKLEFT:
+			abs_rotu(c);
+			break;
+		case BLUECORNERBACKRIGHT:
+			// nothing to do
+			break;
+		case BLUECORNERFRONTRIGHT:
+			abs_rotui(c);
+			break;
+	}
+	// rdRD the cube up to 6 times to get the piece in place
+	for (int i = 0; i < 6; i++)
+	{
+		// check to see if we got it
+		if ((c->face[BACK].tile[2][0] == YEL) &&
+			(c->face[RIGHT].tile[2][2] == RED) &&
+			(c->face[DOWN].tile[2][2] == GRN))
+			break;
+		if (LOGGING)
+			printf("solve_green_corners: solve GRN/YEL/RED: rdRD\n");
+		// rdRD the cube
+		abs_macro(c, MACRO_RDRD_GRN_YEL_RED);
+	}
+
+	// find the green/white/red block
+	int gwr3blockloc = locate_3block(c, GRN, WHT, RED);
+	if (LOGGING)
+		printf("solve_green_corners: solve GRN/WHT/RED: 3-block found at block3triplet #%d.\n", gwr3blockloc);
+	// swing it around to either positions 3 or 7 (GREENCORNERFRONTRIGHT or BLUECORNERFRONTRIGHT)
+	switch (gwr3blockloc)
+	{
+		case GREENCORNERFRONTRIGHT:
+			// nothing to do
+			break;
+		case BLUECORNERFRONTLEFT:
+			abs_rotui(c);
+			break;
+		case BLUECORNERBACKLEFT:
+			abs_rotu(c);
+			abs_rotu(c);
+			break;
+		case BLUECORNERBACKRIGHT:
+			abs_rotu(c);
+			break;
+		case BLUECORNERFRONTRIGHT:
+			// nothing to do
+			break;
+	}
+	// rdRD the cube up to 6 times to get the piece in place
+	for (int i = 0; i < 6; i++)
+	{
+		// check to see if we got it
+		if ((c->face[FRONT].tile[2][2] == WHT) &&
+			(c->face[RIGHT].tile[2][0] == RED) &&
+			(c->face[DOWN].tile[0][2] == GRN))
+			break;
+		if (LOGGING)
+			printf("solve_green_corners: solve GRN/WHT/RED: rdRD\n");
+		// rdRD the cube
+		abs_macro(c, MACRO_RDRD_GRN_WHT_RED);
+	}
+	
+	c->solveGreenCornersMoves = c->totalMoves - c->solveGreenCrossMoves;
+	
+	if (LOGGING)
+		printf("solve_green_corners: solved green corners and bottom stack of cube.\n");
+}
+
+void solve_middle_edges(cube_t *c)
+{
+	if (LOGGING)
+		printf("solve_middle_edges: solving middle edges:\n");
+	
+	// locate WHT/ORG piece
+	int wo2blockloc = locate_2block(c, WHT, ORG);
+	if (LOGGING)
+		printf("solve_middle_edges: solve WHT/ORG: 2-block found at block2pair #%d.\n", wo2blockloc);
+	// if it's not magically in place, then we need to process it
+	if (!((c->face[FRONT].tile[1][0] == WHT) && (c->face[LEFT].tile[1][2] == ORG)))
+	{
+		// if the desired block is in the middle stack, we need to get it up top.
+		if ((wo2blockloc >= MIDDLEFRONTLEFT) && (wo2blockloc <= MIDDLEFRONTRIGHT))
+		{
+			if (LOGGING)
+				printf("solve_middle_edges: move WHT/ORG 2-block to top stack.\n");
+			switch (wo2blockloc)
+			{
+				case MIDDLEFRONTLEFT:
+					// left-lay facing front
+					abs_macro(c, MACRO_LAY_LEFT_FRONT);
+					break;
+				case MIDDLEBACKLEFT:
+					// right-lay facing back
+					abs_macro(c, MACRO_LAY_RIGHT_BACK);
+					break;
+				case MIDDLEBACKRIGHT:
+					// left-lay facing back
+					abs_macro(c, MACRO_LAY_LEFT_BACK);
+					break;
+				case MIDDLEFRONTRIGHT:
+					// right-lay facing front
+					abs_macro(c, MACRO_LAY_RIGHT_FRONT);
+					break;
+			} // switch
+			// locate the piece again since we moved it. it should be on top now.
+			wo2blockloc = locate_2block(c, WHT, ORG);
+			if (LOGGING)
+				printf("solve_middle_edges: WHT/ORG 2-block now at block2pair %d.\n", wo2blockloc);
+		} // if block is in middle stack
+		// if block is not at BLUECROSSFRONT, flip it around so it is
+		if (wo2blockloc != BLUECROSSFRONT)
+		{
+			if (LOGGING)
+				printf("solve_middle_edges: move WHT/ORG 2-block to BLUECROSSFRONT.\n");
+			switch (wo2blockloc)
+			{
+				case BLUECROSSFRONT:
+					// do nothing
+					break;
+				case BLUECROSSLEFT:
+					abs_rotui(c);
+					break;
+				case BLUECROSSBACK:
+					abs_rotu(c);
+					abs_rotu(c);
+					break;
+				case BLUECROSSRIGHT:
+					abs_rotu(c);
+					break;
+			}
+		}
+		// lay the square down into place according to it's orientation
+		if (LOGGING)
+			printf("solve_middle_edges: lay WHT/ORG 2-block down into place.\n");
+		if (c->face[FRONT].tile[0][1] == WHT)
+		{
+			// lay it down to the left
+			abs_macro(c, MACRO_LAY_LEFT_FRONT);
+		}
+		else
+		{
+			// lay it down to the right from orange side
+			abs_macro(c, MACRO_LAY_WHT_ORG_INVERTED);
+		}
+	}
+
+	// locate WHT/RED piece
+	int wr2blockloc = locate_2block(c, WHT, RED);
+	if (LOGGING)
+		printf("solve_middle_edges: solve WHT/RED: 2-block found at block2pair #%d.\n", wr2blockloc);
+	// if it's not magically in place, then we need to process it
+	if (!((c->face[FRONT].tile[1][2] == WHT) && (c->face[RIGHT].tile[1][0] == RED)))
+	{
+		// if the desired block is in the middle stack, we need to get it up top.
+		if ((wr2blockloc >= MIDDLEFRONTLEFT) && (wr2blockloc <= MIDDLEFRONTRIGHT))
+		{
+			if (LOGGING)
+				printf("solve_middle_edges: move WHT/RED 2-block to top stack.\n");
+			switch (wr2blockloc)
+			{
+				case MIDDLEBACKLEFT:
+					// right-lay facing back
+					abs_macro(c, MACRO_LAY_RIGHT_BACK);
+					break;
+				case MIDDLEBACKRIGHT:
+					// left-lay facing back
+					abs_macro(c, MACRO_LAY_LEFT_BACK);
+					break;
+				case MIDDLEFRONTRIGHT:
+					// right-lay facing front
+					abs_macro(c, MACRO_LAY_RIGHT_FRONT);
+					break;
+			} // switch
+			// locate the piece again since we moved it. it should be on top now.
+			wr2blockloc = locate_2block(c, WHT, RED);
+			if (LOGGING)
+				printf("solve_middle_edges: WHT/RED 2-block now at block2pair %d.\n", wr2blockloc);
+		} // if block is in middle stack
+		// if block is not at BLUECROSSFRONT, flip it around so it is
+		if (wr2blockloc != BLUECROSSFRONT)
+		{
+			if (LOGGING)
+				printf("solve_middle_edges: move WHT/RED 2-block to BLUECROSSFRONT.\n");
+			switch (wr2blockloc)
+			{
+				case BLUECROSSFRONT:
+					// do nothing
+					break;
+				case BLUECROSSLEFT:
+					abs_rotui(c);
+					break;
+				case BLUECROSSBACK:
+					abs_rotu(c);
+					abs_rotu(c);
+					break;
+				case BLUECROSSRIGHT:
+					abs_rotu(c);
+					break;
+			}
+		}
+		// lay the square down into place according to it's orientation
+		if (LOGGING)
+			printf("solve_middle_edges: lay WHT/RED 2-block down into place.\n");
+		if (c->face[FRONT].tile[0][1] == WHT)
+		{
+			// lay it down to the right
+			abs_macro(c, MACRO_LAY_RIGHT_FRONT);
+		}
+		else
+		{
+			// lay it down to the left from red side
+			abs_macro(c, MACRO_LAY_WHT_RED_INVERTED);
+		}
+	}
+
+	// locate YEL/ORG piece
+	int yo2blockloc = locate_2block(c, YEL, ORG);
+	if (LOGGING)
+		printf("solve_middle_edges: solve YEL/ORG: 2-block found at block2pair #%d.\n", yo2blockloc);
+	// if it's not magically in place, then we need to process it
+	if (!((c->face[BACK].tile[1][2] == YEL) && (c->face[LEFT].tile[1][0] == ORG)))
+	{
+		// if the desired block is in the middle stack, we need to get it up top.
+		if ((yo2blockloc >= MIDDLEFRONTLEFT) && (yo2blockloc <= MIDDLEFRONTRIGHT))
+		{
+			if (LOGGING)
+				printf("solve_middle_edges: move YEL/ORG 2-block to top stack.\n");
+			switch (yo2blockloc)
+			{
+				case MIDDLEBACKLEFT:
+					// right-lay facing back
+					abs_macro(c, MACRO_LAY_RIGHT_BACK);
+					break;
+				case MIDDLEBACKRIGHT:
+					// left-lay facing back
+					abs_macro(c, MACRO_LAY_LEFT_BACK);
+					break;
+			} // switch
+			// locate the piece again since we moved it. it should be on top now.
+			yo2blockloc = locate_2block(c, YEL, ORG);
+			if (LOGGING)
+				printf("solve_middle_edges: YEL/ORG 2-block now at block2pair %d.\n", yo2blockloc);
+		} // if block is in middle stack
+		// if block is not at BLUECROSSBACK, flip it around so it is
+		if (yo2blockloc != BLUECROSSBACK)
+		{
+			if (LOGGING)
+				printf("solve_middle_edges: move YEL/ORG 2-block to BLUECROSSBACK.\n");
+			switch (yo2blockloc)
+			{
+				case BLUECROSSFRONT:
+					abs_rotu(c);
+					abs_rotu(c);
+					break;
+				case BLUECROSSLEFT:
+					abs_rotu(c);
+					break;
+				case BLUECROSSBACK:
+					// do nothing
+					break;
+				case BLUECROSSRIGHT:
+					abs_rotui(c);
+					break;
+			}
+		}
+		// lay the square down into place according to it's orientation
+		if (LOGGING)
+			printf("solve_middle_edges: lay YEL/ORG 2-block down into place.\n");
+		if (c->face[BACK].tile[0][1] == YEL)
+		{
+			// lay it down to the right
+			abs_macro(c, MACRO_LAY_RIGHT_BACK);
+		}
+		else
+		{
+			// lay it down to the left from orange side
+			abs_macro(c, MACRO_LAY_YEL_ORG_INVERTED);
+		}
+	}
+	
+	// locate YEL/RED piece
+	int yr2blockloc = locate_2block(c, YEL, RED);
+	if (LOGGING)
+		printf("solve_middle_edges: solve YEL/RED: 2-block found at block2pair #%d.\n", yr2blockloc);
+	// if it's not magically in place, then we need to process it
+	if (!((c->face[BACK].tile[1][0] == YEL) && (c->face[RIGHT].tile[1][2] == RED)))
+	{
+		// if the desired block is in the middle stack, we need to get it up top.
+		if ((yr2blockloc >= MIDDLEFRONTLEFT) && (yr2blockloc <= MIDDLEFRONTRIGHT))
+		{
+			if (LOGGING)
+				printf("solve_middle_edges: move YEL/RED 2-block to top stack.\n");
+			// left-lay facing back
+			abs_macro(c, MACRO_LAY_LEFT_BACK);
+			// locate the piece again since we moved it. it should be on top now.
+			yr2blockloc = locate_2block(c, YEL, RED);
+			if (LOGGING)
+				printf("solve_middle_edges: YEL/RED 2-block now at block2pair %d.\n", yr2blockloc);
+		} // if block is in middle stack
+		// if block is not at BLUECROSSBACK, flip it around so it is
+		if (yr2blockloc != BLUECROSSBACK)
+		{
+			if (LOGGING)
+				printf("solve_middle_edges: move YEL/RED 2-block to BLUECROSSBACK.\n");
+			switch (yr2blockloc)
+			{
+				case BLUECROSSFRONT:
+					abs_rotu(c);
+					abs_rotu(c);
+					break;
+				case BLUECROSSLEFT:
+					abs_rotu(c);
+					break;
+				case BLUECROSSBACK:
+					// do nothing
+					break;
+				case BLUECROSSRIGHT:
+					abs_rotui(c);
+					break;
+			}
+		}
+		// lay the square down into place according to it's orientation
+		if (LOGGING)
+			printf("solve_middle_edges: lay YEL/RED 2-block down into place.\n");
+		if (c->face[BACK].tile[0][1] == YEL)
+		{
+			// lay it down to the left
+			abs_macro(c, MACRO_LAY_LEFT_BACK);
+		}
+		else
+		{
+			// lay it down to the right from red side
+			abs_macro(c, MACRO_LAY_YEL_RED_INVERTED);
+		}
+	}
+	
+	c->solveMiddleEdgesMoves = c->totalMoves - c->solveGreenCornersMoves - c->solveGreenCrossMoves;
+
+	if (LOGGING)
+		printf("solve_middle_edges: solved middle edges and bottom/middle stacks of cube.\n");
+}
+
+// Last Layer Table
+// With --last-layer, the blue cross and blue corners stages don't loop over their sequences. Once the middle
+// edges are in, the top layer is one of 62208 arrangements of its 4 edges and 4 corners. At startup a shortest
+// path search from the solved cube, over U turns and a few last layer algorithms that leave the bottom two
+// layers alone (each from all four sides), finds the fewest moves to solve every arrangement, and the table
+// keeps which algorithm starts that solution. The stages just look the top layer up and apply what the table
+// says until they're done: the blue cross stage until the top edges are home, the blue corners stage the rest
+// of the way. The two stages then average about 24 moves together.
+#define LL_INDEXES (24 * 81 * 24 * 16) // corner permutation, twists, edge permutation, flips
+#define LL_ALGORITHMS 8
+#define LL_GENERATORS (2 + LL_ALGORITHMS * 4)
+#define LL_SOLVED 254
+#define LL_NONE 255
+
+// sune and its inverse, and mirrored; an edge flip and its inverse; a corner cycle and its inverse
+const char *ll_algorithm_text[LL_ALGORITHMS] = {
+	"R U Ri U R U U Ri", "R U U Ri Ui R Ui Ri", "Li Ui L Ui Li U U L", "Li U U L U Li U L",
+	"F R U Ri Ui Fi", "F U R Ui Ri Fi", "U R Ui Li U Ri Ui L", "Li U R Ui L U Ri Ui"
+};
+
+bool last_layer_table = false;
+char ll_generator_text[LL_GENERATORS][40];
+int ll_generator_seq[LL_GENERATORS];
+unsigned char *ll_next = NULL; // by ll_index: the generator to apply next, LL_SOLVED, or LL_NONE if unreachable
+
+// a permutation of 4 written as base 4 digits, to its rank, and back
+signed char perm4_rank[256];
+unsigned char perm4_of_rank[24][4];
+
+// Index of the top layer of c, whose bottom two layers must be solved
+static inline int ll_index(const cubie_t *c)
+{
+	int corner_perm = 0, twists = 0, edge_perm = 0, flips = 0;
+	for (int p = URF; p <= UBR; p++)
+	{
+		int loc = cubie_corner(c, p);
+		corner_perm = corner_perm * 4 + loc / 3;
+		twists = twists * 3 + loc % 3;
+	}
+	for (int p = UR; p <= UB; p++)
+	{
+		int loc = cubie_edge(c, p);
+		edge_perm = edge_perm * 4 + loc / 2;
+		flips = flips * 2 + loc % 2;
+	}
+	return ((perm4_rank[corner_perm] * 81 + twists) * 24 + perm4_rank[edge_perm]) * 16 + flips;
+}
+
+// The cube whose top layer has index i; the index needn't be of a solvable cube
+static void ll_cubie(int i, cubie_t *c)
+{
+	int flips = i % 16;
+	int edge_perm = (i / 16) % 24;
+	int twists = (i / (16 * 24)) % 81;
+	int corner_perm = i / (16 * 24 * 81);
+	*c = solved_cubie;
+	for (int p = 3; p >= 0; p--)
+	{
+		cubie_set_corner(c, URF + p, perm4_of_rank[corner_perm][p] * 3 + twists % 3);
+		cubie_set_edge(c, UR + p, perm4_of_rank[edge_perm][p] * 2 + flips % 2);
+		twists /= 3;
+		flips /= 2;
+	}
+}
+
+void init_last_layer_table(void)
+{
+	memset(perm4_rank, -1, sizeof(perm4_rank));
+	int rank = 0;
+	for (int digits = 0; digits < 256; digits++)
+	{
+		int d[4] = { digits >> 6, (digits >> 4) & 3, (digits >> 2) & 3, digits & 3 };
+		if ((d[0] == d[1]) || (d[0] == d[2]) || (d[0] == d[3]) || (d[1] == d[2]) || (d[1] == d[3]) || (d[2] == d[3]))
+			continue;
+		perm4_rank[digits] = rank;
+		for (int p = 0; p < 4; p++)
+			perm4_of_rank[rank][p] = d[p];
+		rank++;
+	}
+	
+	// the generators: U, Ui, and each algorithm turned to start from each side. turning the cube a quarter
+	// about the up face takes R to B, B to L, L to F and F to R.
+	int len[LL_GENERATORS];
+	int inverse[LL_GENERATORS];
+	strcpy(ll_generator_text[0], "U");
+	strcpy(ll_generator_text[1], "Ui");
+	for (int a = 0; a < LL_ALGORITHMS; a++)
+	{
+		for (int turn = 0; turn < 4; turn++)
+		{
+			char *text = ll_generator_text[2 + a * 4 + turn];
+			strcpy(text, ll_algorithm_text[a]);
+			for (char *p = text; *p != '\0'; p++)
+			{
+				const char *side = strchr("RBLF", *p);
+				if (side != NULL)
+					*p = "RBLF"[(side - "RBLF" + turn) % 4];
+			}
+		}
+	}
+	for (int g = 0; g < LL_GENERATORS; g++)
+	{
+		ll_generator_seq[g] = intern_sequence(ll_generator_text[g]);
+		init_cubie_move(MACRO_BASE + ll_generator_seq[g]);
+		len[g] = sequences[ll_generator_seq[g]].length;
+	}
+	for (int g = 0; g < LL_GENERATORS; g++)
+	{
+		inverse[g] = -1;
+		for (int h = 0; h < LL_GENERATORS; h++)
+		{
+			cubie_t c = solved_cubie;
+			cubie_move(&c, MACRO_BASE + ll_generator_seq[g]);
+			cubie_move(&c, MACRO_BASE + ll_generator_seq[h]);
+			if (cubie_solved(&c))
+				inverse[g] = h;
+		}
+		if (inverse[g] < 0)
+		{
+			printf("Last layer algorithm %s has no inverse among the others!\n", ll_generator_text[g]);
+			exit(-1);
+		}
+	}
+	
+	table_part_t parts[1] = { { (void **)&ll_next, LL_INDEXES } };
+	if (map_tables("last-layer", parts, 1))
+		return;
+	
+	// shortest paths from solved, a distance at a time. the generators come with their inverses, so the way
+	// back from an arrangement reached by g starts with g's inverse.
+	unsigned char *distance = malloc(LL_INDEXES);
+	ll_next = malloc(LL_INDEXES);
+	if ((distance == NULL) || (ll_next == NULL))
+	{
+		printf("Unable to allocate the last layer table!\n");
+		exit(-1);
+	}
+	memset(distance, 0xff, LL_INDEXES);
+	memset(ll_next, LL_NONE, LL_INDEXES);
+	int solved = ll_index(&solved_cubie);
+	distance[solved] = 0;
+	ll_next[solved] = LL_SOLVED;
+	int reached = 1;
+	for (int d = 0; reached > 0; d++)
+	{
+		reached = 0;
+		for (int i = 0; i < LL_INDEXES; i++)
+		{
+			if ((distance[i] < d) || (distance[i] == 0xff))
+				continue;
+			if (distance[i] > d)
+			{
+				reached = 1; // still to come
+				continue;
+			}
+			cubie_t c;
+			ll_cubie(i, &c);
+			for (int g = 0; g < LL_GENERATORS; g++)
+			{
+				cubie_t next = c;
+				cubie_move(&next, MACRO_BASE + ll_generator_seq[g]);
+				int j = ll_index(&next);
+				if (distance[j] > d + len[g])
+				{
+					distance[j] = d + len[g];
+					ll_next[j] = inverse[g];
+					reached = 1;
+				}
+			}
+		}
+	}
+	free(distance);
+	save_tables("last-layer", parts, 1);
+}
+
+// The generator to apply next to state, or -1 once its top edges are home (edges_only) or it's solved
+int ll_step(const cubie_t *state, bool edges_only)
+{
+	if (edges_only && cubie_edge_home(state, UR) && cubie_edge_home(state, UF) && cubie_edge_home(state, UL) &&
+		cubie_edge_home(state, UB))
+		return -1;
+	int g = ll_next[ll_index(state)];
+	if (g == LL_SOLVED)
+		return -1;
+	if (g == LL_NONE)
+	{
+		printf("Last layer arrangement isn't in the table!\n");
+		exit(-1);
+	}
+	return g;
+}
+
+// Apply the table's algorithms to c until its top edges are home, or with edges_only false until it's solved
+void walk_last_layer(cube_t *c, bool edges_only)
+{
+	cubie_t state;
+	if (c->indexed)
+		state = c->pieces;
+	else
+		facelets_to_cubie(c->facelet, &state);
+	
+	for (int g = ll_step(&state, edges_only); g >= 0; g = ll_step(&state, edges_only))
+	{
+		abs_rot_sequence(c, ll_generator_seq[g]);
+		cubie_move(&state, MACRO_BASE + ll_generator_seq[g]);
+	}
+}
+
+int identify_blue_cross_state(cube_t *c)
+{
+	// identify if we have an L, a line, or a cross, and which way they are pointing.
+	
+	if ((c->face[UP].tile[0][1] == BLU) && (c->face[UP].tile[1][0] == BLU) && (c->face[UP].tile[1][2] == BLU) && (c->face[UP].tile[2][1] == BLU))
+		return BLUECROSSSTATECROSS;
+	
+	if ((c->face[UP].tile[1][0] == BLU) && (c->face[UP].tile[1][2] == BLU))
+		return BLUECROSSSTATELINEH;
+	
+	if ((c->face[UP].tile[0][1] == BLU) && (c->face[UP].tile[2][1] == BLU))
+		return BLUECROSSSTATELINEV;
+	
+	if ((c->face[UP].tile[1][0] == BLU) && (c->face[UP].tile[2][1] == BLU))
+		return BLUECROSSSTATELFRONTLEFT;
+	
+	if ((c->face[UP].tile[1][0] == BLU) && (c->face[UP].tile[0][1] == BLU))
+		return BLUECROSSSTATELBACKLEFT;
+	
+	if ((c->face[UP].tile[0][1] == BLU) && (c->face[UP].tile[1][2] == BLU))
+		return BLUECROSSSTATELBACKRIGHT;
+	
+	if ((c->face[UP].tile[1][2] == BLU) && (c->face[UP].tile[2][1] == BLU))
+		return BLUECROSSSTATELFRONTRIGHT;
+	
+	return BLUECROSSSTATENONE;
+}
+
+void solve_blue_cross(cube_t *c)
+{
+	if (LOGGING)
+		printf("solve_blue_cross: solving blue cross:\n");
+	
+	if (last_layer_table)
+	{
+		walk_last_layer(c, true);
+		c->solveBlueCrossMoves = c->totalMoves - c->solveMiddleEdgesMoves - c->solveGreenCornersMoves - c->solveGreenCrossMoves;
+		return;
+	}
+	
+	int bluecrosstype = identify_blue_cross_state(c);
+	while (bluecrosstype != BLUECROSSSTATECROSS)
+	{
+		if (LOGGING)
+			printf("solve_blue_cross: found blue cross state to be %d.\n", bluecrosstype);
+		switch (bluecrosstype)
+		{
+			case BLUECROSSSTATENONE:
+				abs_macro(c, MACRO_CROSS_FRONT);
+				break;
+			case BLUECROSSSTATELFRONTLEFT:
+				abs_macro(c, MACRO_CROSS_RIGHT);
+				break;
+			case BLUECROSSSTATELBACKLEFT:
+				abs_macro(c, MACRO_CROSS_FRONT);
+				break;
+			case BLUECROSSSTATELBACKRIGHT:
+				abs_macro(c, MACRO_CROSS_LEFT);
+				break;
+			case BLUECROSSSTATELFRONTRIGHT:
+				abs_macro(c, MACRO_CROSS_BACK);
+				break;
+			case BLUECROSSSTATELINEH:
+				abs_macro(c, MACRO_CROSS_FRONT);
+				break;
+			case BLUECROSSSTATELINEV:
+				abs_macro(c, MACRO_CROSS_LEFT);
+				break;
+		}
+		
+		// get it again now that we twiddled it
+		bluecrosstype = identify_blue_cross_state(c);
+	}
+	
+	// get the blue/white piece in front and aligned
+	while (locate_2block(c, BLU, WHT) != BLUECROSSFRONT)
+		abs_rotu(c);
+	
+	// get the blu/red piece in it's proper spot on the left
+	while (locate_2block(c, BLU, RED) != BLUECROSSRIGHT)
+	{
+		if (LOGGING)
+			printf("solve_blue_cross: aligning BLU/RED piece.\n");
+		abs_macro(c, MACRO_CROSS_SWAP);
+	}
+	
+	// if blu/yel and blu/org are in a parity state around the left and back, then we want to
+	// repeat previous algorithm looking at the orange side (blu/white and blu/red facing the adjusted "back right corner")
+	// do this until the white, red, yellow and orange pieces line up in sequence (but not necessarily in the right spots)
+	// the yellow piece will stay put (in it's wrong spot) on the left (orange) side, while the white, red and orange pieces will cascade
+	// around the front, right and back. When they are in order of yellow, orange, white and red (going CCW) starting on the left,
+	// then we will give it one final up-rotation to align them.
+	if ((locate_2block(c, BLU, YEL) == BLUECROSSLEFT) && (locate_2block(c, BLU, ORG) == BLUECROSSBACK))
+	{
+		while ((locate_2block(c, BLU, ORG) != BLUECROSSFRONT) ||
+			   (locate_2block(c, BLU, WHT) != BLUECROSSRIGHT) ||
+			   (locate_2block(c, BLU, RED) != BLUECROSSBACK))
+		{
+			if (LOGGING)
+				printf("solve_blue_cross: fixing BLU/YEL and BLU/ORG parity.\n");
+			abs_macro(c, MACRO_CROSS_PARITY);
+		}
+		// and one final up-rotation to fix it
+		abs_rotu(c);
+	}
+	
+	c->solveBlueCrossMoves = c->totalMoves - c->solveMiddleEdgesMoves - c->solveGreenCornersMoves - c->solveGreenCrossMoves;
+	
+	if (LOGGING)
+		printf("solve_blue_cross: solved blue cross.\n");
+}
+
+bool check_blue_corner_alignment(cube_t *c, int corner)
+{
+	// returns TRUE if the specified corner is aligned properly with all the colors pointing the right way
+	bool retval = false;
+	
+	switch (corner)
+	{
+		case BLUECORNERFRONTLEFT:
+			if ((c->face[FRONT].tile[0][0] == WHT) && (c->face[LEFT].tile[0][2] == ORG) && (c->face[UP].tile[2][0] == BLU))
+				retval = true;
+			break;
+		case BLUECORNERBACKLEFT:
+			if ((c->face[BACK].tile[0][2] == YEL) && (c->face[LEFT].tile[0][0] == ORG) && (c->face[UP].tile[0][0] == BLU))
+				retval = true;
+			break;
+		case BLUECORNERBACKRIGHT:
+			if ((c->face[BACK].tile[0][0] == YEL) && (c->face[RIGHT].tile[0][2] == RED) && (c->face[UP].tile[0][2] == BLU))
+				retval = true;
+			break;
+		case BLUECORNERFRONTRIGHT:
+			if ((c->face[FRONT].tile[0][2] == WHT) && (c->face[RIGHT].tile[0][0] == RED) && (c->face[UP].tile[2][2] == BLU))
+				retval = true;
+			break;
+	}
+	return retval;
+}
+
+bool check_working_corner_alignment(cube_t *c, int working_corner, int piece_of_interest)
+{
+	// this function checks corner working_corner for a proper alignment of piece_of_interest, as the top later
+	// is rotated during the final solve. piece_of_interest is the corner where the proper color normally resides.
+	// for instance, if we call this function with working_corner = BLUECORNERFRONTLEFT and piece_of_interest is
+	// BLUECORNERBACKRIGHT, it will check the front-left corner for a proper alignment of the red/yellow/blue piece,
+	// if it were rotated into position into the front-left corner.
+	
+	// returns TRUE if the specified corner is aligned properly with all the colors pointing the right way
+	bool retval = false;
+	
+	switch (working_corner)
+	{
+		case BLUECORNERFRONTLEFT:
+			switch (piece_of_interest)
+			{
+				case BLUECORNERFRONTLEFT:
+					if ((c->face[FRONT].tile[0][0] == WHT) && (c->face[LEFT].tile[0][2] == ORG) && (c->face[UP].tile[2][0] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERBACKLEFT:
+					if ((c->face[FRONT].tile[0][0] == ORG) && (c->face[LEFT].tile[0][2] == YEL) && (c->face[UP].tile[2][0] == BLU))
+						retval = true;
+					break;					
+				case BLUECORNERBACKRIGHT:
+					if ((c->face[FRONT].tile[0][0] == YEL) && (c->face[LEFT].tile[0][2] == RED) && (c->face[UP].tile[2][0] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERFRONTRIGHT:
+					if ((c->face[FRONT].tile[0][0] == RED) && (c->face[LEFT].tile[0][2] == WHT) && (c->face[UP].tile[2][0] == BLU))
+						retval = true;
+					break;					
+			}
+			break;
+		case BLUECORNERBACKLEFT:
+			switch (piece_of_interest)
+			{
+				case BLUECORNERFRONTLEFT:
+					if ((c->face[BACK].tile[0][2] == ORG) && (c->face[LEFT].tile[0][0] == WHT) && (c->face[UP].tile[0][0] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERBACKLEFT:
+					if ((c->face[BACK].tile[0][2] == YEL) && (c->face[LEFT].tile[0][0] == ORG) && (c->face[UP].tile[0][0] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERBACKRIGHT:
+					if ((c->face[BACK].tile[0][2] == RED) && (c->face[LEFT].tile[0][0] == YEL) && (c->face[UP].tile[0][0] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERFRONTRIGHT:
+					if ((c->face[BACK].tile[0][2] == WHT) && (c->face[LEFT].tile[0][0] == RED) && (c->face[UP].tile[0][0] == BLU))
+						retval = true;
+					break;
+			}
+			break;
+		case BLUECORNERBACKRIGHT:
+			switch (piece_of_interest)
+			{
+				case BLUECORNERFRONTLEFT:
+					if ((c->face[BACK].tile[0][0] == WHT) && (c->face[RIGHT].tile[0][2] == ORG) && (c->face[UP].tile[0][2] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERBACKLEFT:
+					if ((c->face[BACK].tile[0][0] == ORG) && (c->face[RIGHT].tile[0][2] == YEL) && (c->face[UP].tile[0][2] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERBACKRIGHT:
+					if ((c->face[BACK].tile[0][0] == YEL) && (c->face[RIGHT].tile[0][2] == RED) && (c->face[UP].tile[0][2] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERFRONTRIGHT:
+					if ((c->face[BACK].tile[0][0] == RED) && (c->face[RIGHT].tile[0][2] == WHT) && (c->face[UP].tile[0][2] == BLU))
+						retval = true;
+					break;
+			}
+			break;
+		case BLUECORNERFRONTRIGHT:
+			switch (piece_of_interest)
+			{
+				case BLUECORNERFRONTLEFT:
+					if ((c->face[FRONT].tile[0][2] == ORG) && (c->face[RIGHT].tile[0][0] == WHT) && (c->face[UP].tile[2][2] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERBACKLEFT:
+					if ((c->face[FRONT].tile[0][2] == YEL) && (c->face[RIGHT].tile[0][0] == ORG) && (c->face[UP].tile[2][2] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERBACKRIGHT:
+					if ((c->face[FRONT].tile[0][2] == RED) && (c->face[RIGHT].tile[0][0] == YEL) && (c->face[UP].tile[2][2] == BLU))
+						retval = true;
+					break;
+				case BLUECORNERFRONTRIGHT:
+					if ((c->face[FRONT].tile[0][2] == WHT) && (c->face[RIGHT].tile[0][0] == RED) && (c->face[UP].tile[2][2] == BLU))
+						retval = true;
+					break;
+			}
+			break;
+	}
+	return retval;
+}
+
+void align_blue_corners(cube_t *c)
+{
+	if (LOGGING)
+		printf("align_blue_corners: aligning blue corners:\n");
+	
+	if (last_layer_table)
+	{
+		walk_last_layer(c, false);
+		c->alignBlueCornersMoves = c->totalMoves - c->solveBlueCrossMoves - c->solveMiddleEdgesMoves - c->solveGreenCornersMoves - c->solveGreenCrossMoves;
+		return;
+	}
+	
+	// repeat the corner alignment algorithm until we have at least one corner piece in the right spot (although not necessarily flipped the right way)
+	while (!((locate_3block(c, BLU, WHT, ORG) == BLUECORNERFRONTLEFT) ||
+		   (locate_3block(c, BLU, YEL, ORG) == BLUECORNERBACKLEFT) ||
+		   (locate_3block(c, BLU, YEL, RED) == BLUECORNERBACKRIGHT) ||
+		   (locate_3block(c, BLU, WHT, RED) == BLUECORNERFRONTRIGHT)))
+	{
+		if (LOGGING)
+			printf("align_blue_corners: no corners aligned; trying to get initial corner piece aligned\n");
+		abs_macro(c, MACRO_CYCLE_FRONT_RIGHT);
+	}
+	
+	// now, at least one of the corners is in the right spot. take a walk around the top of the cube and find one.
+	int good_corner = -1;
+	
+	if (locate_3block(c, BLU, WHT, ORG) == BLUECORNERFRONTLEFT)
+		good_corner = BLUECORNERFRONTLEFT;
+	else if (locate_3block(c, BLU, YEL, ORG) == BLUECORNERBACKLEFT)
+		good_corner = BLUECORNERBACKLEFT;
+	else if (locate_3block(c, BLU, YEL, RED) == BLUECORNERBACKRIGHT)
+		good_corner = BLUECORNERBACKRIGHT;
+	else if (locate_3block(c, BLU, WHT, RED) == BLUECORNERFRONTRIGHT)
+		good_corner = BLUECORNERFRONTRIGHT;
+	
+	// repeat corner alignment again, this time with the good corner in the front right while facing the appropriate side
+	// do it until all four corners are in the right spots
+	while (!((locate_3block(c, BLU, WHT, ORG) == BLUECORNERFRONTLEFT) &&
+			 (locate_3block(c, BLU, YEL, ORG) == BLUECORNERBACKLEFT) &&
+			 (locate_3block(c, BLU, YEL, RED) == BLUECORNERBACKRIGHT) &&
+			 (locate_3block(c, BLU, WHT, RED) == BLUECORNERFRONTRIGHT)))
+	{
+		if (LOGGING)
+			printf("align_blue_corners: trying to get corner pieces in the right spots\n");
+		switch (good_corner)
+		{
+			case BLUECORNERFRONTLEFT:
+				abs_macro(c, MACRO_CYCLE_FRONT_LEFT);
+				break;
+			case BLUECORNERBACKLEFT:
+				abs_macro(c, MACRO_CYCLE_BACK_LEFT);
+				break;
+			case BLUECORNERBACKRIGHT:
+				abs_macro(c, MACRO_CYCLE_BACK_RIGHT);
+				break;
+			case BLUECORNERFRONTRIGHT:
+				abs_macro(c, MACRO_CYCLE_FRONT_RIGHT);
+				break;
+		}
+	}
+	
+	// find out how many, and which blue corners, are twiddled
+	int bad_corners[4]; // array to hold corner tags
+	int num_bad_corners = -1; // zero based
+	for (int i = BLUECORNERFRONTLEFT; i <= BLUECORNERFRONTRIGHT; i++)
+	{
+		if (!check_blue_corner_alignment(c, i))
+		{
+			num_bad_corners++;
+			bad_corners[num_bad_corners] = i;
+		}
+	}
+	
+	if (LOGGING)
+	{
+		printf("align_blue_corners: %d twiddled blue corners.\n", num_bad_corners + 1);
+		for (int i = 0; i <= num_bad_corners; i++)
+			printf("align_blue_corners: --> corner %d is twiddled.\n", bad_corners[i]);
+	}
+	
+	// if there are no twiddled corners, the puzzle is solved! however, if there are,
+	// enter our "final solution" loop
+	if (num_bad_corners > -1)
+	{
+		// look at the side face with the first twiddled corner in the top right.
+		// do a series rdRD's until the corner is untwiddled.
+		// advance to the next twiddled corner (still looking at the first side face) by rotating up-inverted until the next
+		// twiddled face is in the top right. continue doing this until we are out of twiddled corners.
+		
+		// find out which way to look
+		int look_at;
+		switch (bad_corners[0])
+		{
+			case BLUECORNERFRONTLEFT:
+				look_at = LEFT;
+				break;
+			case BLUECORNERBACKLEFT:
+				look_at = BACK;
+				break;
+			case BLUECORNERBACKRIGHT:
+				look_at = RIGHT;
+				break;
+			case BLUECORNERFRONTRIGHT:
+				look_at = FRONT;
+				break;
+		}
+		
+		for (int i = 0; i <= num_bad_corners; i++)
+		{
 			if (LOGGING)
-				printf("solve_middle_edges: move WHT/ORG 2-block to top stack.\n");
-			switch (wo2blockloc)
 			{
-				case MIDDLEFRONTLEFT:
-					// left-lay facing front
-					abs_rotui(index);
-					abs_rotli(index);
-					abs_rotu(index);
-					abs_rotl(index);
-					abs_rotu(index);
-					abs_rotf(index);
-					abs_rotui(index);
-					abs_rotfi(index);
-					break;
-				case MIDDLEBACKLEFT:
-					// right-lay facing back
-					abs_rotu(index);
-					abs_rotl(index);
-					abs_rotui(index);
-					abs_rotli(index);
-					abs_rotui(index);
-					abs_rotbi(index);
-					abs_rotu(index);
-					abs_rotb(index);
-					break;
-				case MIDDLEBACKRIGHT:
-					// left-lay facing back
-					abs_rotui(index);
-					abs_rotri(index);
-					abs_rotu(index);
-					abs_rotr(index);
-					abs_rotu(index);
-					abs_rotb(index);
-					abs_rotui(index);
-					abs_rotbi(index);
-					break;
-				case MIDDLEFRONTRIGHT:
-					// right-lay facing front
-					abs_rotu(index);
-					abs_rotr(index);
-					abs_rotui(index);
-					abs_rotri(index);
-					abs_rotui(index);
-					abs_rotfi(index);
-					abs_rotu(index);
-					abs_rotf(index);
+				printf("align_blue_corners: fixing twiddle on corner %d.\n", bad_corners[i]);
+			}
+			
+			// rdRD the working corner (bad_corners[0]) until it's in proper alignment
+			while (!check_working_corner_alignment(c, bad_corners[0], bad_corners[i]))
+			{
+				switch (look_at)
+				{
+					case LEFT:
+						abs_macro(c, MACRO_TWIST_LEFT);
+						break;
+					case BACK:
+						abs_macro(c, MACRO_TWIST_BACK);
+						break;
+					case RIGHT:
+						abs_macro(c, MACRO_TWIST_RIGHT);
+						break;
+					case FRONT:
+						abs_macro(c, MACRO_TWIST_FRONT);
+						break;
+				}
+			}
+			
+			// if bad corners remain, rotate up-inverted (the next corner # - the current corner #) times.
+			if (i < num_bad_corners)
+			{
+				for (int j = bad_corners[i]; j < bad_corners[i + 1]; j++)
+					abs_rotui(c);
+			}
+		} // for int i = 0 to <= num_bad_corners
+		
+		// if the top layers is shifted, fix it
+		while (c->face[FRONT].tile[0][1] != WHT)
+			abs_rotu(c);
+	} // if num_bad_corners > -1
+	
+	c->alignBlueCornersMoves = c->totalMoves - c->solveBlueCrossMoves - c->solveMiddleEdgesMoves - c->solveGreenCornersMoves - c->solveGreenCrossMoves;
+	
+	if (LOGGING)
+		printf("align_blue_corners: aligned blue corners and solved cube.\n");
+}
+
+// Two-Phase Engine
+// With --engine two-phase, cubes are solved by Kociemba's two-phase algorithm instead of the five stages.
+// Phase 1 brings the cube into the subgroup where no corner is twisted, no edge is flipped and the four
+// middle edges are in the middle layer; phase 2 solves it from there with U and D turns and half turns of the
+// sides, which never leave the subgroup. Each phase runs IDA* over small coordinates of the cubie state,
+// stepped by move tables rather than by turning a cube, and bounded by pruning tables holding each pair of
+// coordinates' distance from the goal. Moves are quarter turns as everywhere else, so a half turn in phase 2
+// costs 2. Phase 1 solutions are tried shortest first, each followed by the shortest phase 2 from where it
+// ends, until a solution is two_phase_target moves or fewer, or no shorter one can turn up.
+enum { ENGINE_LAYERS, ENGINE_TWO_PHASE, ENGINE_OPTIMAL };
+
+#define TWISTS 2187 // 3^7 twists of the first 7 corner slots; the last follows
+#define FLIPS 2048 // 2^11 flips of the first 11 edge slots
+#define SLICES 495 // 12 choose 4 sets of slots for the middle edges
+#define PERMS8 40320 // 8! orders of the corners, or of the up and down edges in phase 2
+#define PERMS4 24 // 4! orders of the middle edges in phase 2
+#define PHASE1_MOVES 12
+#define PHASE2_MOVES 8
+#define PHASE2_DEPTH 18 // longest phase 2 searched for
+#define MAX_TWO_PHASE_MOVES 64
+
+int solve_engine = ENGINE_LAYERS;
+unsigned int two_phase_target = 30;
+
+// phase 2 moves, as one or two quarter turns
+const unsigned char phase2_quarters[PHASE2_MOVES][2] = {
+	{ ROTU }, { ROTUI }, { ROTD }, { ROTDI }, { ROTR, ROTR }, { ROTL, ROTL }, { ROTF, ROTF }, { ROTB, ROTB }
+};
+const unsigned char phase2_cost[PHASE2_MOVES] = { 1, 1, 1, 1, 2, 2, 2, 2 };
+
+// coordinate move tables, [coordinate * moves + move]
+uint16_t *twist_move = NULL;
+uint16_t *flip_move = NULL;
+uint16_t *slice_move = NULL;
+uint16_t *corner_perm_move = NULL;
+uint16_t *edge_perm_move = NULL;
+uint16_t *slice_perm_move = NULL;
+
+// pruning tables: moves from the phase's goal, by pair of coordinates
+unsigned char *twist_slice_prune = NULL;
+unsigned char *flip_slice_prune = NULL;
+unsigned char *twist_flip_prune = NULL;
+unsigned char *corner_slice_prune = NULL;
+unsigned char *edge_slice_prune = NULL;
+
+int slice_solved; // slice coordinate of the solved cube
+
+// the piece in each slot and how it's turned there, which is what the coordinates are counted over
+typedef struct {
+	unsigned char corner[8];
+	unsigned char twist[8];
+	unsigned char edge[12];
+	unsigned char flip[12];
+} cubie_slots_t;
+
+static void cubie_to_slots(const cubie_t *c, cubie_slots_t *s)
+{
+	for (int p = URF; p <= DRB; p++)
+	{
+		int loc = cubie_corner(c, p);
+		s->corner[loc / 3] = p;
+		s->twist[loc / 3] = loc % 3;
+	}
+	for (int p = UR; p <= BR; p++)
+	{
+		int loc = cubie_edge(c, p);
+		s->edge[loc / 2] = p;
+		s->flip[loc / 2] = loc % 2;
+	}
+}
+
+static void slots_to_cubie(const cubie_slots_t *s, cubie_t *c)
+{
+	for (int slot = 0; slot < 8; slot++)
+		cubie_set_corner(c, s->corner[slot], slot * 3 + s->twist[slot]);
+	for (int slot = 0; slot < 12; slot++)
+		cubie_set_edge(c, s->edge[slot], slot * 2 + s->flip[slot]);
+}
+
+static void solved_slots(cubie_slots_t *s)
+{
+	cubie_to_slots(&solved_cubie, s);
+}
+
+// Turn s by a list of quarter turns
+static void turn_slots(cubie_slots_t *s, const unsigned char *quarters, int n)
+{
+	cubie_t c = solved_cubie;
+	slots_to_cubie(s, &c);
+	for (int i = 0; i < n; i++)
+		cubie_move(&c, quarters[i]);
+	cubie_to_slots(&c, s);
+}
+
+static int twist_coord(const cubie_slots_t *s)
+{
+	int t = 0;
+	for (int slot = 0; slot < 7; slot++)
+		t = t * 3 + s->twist[slot];
+	return t;
+}
+
+static void set_twist_coord(cubie_slots_t *s, int t)
+{
+	int sum = 0;
+	for (int slot = 6; slot >= 0; slot--)
+	{
+		s->twist[slot] = t % 3;
+		sum += t % 3;
+		t /= 3;
+	}
+	s->twist[7] = (3 - sum % 3) % 3;
+}
+
+static int flip_coord(const cubie_slots_t *s)
+{
+	int f = 0;
+	for (int slot = 0; slot < 11; slot++)
+		f = f * 2 + s->flip[slot];
+	return f;
+}
+
+static void set_flip_coord(cubie_slots_t *s, int f)
+{
+	int sum = 0;
+	for (int slot = 10; slot >= 0; slot--)
+	{
+		s->flip[slot] = f % 2;
+		sum += f % 2;
+		f /= 2;
+	}
+	s->flip[11] = sum % 2;
+}
+
+static int choose(int n, int k)
+{
+	if (k > n)
+		return 0;
+	int r = 1;
+	for (int i = 0; i < k; i++)
+		r = r * (n - i) / (i + 1);
+	return r;
+}
+
+// which slots hold the middle edges, ranked as a combination
+static int slice_coord(const cubie_slots_t *s)
+{
+	int r = 0, k = 0;
+	for (int slot = 0; slot < 12; slot++)
+		if (s->edge[slot] >= FR)
+			r += choose(slot, ++k);
+	return r;
+}
+
+static void set_slice_coord(cubie_slots_t *s, int r)
+{
+	int middle = BR, other = DB;
+	for (int slot = 11, k = 4; slot >= 0; slot--)
+	{
+		if ((k > 0) && (r >= choose(slot, k)))
+		{
+			r -= choose(slot, k--);
+			s->edge[slot] = middle--;
+		}
+		else
+			s->edge[slot] = other--;
+	}
+}
+
+// rank of an order of n pieces numbered from first, and back
+static int perm_coord(const unsigned char *piece, int n)
+{
+	int r = 0;
+	for (int i = 0; i < n; i++)
+	{
+		int smaller = 0;
+		for (int j = i + 1; j < n; j++)
+			if (piece[j] < piece[i])
+				smaller++;
+		r = r * (n - i) + smaller;
+	}
+	return r;
+}
+
+static void set_perm_coord(unsigned char *piece, int n, int first, int r)
+{
+	int digit[12];
+	for (int i = n - 1; i >= 0; i--)
+	{
+		digit[i] = r % (n - i);
+		r /= n - i;
+	}
+	bool used[12] = { false };
+	for (int i = 0; i < n; i++)
+	{
+		int p = 0;
+		for (int skip = digit[i]; used[p] || (skip-- > 0); p++)
+			;
+		used[p] = true;
+		piece[i] = first + p;
+	}
+}
+
+// Fill a coordinate's move table: set(s, i) makes a cube with coordinate i, coord reads it back. Move m is
+// quarters[m], cost[m] quarter turns long, or with cost NULL the quarter turn m.
+static uint16_t *init_coord_moves(int size, int moves, const unsigned char (*quarters)[2], const unsigned char *cost,
+								  void (*set)(cubie_slots_t *, int), int (*coord)(const cubie_slots_t *))
+{
+	uint16_t *table = malloc(size * moves * sizeof(uint16_t));
+	if (table == NULL)
+	{
+		printf("Unable to allocate coordinate move tables!\n");
+		exit(-1);
+	}
+	for (int i = 0; i < size; i++)
+	{
+		cubie_slots_t s;
+		solved_slots(&s);
+		set(&s, i);
+		for (int m = 0; m < moves; m++)
+		{
+			cubie_slots_t t = s;
+			unsigned char quarter = m;
+			if (cost == NULL)
+				turn_slots(&t, &quarter, 1);
+			else
+				turn_slots(&t, quarters[m], cost[m]);
+			table[i * moves + m] = coord(&t);
+		}
+	}
+	return table;
+}
+
+static void set_corner_perm(cubie_slots_t *s, int r) { set_perm_coord(s->corner, 8, URF, r); }
+static int corner_perm_coord(const cubie_slots_t *s) { return perm_coord(s->corner, 8); }
+static void set_edge_perm(cubie_slots_t *s, int r) { set_perm_coord(s->edge, 8, UR, r); }
+static int edge_perm_coord(const cubie_slots_t *s) { return perm_coord(s->edge, 8); }
+static void set_slice_perm(cubie_slots_t *s, int r) { set_perm_coord(s->edge + 8, 4, FR, r); }
+static int slice_perm_coord(const cubie_slots_t *s) { return perm_coord(s->edge + 8, 4); }
+
+// Fill a pruning table over pairs of coordinates a and b, indexed a * size_b + b, with each pair's distance
+// from goal: a shortest path search outward from the goal, a distance at a time, since phase 2 moves cost 1
+// or 2. Every move has its inverse among the moves, so distances to and from the goal are the same.
+static unsigned char *init_prune_table(int size_a, const uint16_t *move_a, int size_b, const uint16_t *move_b, int moves,
+									   const unsigned char *cost, int goal)
+{
+	int size = size_a * size_b;
+	unsigned char *table = malloc(size);
+	if (table == NULL)
+	{
+		printf("Unable to allocate the two-phase pruning tables!\n");
+		exit(-1);
+	}
+	memset(table, 0xff, size);
+	table[goal] = 0;
+	int deepest = 0;
+	for (int d = 0; d <= deepest; d++)
+	{
+		for (int i = 0; i < size; i++)
+		{
+			if (table[i] != d)
+				continue;
+			int a = i / size_b, b = i % size_b;
+			for (int m = 0; m < moves; m++)
+			{
+				int j = move_a[a * moves + m] * size_b + move_b[b * moves + m];
+				int next = d + ((cost == NULL) ? 1 : cost[m]);
+				if (table[j] > next)
+				{
+					table[j] = next;
+					if (next > deepest)
+						deepest = next;
+				}
+			}
+		}
+	}
+	return table;
+}
+
+void init_two_phase_tables(void)
+{
+	cubie_slots_t s;
+	solved_slots(&s);
+	slice_solved = slice_coord(&s);
+	
+	table_part_t parts[] = {
+		{ (void **)&twist_move, TWISTS * PHASE1_MOVES * sizeof(uint16_t) },
+		{ (void **)&flip_move, FLIPS * PHASE1_MOVES * sizeof(uint16_t) },
+		{ (void **)&slice_move, SLICES * PHASE1_MOVES * sizeof(uint16_t) },
+		{ (void **)&corner_perm_move, PERMS8 * PHASE2_MOVES * sizeof(uint16_t) },
+		{ (void **)&edge_perm_move, PERMS8 * PHASE2_MOVES * sizeof(uint16_t) },
+		{ (void **)&slice_perm_move, PERMS4 * PHASE2_MOVES * sizeof(uint16_t) },
+		{ (void **)&twist_slice_prune, TWISTS * SLICES },
+		{ (void **)&flip_slice_prune, FLIPS * SLICES },
+		{ (void **)&twist_flip_prune, TWISTS * FLIPS },
+		{ (void **)&corner_slice_prune, PERMS8 * PERMS4 },
+		{ (void **)&edge_slice_prune, PERMS8 * PERMS4 }
+	};
+	int num_parts = sizeof(parts) / sizeof(parts[0]);
+	if (map_tables("two-phase", parts, num_parts))
+		return;
+	
+	twist_move = init_coord_moves(TWISTS, PHASE1_MOVES, NULL, NULL, set_twist_coord, twist_coord);
+	flip_move = init_coord_moves(FLIPS, PHASE1_MOVES, NULL, NULL, set_flip_coord, flip_coord);
+	slice_move = init_coord_moves(SLICES, PHASE1_MOVES, NULL, NULL, set_slice_coord, slice_coord);
+	corner_perm_move = init_coord_moves(PERMS8, PHASE2_MOVES, phase2_quarters, phase2_cost, set_corner_perm, corner_perm_coord);
+	edge_perm_move = init_coord_moves(PERMS8, PHASE2_MOVES, phase2_quarters, phase2_cost, set_edge_perm, edge_perm_coord);
+	slice_perm_move = init_coord_moves(PERMS4, PHASE2_MOVES, phase2_quarters, phase2_cost, set_slice_perm, slice_perm_coord);
+	
+	twist_slice_prune = init_prune_table(TWISTS, twist_move, SLICES, slice_move, PHASE1_MOVES, NULL, slice_solved);
+	flip_slice_prune = init_prune_table(FLIPS, flip_move, SLICES, slice_move, PHASE1_MOVES, NULL, slice_solved);
+	twist_flip_prune = init_prune_table(TWISTS, twist_move, FLIPS, flip_move, PHASE1_MOVES, NULL, 0);
+	corner_slice_prune = init_prune_table(PERMS8, corner_perm_move, PERMS4, slice_perm_move, PHASE2_MOVES, phase2_cost, 0);
+	edge_slice_prune = init_prune_table(PERMS8, edge_perm_move, PERMS4, slice_perm_move, PHASE2_MOVES, phase2_cost, 0);
+	save_tables("two-phase", parts, num_parts);
+}
+
+pthread_once_t two_phase_once = PTHREAD_ONCE_INIT;
+
+void init_two_phase(void)
+{
+	pthread_once(&two_phase_once, init_two_phase_tables);
+}
+
+// a search in progress: the quarter turns made so far, and the shortest solution found
+typedef struct {
+	cubie_t start;
+	unsigned char path[MAX_TWO_PHASE_MOVES];
+	int length;
+	int phase1_length;
+	unsigned char best[MAX_TWO_PHASE_MOVES];
+	int best_length; // MAX_TWO_PHASE_MOVES until a solution turns up
+	int best_phase1_length;
+	int target;
+	bool done;
+} two_phase_search_t;
+
+// Whether turn q can follow the path without an obvious waste: undoing the last turn, making three quarter
+// turns of one face, or turning opposite faces (which commute) in anything but one order
+static inline bool quarter_allowed(const two_phase_search_t *s, int q)
+{
+	if (s->length == 0)
+		return true;
+	int last = s->path[s->length - 1];
+	if (q == inverse_move(last))
+		return false;
+	if ((q == last) && (s->length >= 2) && (s->path[s->length - 2] == q))
+		return false;
+	return !((opposite_face[q >> 1] == (last >> 1)) && ((q >> 1) < (last >> 1)));
+}
+
+// Search for phase 2 solutions of at most budget moves from the given coordinates
+static bool phase2_search(two_phase_search_t *s, int corners, int edges, int slice, int budget)
+{
+	int h = corner_slice_prune[corners * PERMS4 + slice];
+	int he = edge_slice_prune[edges * PERMS4 + slice];
+	if (he > h)
+		h = he;
+	if (h > budget)
+		return false;
+	if (h == 0)
+	{
+		memcpy(s->best, s->path, s->length);
+		s->best_length = s->length;
+		s->best_phase1_length = s->phase1_length;
+		return true;
+	}
+	
+	for (int m = 0; m < PHASE2_MOVES; m++)
+	{
+		if ((phase2_cost[m] > budget) || !quarter_allowed(s, phase2_quarters[m][0]))
+			continue;
+		s->path[s->length++] = phase2_quarters[m][0];
+		if ((phase2_cost[m] == 1) || quarter_allowed(s, phase2_quarters[m][1]))
+		{
+			if (phase2_cost[m] == 2)
+				s->path[s->length++] = phase2_quarters[m][1];
+			bool found = phase2_search(s, corner_perm_move[corners * PHASE2_MOVES + m], edge_perm_move[edges * PHASE2_MOVES + m],
+									   slice_perm_move[slice * PHASE2_MOVES + m], budget - phase2_cost[m]);
+			s->length -= phase2_cost[m];
+			if (found)
+				return true;
+		}
+		else
+			s->length--;
+	}
+	return false;
+}
+
+// A phase 1 solution is in s->path: look for the shortest phase 2 to follow it that beats the best so far
+static void start_phase2(two_phase_search_t *s)
+{
+	// a phase 1 ending in a phase 2 move just does phase 2's work; the shorter phase 1 without it covers that
+	if (s->length > 0)
+	{
+		int last = s->path[s->length - 1];
+		if (((last >> 1) == UP) || ((last >> 1) == DOWN))
+			return;
+		if ((s->length >= 2) && (s->path[s->length - 2] == last))
+			return;
+	}
+	
+	cubie_t c = s->start;
+	for (int i = 0; i < s->length; i++)
+		cubie_move(&c, s->path[i]);
+	cubie_slots_t slots;
+	cubie_to_slots(&c, &slots);
+	int corners = corner_perm_coord(&slots);
+	int edges = edge_perm_coord(&slots);
+	int slice = slice_perm_coord(&slots);
+	
+	s->phase1_length = s->length;
+	int limit = s->best_length - s->length - 1;
+	if (limit > PHASE2_DEPTH)
+		limit = PHASE2_DEPTH;
+	// every quarter turn is an odd permutation of the corners, so a phase 2 has the parity of the corners' order
+	int corner_order[8];
+	for (int slot = 0; slot < 8; slot++)
+		corner_order[slot] = slots.corner[slot];
+	for (int budget = permutation_parity(corner_order, 8); budget <= limit; budget += 2)
+	{
+		if (phase2_search(s, corners, edges, slice, budget))
+		{
+			if (s->best_length <= s->target)
+				s->done = true;
+			return;
+		}
+	}
+}
+
+// Search for phase 1 solutions of exactly depth more moves from the given coordinates
+static void phase1_search(two_phase_search_t *s, int twist, int flip, int slice, int depth)
+{
+	if (depth == 0)
+	{
+		if ((twist == 0) && (flip == 0) && (slice == slice_solved))
+			start_phase2(s);
+		return;
+	}
+	int h = twist_slice_prune[twist * SLICES + slice];
+	int hf = flip_slice_prune[flip * SLICES + slice];
+	if (hf > h)
+		h = hf;
+	int htf = twist_flip_prune[twist * FLIPS + flip];
+	if (htf > h)
+		h = htf;
+	if (h > depth)
+		return;
+	
+	for (int q = ROTU; (q <= ROTDI) && !s->done; q++)
+	{
+		if (!quarter_allowed(s, q))
+			continue;
+		s->path[s->length++] = q;
+		phase1_search(s, twist_move[twist * PHASE1_MOVES + q], flip_move[flip * PHASE1_MOVES + q],
+					  slice_move[slice * PHASE1_MOVES + q], depth - 1);
+		s->length--;
+	}
+}
+
+// Apply moves to c, recording them as span if there's a solution to record
+static void apply_engine_moves(cube_t *c, const unsigned char *moves, int n, move_arena_t *arena, move_span_t *span)
+{
+	if (span != NULL)
+	{
+		move_arena_begin_span(arena);
+		c->recording = arena;
+	}
+	for (int i = 0; i < n; i++)
+		abs_rot_indrot(c, moves[i]);
+	if (span != NULL)
+	{
+		c->recording = NULL;
+		move_arena_end_span(arena, span);
+	}
+}
+
+void solve_cube_two_phase(cube_t *c, unsigned int target, move_arena_t *arena, solution_t *solution)
+{
+	two_phase_search_t search;
+	two_phase_search_t *s = &search;
+	if (c->indexed)
+		s->start = c->pieces;
+	else if (!facelets_to_cubie(c->facelet, &s->start))
+	{
+		printf("Two-phase solver was handed an unsolvable cube!\n");
+		exit(-1);
+	}
+	s->length = 0;
+	s->best_length = MAX_TWO_PHASE_MOVES;
+	s->target = target;
+	s->done = false;
+	
+	cubie_slots_t slots;
+	cubie_to_slots(&s->start, &slots);
+	int twist = twist_coord(&slots), flip = flip_coord(&slots), slice = slice_coord(&slots);
+	for (int depth = 0; (depth < s->best_length) && !s->done; depth++)
+		phase1_search(s, twist, flip, slice, depth);
+	if (s->best_length == MAX_TWO_PHASE_MOVES)
+	{
+		printf("Two-phase search found no solution!\n");
+		exit(-1);
+	}
+	
+	if (LOGGING)
+		printf("solve_cube_two_phase: %d + %d moves\n", s->best_phase1_length, s->best_length - s->best_phase1_length);
+	
+	unsigned int before = c->totalMoves;
+	apply_engine_moves(c, s->best, s->best_phase1_length, arena, (solution != NULL) ? &solution->stage[0] : NULL);
+	c->solveGreenCrossMoves = c->totalMoves - before;
+	apply_engine_moves(c, s->best + s->best_phase1_length, s->best_length - s->best_phase1_length, arena,
+						  (solution != NULL) ? &solution->stage[1] : NULL);
+	c->solveGreenCornersMoves = c->totalMoves - before - c->solveGreenCrossMoves;
+	c->solveMiddleEdgesMoves = c->solveBlueCrossMoves = c->alignBlueCornersMoves = 0;
+	for (int stage = 2; (solution != NULL) && (stage < 5); stage++)
+		apply_engine_moves(c, NULL, 0, arena, &solution->stage[stage]);
+}
+
+// Optimal Solver
+// With --engine optimal, cubes are solved in the fewest face turns, a half turn counting as one (it's still
+// written out as two quarter turns). This is IDA* with pattern databases, as in Korf's solver: three
+// databases hold the exact distance from solved of the corners alone and of each half of the edges, six
+// pieces with their flips. The largest of the three never overestimates, so the first solution found within
+// an iteration's bound is optimal. States are coordinates stepped by move tables: the corners' order and
+// twists as in the two-phase engine, and for each half of the edges, the slots its pieces are in (an ordered
+// choice of 6 of the 12) and their flips. How a move changes those depends only on the slots, so one pair
+// of tables serves both halves.
+//
+// Each iteration is split across optimal_threads workers at OPTIMAL_SPLIT_DEPTH: every move sequence that
+// long is a task, the tasks are dealt out evenly, and a worker that runs out steals from the front of
+// another worker's queue while the owner works from the back. The workers are started once a cube's search
+// gets that deep and wait at a barrier between iterations; the calling thread is worker 0.
+#define FACE_TURNS 18 // by face: a quarter turn, its inverse, a half turn
+#define CORNER_STATES (PERMS8 * TWISTS)
+#define EDGE_SLOT_CHOICES 665280 // 12 * 11 * 10 * 9 * 8 * 7
+#define EDGE_HALF_STATES (EDGE_SLOT_CHOICES * 64)
+#define OPTIMAL_SPLIT_DEPTH 3
+#define MAX_OPTIMAL_DEPTH 26 // more than any cube needs
+#define MAX_OPTIMAL_TASKS 4096
+
+const unsigned char face_turn_quarters[FACE_TURNS][2] = {
+	{ ROTU }, { ROTUI }, { ROTU, ROTU }, { ROTB }, { ROTBI }, { ROTB, ROTB }, { ROTL }, { ROTLI }, { ROTL, ROTL },
+	{ ROTF }, { ROTFI }, { ROTF, ROTF }, { ROTR }, { ROTRI }, { ROTR, ROTR }, { ROTD }, { ROTDI }, { ROTD, ROTD }
+};
+const unsigned char face_turn_cost[FACE_TURNS] = { 1, 1, 2, 1, 1, 2, 1, 1, 2, 1, 1, 2, 1, 1, 2, 1, 1, 2 };
+
+int optimal_threads = 1;
+
+uint16_t *face_corner_perm_move = NULL;
+uint16_t *face_twist_move = NULL;
+uint32_t *edge_slots_move = NULL;
+unsigned char *edge_flips_move = NULL; // flips to toggle, by piece of the half
+unsigned char *corner_pdb = NULL; // distances, 4 bits each
+unsigned char *edge_pdb[2] = { NULL, NULL };
+
+// for the report
+atomic_ulong optimal_nodes = 0;
+atomic_ulong optimal_face_turns = 0;
+atomic_ulong optimal_usecs = 0;
+
+typedef struct {
+	uint16_t corner_perm;
+	uint16_t twist;
+	uint32_t edge_slots[2];
+	unsigned char edge_flips[2];
+} optimal_state_t;
+
+static inline int pdb_get(const unsigned char *pdb, uint64_t i)
+{
+	return (pdb[i >> 1] >> ((i & 1) * 4)) & 0x0f;
+}
+
+static inline void pdb_set(unsigned char *pdb, uint64_t i, int distance)
+{
+	pdb[i >> 1] = (pdb[i >> 1] & ~(0x0f << ((i & 1) * 4))) | (distance << ((i & 1) * 4));
+}
+
+// rank of an ordered choice of 6 of the 12 edge slots, and back
+static int edge_slots_coord(const unsigned char *slot)
+{
+	int r = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		int digit = slot[i];
+		for (int j = 0; j < i; j++)
+			if (slot[j] < slot[i])
+				digit--;
+		r = r * (12 - i) + digit;
+	}
+	return r;
+}
+
+static void set_edge_slots_coord(unsigned char *slot, int r)
+{
+	int digit[6];
+	for (int i = 5; i >= 0; i--)
+	{
+		digit[i] = r % (12 - i);
+		r /= 12 - i;
+	}
+	bool used[12] = { false };
+	for (int i = 0; i < 6; i++)
+	{
+		int p = 0;
+		for (int skip = digit[i]; used[p] || (skip-- > 0); p++)
+			;
+		used[p] = true;
+		slot[i] = p;
+	}
+}
+
+// The slots and flips of half of the edges (pieces UR..DF, or DL..BR)
+static void edge_half_coord(const cubie_slots_t *s, int half, uint32_t *slots, unsigned char *flips)
+{
+	unsigned char slot[6];
+	*flips = 0;
+	for (int i = 0; i < 12; i++)
+	{
+		int p = s->edge[i] - half * 6;
+		if ((p >= 0) && (p < 6))
+		{
+			slot[p] = i;
+			*flips |= s->flip[i] << p;
+		}
+	}
+	*slots = edge_slots_coord(slot);
+}
+
+static void optimal_state_of(const cubie_t *c, optimal_state_t *state)
+{
+	cubie_slots_t s;
+	cubie_to_slots(c, &s);
+	state->corner_perm = corner_perm_coord(&s);
+	state->twist = twist_coord(&s);
+	for (int half = 0; half < 2; half++)
+		edge_half_coord(&s, half, &state->edge_slots[half], &state->edge_flips[half]);
+}
+
+static inline void optimal_turn(const optimal_state_t *s, int m, optimal_state_t *next)
+{
+	next->corner_perm = face_corner_perm_move[s->corner_perm * FACE_TURNS + m];
+	next->twist = face_twist_move[s->twist * FACE_TURNS + m];
+	for (int half = 0; half < 2; half++)
+	{
+		next->edge_slots[half] = edge_slots_move[s->edge_slots[half] * FACE_TURNS + m];
+		next->edge_flips[half] = s->edge_flips[half] ^ edge_flips_move[s->edge_slots[half] * FACE_TURNS + m];
+	}
+}
+
+// Lower bound on the face turns left to solve s; 0 only when it's solved
+static inline int optimal_bound(const optimal_state_t *s)
+{
+	int h = pdb_get(corner_pdb, (uint64_t)s->corner_perm * TWISTS + s->twist);
+	for (int half = 0; half < 2; half++)
+	{
+		int he = pdb_get(edge_pdb[half], (uint64_t)s->edge_slots[half] * 64 + s->edge_flips[half]);
+		if (he > h)
+			h = he;
+	}
+	return h;
+}
+
+// Whether a turn of face can follow one of last_face (-1 for none): never the same face twice, and opposite
+// faces, which commute, in one order only
+static inline bool face_turn_allowed(int face, int last_face)
+{
+	return (last_face < 0) || ((face != last_face) && !((opposite_face[face] == last_face) && (face < last_face)));
+}
+
+// the states next to state i of a pattern database
+static uint64_t corner_neighbor(uint64_t i, int m)
+{
+	return (uint64_t)face_corner_perm_move[(i / TWISTS) * FACE_TURNS + m] * TWISTS + face_twist_move[(i % TWISTS) * FACE_TURNS + m];
+}
+
+static uint64_t edge_neighbor(uint64_t i, int m)
+{
+	uint64_t slots = i / 64;
+	return (uint64_t)edge_slots_move[slots * FACE_TURNS + m] * 64 + ((i % 64) ^ edge_flips_move[slots * FACE_TURNS + m]);
+}
+
+// Fill a pattern database by breadth first search from goal. Early on, states at the current distance step
+// out to their unvisited neighbors; once they outnumber the states still unvisited, each unvisited state
+// looks for a neighbor at the current distance instead, which is far less work at the end.
+static unsigned char *init_pdb(uint64_t size, uint64_t goal, uint64_t (*neighbor)(uint64_t, int))
+{
+	unsigned char *pdb = malloc(size / 2 + 1);
+	if (pdb == NULL)
+	{
+		printf("Unable to allocate the pattern databases!\n");
+		exit(-1);
+	}
+	memset(pdb, 0xff, size / 2 + 1);
+	pdb_set(pdb, goal, 0);
+	uint64_t visited = 1, frontier = 1;
+	for (int d = 0; (frontier > 0) && (visited < size); d++)
+	{
+		if (d + 1 >= 0x0f)
+		{
+			printf("Pattern database is deeper than it can hold!\n");
+			exit(-1);
+		}
+		uint64_t reached = 0;
+		if (frontier < size - visited)
+		{
+			for (uint64_t i = 0; i < size; i++)
+			{
+				if (pdb_get(pdb, i) != d)
+					continue;
+				for (int m = 0; m < FACE_TURNS; m++)
+				{
+					uint64_t j = neighbor(i, m);
+					if (pdb_get(pdb, j) == 0x0f)
+					{
+						pdb_set(pdb, j, d + 1);
+						reached++;
+					}
+				}
+			}
+		}
+		else
+		{
+			for (uint64_t i = 0; i < size; i++)
+			{
+				if (pdb_get(pdb, i) != 0x0f)
+					continue;
+				for (int m = 0; m < FACE_TURNS; m++)
+				{
+					if (pdb_get(pdb, neighbor(i, m)) == d)
+					{
+						pdb_set(pdb, i, d + 1);
+						reached++;
+						break;
+					}
+				}
+			}
+		}
+		visited += reached;
+		frontier = reached;
+	}
+	return pdb;
+}
+
+void init_optimal_tables(void)
+{
+	table_part_t parts[] = {
+		{ (void **)&face_corner_perm_move, PERMS8 * FACE_TURNS * sizeof(uint16_t) },
+		{ (void **)&face_twist_move, TWISTS * FACE_TURNS * sizeof(uint16_t) },
+		{ (void **)&edge_slots_move, (size_t)EDGE_SLOT_CHOICES * FACE_TURNS * sizeof(uint32_t) },
+		{ (void **)&edge_flips_move, (size_t)EDGE_SLOT_CHOICES * FACE_TURNS },
+		{ (void **)&corner_pdb, CORNER_STATES / 2 + 1 },
+		{ (void **)&edge_pdb[0], EDGE_HALF_STATES / 2 + 1 },
+		{ (void **)&edge_pdb[1], EDGE_HALF_STATES / 2 + 1 }
+	};
+	int num_parts = sizeof(parts) / sizeof(parts[0]);
+	if (map_tables("optimal", parts, num_parts))
+		return;
+	
+	face_corner_perm_move = init_coord_moves(PERMS8, FACE_TURNS, face_turn_quarters, face_turn_cost, set_corner_perm, corner_perm_coord);
+	face_twist_move = init_coord_moves(TWISTS, FACE_TURNS, face_turn_quarters, face_turn_cost, set_twist_coord, twist_coord);
+	
+	// the slot tables follow the first half's pieces, the others filling in the slots they leave
+	edge_slots_move = malloc((size_t)EDGE_SLOT_CHOICES * FACE_TURNS * sizeof(uint32_t));
+	edge_flips_move = malloc((size_t)EDGE_SLOT_CHOICES * FACE_TURNS);
+	if ((edge_slots_move == NULL) || (edge_flips_move == NULL))
+	{
+		printf("Unable to allocate the optimal solver's move tables!\n");
+		exit(-1);
+	}
+	for (int r = 0; r < EDGE_SLOT_CHOICES; r++)
+	{
+		cubie_slots_t s;
+		unsigned char slot[6];
+		bool taken[12] = { false };
+		solved_slots(&s);
+		set_edge_slots_coord(slot, r);
+		for (int p = 0; p < 6; p++)
+		{
+			s.edge[slot[p]] = p;
+			taken[slot[p]] = true;
+		}
+		for (int i = 0, p = 6; i < 12; i++)
+			if (!taken[i])
+				s.edge[i] = p++;
+		for (int m = 0; m < FACE_TURNS; m++)
+		{
+			cubie_slots_t t = s;
+			turn_slots(&t, face_turn_quarters[m], face_turn_cost[m]);
+			edge_half_coord(&t, 0, &edge_slots_move[r * FACE_TURNS + m], &edge_flips_move[r * FACE_TURNS + m]);
+		}
+	}
+	
+	optimal_state_t solved;
+	optimal_state_of(&solved_cubie, &solved);
+	corner_pdb = init_pdb(CORNER_STATES, (uint64_t)solved.corner_perm * TWISTS + solved.twist, corner_neighbor);
+	for (int half = 0; half < 2; half++)
+		edge_pdb[half] = init_pdb(EDGE_HALF_STATES, (uint64_t)solved.edge_slots[half] * 64 + solved.edge_flips[half], edge_neighbor);
+	save_tables("optimal", parts, num_parts);
+}
+
+pthread_once_t optimal_once = PTHREAD_ONCE_INIT;
+
+void init_optimal(void)
+{
+	pthread_once(&optimal_once, init_optimal_tables);
+}
+
+// a worker's end of the tasks: the owner takes from the back, thieves from the front
+typedef struct {
+	pthread_mutex_t lock;
+	int front;
+	int back;
+} task_queue_t;
+
+typedef struct {
+	optimal_state_t start;
+	int bound; // of the current iteration, or -1 once the workers are to stop
+	int num_tasks;
+	unsigned char task[MAX_OPTIMAL_TASKS][OPTIMAL_SPLIT_DEPTH];
+	int num_workers;
+	task_queue_t *queue;
+	pthread_barrier_t iteration; // the workers wait here before and after each iteration
+	atomic_bool found;
+	pthread_mutex_t lock; // guards the solution
+	unsigned char solution[MAX_OPTIMAL_DEPTH];
+	int length;
+} optimal_search_t;
+
+typedef struct {
+	pthread_t thread;
+	optimal_search_t *search;
+	int id;
+	unsigned long nodes;
+	unsigned char path[MAX_OPTIMAL_DEPTH];
+} optimal_worker_t;
+
+// Depth first search below state, depth turns into the path, for solutions within remaining more turns
+static bool optimal_dfs(optimal_worker_t *w, const optimal_state_t *state, int depth, int remaining, int last_face)
+{
+	w->nodes++;
+	int h = optimal_bound(state);
+	if (h > remaining)
+		return false;
+	optimal_search_t *s = w->search;
+	if (h == 0)
+	{
+		pthread_mutex_lock(&s->lock);
+		if (!atomic_load(&s->found))
+		{
+			memcpy(s->solution, w->path, depth);
+			s->length = depth;
+			atomic_store(&s->found, true);
+		}
+		pthread_mutex_unlock(&s->lock);
+		return true;
+	}
+	if (atomic_load_explicit(&s->found, memory_order_relaxed))
+		return true;
+	
+	for (int m = 0; m < FACE_TURNS; m++)
+	{
+		if (!face_turn_allowed(m / 3, last_face))
+			continue;
+		optimal_state_t next;
+		optimal_turn(state, m, &next);
+		w->path[depth] = m;
+		if (optimal_dfs(w, &next, depth + 1, remaining - 1, m / 3))
+			return true;
+	}
+	return false;
+}
+
+static bool take_task(optimal_search_t *s, int id, int *task)
+{
+	for (int k = 0; k < s->num_workers; k++)
+	{
+		task_queue_t *q = &s->queue[(id + k) % s->num_workers];
+		pthread_mutex_lock(&q->lock);
+		bool any = (q->front < q->back);
+		if (any)
+			*task = (k == 0) ? --q->back : q->front++;
+		pthread_mutex_unlock(&q->lock);
+		if (any)
+			return true;
+	}
+	return false;
+}
+
+// Work through the tasks of the current iteration, the worker's own and then any it can steal
+static void optimal_iteration(optimal_worker_t *w)
+{
+	optimal_search_t *s = w->search;
+	int t;
+	while (!atomic_load_explicit(&s->found, memory_order_relaxed) && take_task(s, w->id, &t))
+	{
+		optimal_state_t state = s->start;
+		for (int i = 0; i < OPTIMAL_SPLIT_DEPTH; i++)
+		{
+			optimal_state_t next;
+			optimal_turn(&state, s->task[t][i], &next);
+			state = next;
+			w->path[i] = s->task[t][i];
+		}
+		optimal_dfs(w, &state, OPTIMAL_SPLIT_DEPTH, s->bound - OPTIMAL_SPLIT_DEPTH, s->task[t][OPTIMAL_SPLIT_DEPTH - 1] / 3);
+	}
+}
+
+static void *optimal_worker(void *arg)
+{
+	optimal_worker_t *w = (optimal_worker_t *)arg;
+	optimal_search_t *s = w->search;
+	for (;;)
+	{
+		pthread_barrier_wait(&s->iteration);
+		if (s->bound < 0)
+			return NULL;
+		optimal_iteration(w);
+		pthread_barrier_wait(&s->iteration);
+	}
+}
+
+// List every move sequence OPTIMAL_SPLIT_DEPTH long that the search would make
+static void list_tasks(optimal_search_t *s, unsigned char *prefix, int depth, int last_face)
+{
+	if (depth == OPTIMAL_SPLIT_DEPTH)
+	{
+		memcpy(s->task[s->num_tasks++], prefix, OPTIMAL_SPLIT_DEPTH);
+		return;
+	}
+	for (int m = 0; m < FACE_TURNS; m++)
+	{
+		if (!face_turn_allowed(m / 3, last_face))
+			continue;
+		prefix[depth] = m;
+		list_tasks(s, prefix, depth + 1, m / 3);
+	}
+}
+
+// Find an optimal solution of s->start, in face turns, into s->solution
+static void optimal_search(optimal_search_t *s, unsigned long *nodes)
+{
+	optimal_worker_t *workers = calloc(s->num_workers, sizeof(optimal_worker_t));
+	if (workers == NULL)
+	{
+		printf("Unable to allocate optimal search workers!\n");
+		exit(-1);
+	}
+	for (int i = 0; i < s->num_workers; i++)
+	{
+		workers[i].search = s;
+		workers[i].id = i;
+	}
+	
+	// short solutions in one thread; splitting wouldn't pay
+	int bound = optimal_bound(&s->start);
+	for (; (bound <= OPTIMAL_SPLIT_DEPTH) && !atomic_load(&s->found); bound++)
+		optimal_dfs(&workers[0], &s->start, 0, bound, -1);
+	
+	bool started = false;
+	for (; !atomic_load(&s->found); bound++)
+	{
+		if (bound > MAX_OPTIMAL_DEPTH)
+		{
+			printf("Optimal search found no solution!\n");
+			exit(-1);
+		}
+		if (!started)
+		{
+			pthread_barrier_init(&s->iteration, NULL, s->num_workers);
+			for (int i = 1; i < s->num_workers; i++)
+				if (pthread_create(&workers[i].thread, NULL, optimal_worker, &workers[i]) != 0)
+				{
+					printf("Unable to start optimal search worker!\n");
+					exit(-1);
+				}
+			started = true;
+		}
+		s->bound = bound;
+		for (int i = 0; i < s->num_workers; i++)
+		{
+			s->queue[i].front = (int)((long)s->num_tasks * i / s->num_workers);
+			s->queue[i].back = (int)((long)s->num_tasks * (i + 1) / s->num_workers);
+		}
+		pthread_barrier_wait(&s->iteration);
+		optimal_iteration(&workers[0]);
+		pthread_barrier_wait(&s->iteration);
+	}
+	if (started)
+	{
+		s->bound = -1;
+		pthread_barrier_wait(&s->iteration);
+		for (int i = 1; i < s->num_workers; i++)
+			pthread_join(workers[i].thread, NULL);
+		pthread_barrier_destroy(&s->iteration);
+	}
+	
+	*nodes = 0;
+	for (int i = 0; i < s->num_workers; i++)
+		*nodes += workers[i].nodes;
+	free(workers);
+}
+
+void solve_cube_optimal(cube_t *c, int threads, move_arena_t *arena, solution_t *solution)
+{
+	cubie_t start;
+	if (c->indexed)
+		start = c->pieces;
+	else if (!facelets_to_cubie(c->facelet, &start))
+	{
+		printf("Optimal solver was handed an unsolvable cube!\n");
+		exit(-1);
+	}
+	
+	optimal_search_t *s = malloc(sizeof(optimal_search_t));
+	if (s != NULL)
+		s->queue = calloc(threads, sizeof(task_queue_t));
+	if ((s == NULL) || (s->queue == NULL))
+	{
+		printf("Unable to allocate an optimal search!\n");
+		exit(-1);
+	}
+	optimal_state_of(&start, &s->start);
+	s->num_workers = threads;
+	for (int i = 0; i < threads; i++)
+		pthread_mutex_init(&s->queue[i].lock, NULL);
+	pthread_mutex_init(&s->lock, NULL);
+	atomic_init(&s->found, false);
+	s->length = 0;
+	s->num_tasks = 0;
+	unsigned char prefix[OPTIMAL_SPLIT_DEPTH];
+	list_tasks(s, prefix, 0, -1);
+	
+	struct timeval start_time, end_time;
+	unsigned long nodes;
+	gettimeofday(&start_time, NULL);
+	optimal_search(s, &nodes);
+	gettimeofday(&end_time, NULL);
+	atomic_fetch_add(&optimal_nodes, nodes);
+	atomic_fetch_add(&optimal_face_turns, s->length);
+	atomic_fetch_add(&optimal_usecs, (end_time.tv_sec - start_time.tv_sec) * 1000000L + (end_time.tv_usec - start_time.tv_usec));
+	
+	if (LOGGING)
+		printf("solve_cube_optimal: %d face turns, %lu nodes\n", s->length, nodes);
+	
+	unsigned char moves[MAX_OPTIMAL_DEPTH * 2];
+	int n = 0;
+	for (int i = 0; i < s->length; i++)
+		for (int q = 0; q < face_turn_cost[s->solution[i]]; q++)
+			moves[n++] = face_turn_quarters[s->solution[i]][q];
+	unsigned int before = c->totalMoves;
+	apply_engine_moves(c, moves, n, arena, (solution != NULL) ? &solution->stage[0] : NULL);
+	c->solveGreenCrossMoves = c->totalMoves - before;
+	c->solveGreenCornersMoves = c->solveMiddleEdgesMoves = c->solveBlueCrossMoves = c->alignBlueCornersMoves = 0;
+	for (int stage = 1; (solution != NULL) && (stage < 5); stage++)
+		apply_engine_moves(c, NULL, 0, arena, &solution->stage[stage]);
+	
+	for (int i = 0; i < threads; i++)
+		pthread_mutex_destroy(&s->queue[i].lock);
+	pthread_mutex_destroy(&s->lock);
+	free(s->queue);
+	free(s);
+}
+
+// Short Scramble Fast Path
+// With --fast-path N, each cube is first looked for in the short sequence table from both ends: every
+// sequence of up to N - short_table_depth turns from the cube is tried (none but the empty one if a long
+// --window built the table deeper than that), and where one lands on a position in the table, the table's way
+// back to solved finishes it. Forward depths are tried shortest first, and the first depth with a meeting
+// within N moves holds an optimal solution in quarter turns, so any cube within N moves gets one. Cubes
+// further out go on to the engine as usual.
+#define MAX_FAST_PATH (2 * MAX_WINDOW_DEPTH)
+
+int fast_path_depth = 0; // zero if the fast path is off
+atomic_ulong fast_path_cubes = 0; // for the report
+
+typedef struct {
+	unsigned char path[MAX_FAST_PATH];
+	int best; // shortest total length found, or fast_path_depth + 1
+	unsigned char best_path[MAX_FAST_PATH];
+	int best_forward;
+	cubie_t meeting; // where the best one meets the table
+	int meeting_distance;
+} fast_path_search_t;
+
+static void fast_path_meet(fast_path_search_t *s, const cubie_t *c, uint64_t hash, int depth)
+{
+	int distance = short_table_lookup(c, hash);
+	if ((distance >= 0) && (depth + distance < s->best))
+	{
+		s->best = depth + distance;
+		memcpy(s->best_path, s->path, depth);
+		s->best_forward = depth;
+		s->meeting = *c;
+		s->meeting_distance = distance;
+	}
+}
+
+// Try every sequence of exactly forward turns from c, depth of them made so far
+static void fast_path_search(fast_path_search_t *s, const cubie_t *c, int depth, int forward)
+{
+	if (depth == forward)
+	{
+		fast_path_meet(s, c, cubie_hash(c), depth);
+		return;
+	}
+	
+	// the table is far bigger than the cache, so the last turn's positions are all prefetched before any is
+	// looked up
+	cubie_t next[12];
+	uint64_t hash[12];
+	unsigned char turn[12];
+	int n = 0;
+	for (int q = ROTU; q <= ROTDI; q++)
+	{
+		// skip undoing the last turn, a third quarter turn of one face, and opposite faces out of order
+		if (depth > 0)
+		{
+			int last = s->path[depth - 1];
+			if ((q == inverse_move(last)) || ((q == last) && (depth >= 2) && (s->path[depth - 2] == q)) ||
+				((opposite_face[q >> 1] == (last >> 1)) && ((q >> 1) < (last >> 1))))
+				continue;
+		}
+		next[n] = *c;
+		cubie_move(&next[n], q);
+		turn[n] = q;
+		if (depth + 1 == forward)
+		{
+			hash[n] = cubie_hash(&next[n]);
+			__builtin_prefetch(&short_table[hash[n] & short_table_mask]);
+		}
+		n++;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		s->path[depth] = turn[i];
+		if (depth + 1 == forward)
+			fast_path_meet(s, &next[i], hash[i], depth + 1);
+		else
+			fast_path_search(s, &next[i], depth + 1, forward);
+	}
+}
+
+// Solve c optimally if it's within fast_path_depth quarter turns, crediting and recording the moves as the
+// first stage; returns false, leaving c alone, if it's further out
+bool solve_fast_path(cube_t *c, move_arena_t *arena, solution_t *solution)
+{
+	fast_path_search_t s;
+	cubie_t start;
+	if (c->indexed)
+		start = c->pieces;
+	else if (!facelets_to_cubie(c->facelet, &start))
+		return false;
+	
+	// only meetings within fast_path_depth count, as the table may reach further on its own
+	int max_forward = (fast_path_depth > short_table_depth) ? fast_path_depth - short_table_depth : 0;
+	s.best = fast_path_depth + 1;
+	for (int forward = 0; (forward <= max_forward) && (s.best > fast_path_depth); forward++)
+		fast_path_search(&s, &start, 0, forward);
+	if (s.best > fast_path_depth)
+		return false;
+	
+	// the table gives the way out from solved to the meeting; back is its inverse, last move first
+	unsigned char moves[MAX_FAST_PATH], out[MAX_WINDOW_DEPTH];
+	memcpy(moves, s.best_path, s.best_forward);
+	short_table_sequence(s.meeting, s.meeting_distance, out);
+	for (int i = 0; i < s.meeting_distance; i++)
+		moves[s.best_forward + i] = inverse_move(out[s.meeting_distance - 1 - i]);
+	
+	if (LOGGING)
+		printf("solve_fast_path: %d moves\n", s.best);
+	
+	unsigned int before = c->totalMoves;
+	apply_engine_moves(c, moves, s.best, arena, (solution != NULL) ? &solution->stage[0] : NULL);
+	c->solveGreenCrossMoves = c->totalMoves - before;
+	c->solveGreenCornersMoves = c->solveMiddleEdgesMoves = c->solveBlueCrossMoves = c->alignBlueCornersMoves = 0;
+	for (int stage = 1; (solution != NULL) && (stage < 5); stage++)
+		apply_engine_moves(c, NULL, 0, arena, &solution->stage[stage]);
+	atomic_fetch_add(&fast_path_cubes, 1);
+	return true;
+}
+
+// Random Numbers
+// Scrambles draw from xoshiro256**, a small, fast generator whose state lives with whoever is using it, so
+// threads never contend for it. Every cube gets a generator of its own, seeded from the run's seed and the
+// cube's number in the batch: cube i gets the same scramble however the batch is split over threads, chunks
+// or lockstep blocks, and a run repeats exactly given the same --seed.
+typedef struct {
+	uint64_t s[4];
+} rng_t;
+
+uint64_t scramble_seed = 0; // --seed, or from the clock
+long cube_base = 0; // number in the batch of cube[0], the first cube of the current chunk
+
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+// splitmix64's finalizer: a bijection that spreads every input bit over the output
+static inline uint64_t mix64(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// Seed a generator for one stream of seed, e.g. one cube of the batch
+void rng_seed(rng_t *rng, uint64_t seed, uint64_t stream)
+{
+	uint64_t x = seed ^ mix64(stream);
+	for (int i = 0; i < 4; i++)
+	{
+		x += 0x9e3779b97f4a7c15ULL;
+		rng->s[i] = mix64(x);
+	}
+}
+
+static inline uint64_t rng_next(rng_t *rng)
+{
+	uint64_t *s = rng->s;
+	uint64_t result = rotl64(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl64(s[3], 45);
+	return result;
+}
+
+// A number from 0 to n - 1, by scaling the top 32 bits rather than a divide
+static inline unsigned int rng_below(rng_t *rng, unsigned int n)
+{
+	return (unsigned int)(((rng_next(rng) >> 32) * n) >> 32);
+}
+
+// Initialize a cube
+void init_cube(cube_t *c)
+{
+	// clear the faces
+	for (int i = 0; i < 6; i++)
+		for (int j = 0; j < 3; j++)
+			for (int k = 0; k < 3; k++)
+				c->face[i].tile[j][k] = i;	
+	c->recording = NULL;
+	c->indexed = false;
+}
+
+// Scramble
+void scramble_cube(cube_t *c, rng_t *rng)
+{
+	if (LOGGING)
+		printf("scramble_cube:\n");
+	
+	// 40 random moves
+	for (int i = 0; i < 40; i++)
+		abs_rot_indrot(c, rng_below(rng, 12));
+	
+	// set up move counters
+	c->totalMoves = 0;
+	c->solveGreenCrossMoves = 0;
+	c->solveGreenCornersMoves = 0;
+	c->solveMiddleEdgesMoves = 0;
+	c->solveBlueCrossMoves = 0;
+	c->alignBlueCornersMoves = 0;
+}
+
+// Uniform Scrambles
+// 40 random turns don't reach every state equally often, and pay for 40 trips through abs_rot_indrot. With
+// --uniform, scrambles instead draw the pieces directly: a random arrangement of the corners and of the edges,
+// fixed up to have the same parity, and random twists and flips with the last corner and edge making them
+// cancel out. Every state of the cube is then equally likely, and the facelets are written out in one go.
+bool uniform_scrambles = false;
+
+// Shuffle the pieces of an n piece permutation
+static void rng_shuffle(rng_t *rng, int *slot, int n)
+{
+	for (int i = 0; i < n; i++)
+		slot[i] = i;
+	for (int i = n - 1; i > 0; i--)
+	{
+		int j = rng_below(rng, i + 1);
+		int t = slot[i];
+		slot[i] = slot[j];
+		slot[j] = t;
+	}
+}
+
+// Draw a uniformly random, solvable cubie state
+void random_cubie(cubie_t *c, rng_t *rng)
+{
+	int corner_slot[8];
+	int edge_slot[12];
+	rng_shuffle(rng, corner_slot, 8);
+	rng_shuffle(rng, edge_slot, 12);
+	if (permutation_parity(corner_slot, 8) != permutation_parity(edge_slot, 12))
+	{
+		int t = edge_slot[0];
+		edge_slot[0] = edge_slot[1];
+		edge_slot[1] = t;
+	}
+	
+	int twist = 0;
+	for (int p = URF; p <= DRB; p++)
+	{
+		int t = (p < DRB) ? (int)rng_below(rng, 3) : (3 - twist % 3) % 3;
+		twist += t;
+		cubie_set_corner(c, p, corner_slot[p] * 3 + t);
+	}
+	int flip = 0;
+	for (int p = UR; p <= BR; p++)
+	{
+		int f = (p < BR) ? (int)rng_below(rng, 2) : flip & 1;
+		flip += f;
+		cubie_set_edge(c, p, edge_slot[p] * 2 + f);
+	}
+}
+
+void uniform_scramble_cube(cube_t *c, rng_t *rng)
+{
+	if (LOGGING)
+		printf("uniform_scramble_cube:\n");
+	
+	cubie_t state = { 0, 0 };
+	random_cubie(&state, rng);
+	cubie_to_facelets(&state, c->facelet);
+	
+	// set up move counters
+	c->totalMoves = 0;
+	c->solveGreenCrossMoves = 0;
+	c->solveGreenCornersMoves = 0;
+	c->solveMiddleEdgesMoves = 0;
+	c->solveBlueCrossMoves = 0;
+	c->alignBlueCornersMoves = 0;
+}
+
+// Display a cube
+void show_cube(int index)
+{
+	printf("Cube %03d --------------------\n", index);
+	
+	// show UP
+	for (int row = 0; row < 3; row++)
+	{
+		printf("                ");
+		for (int j = 0; j < 3; j++)
+			printf("%c ", colors[cube[index].face[UP].tile[row][j]]);
+		printf("\n");
+	}
+	printf("                | | |\n");
+	
+	// show back, left, front, right
+	for (int row = 0; row < 3; row++)
+	{
+		for (int i = BACK; i <= RIGHT; i++)
+		{
+			for (int j = 0; j < 3; j++)
+				printf("%c ", colors[cube[index].face[i].tile[row][j]]);
+			if (i != RIGHT) // suppress dash at end
+				printf("- ");
+		}
+		printf("\n");
+	}
+
+	// show DOWN
+	printf("                | | |\n");
+	for (int row = 0; row < 3; row++)
+	{
+		printf("                ");
+		for (int j = 0; j < 3; j++)
+			printf("%c ", colors[cube[index].face[DOWN].tile[row][j]]);
+		printf("\n");
+	}
+}
+
+// Log a freshly solved cube, with its solution if we're recording them
+void show_solved_cube(int index)
+{
+	printf("*** Solved Cube in %d moves.\n", cube[index].totalMoves);
+	if (record_solutions)
+	{
+		printf("*** Solution: ");
+		write_solution(stdout, &solutions[index]);
+	}
+	show_cube(index);
+}
+
+// Lockstep Mode
+// For batch work, cubes are transposed into structure-of-arrays blocks: row i of a block holds facelet i of
+// SOA_WIDTH cubes side by side. Turning a face on every cube of a block is then 20 dense 64-byte row copies
+// (or masked blends, when only some of the cubes take the move), which the compiler turns into vector loads
+// and stores, instead of SOA_WIDTH trips through abs_rot_indrot.
+#define SOA_WIDTH 64
+
+typedef struct {
+	_Alignas(64) unsigned char row[NUM_FACELETS][SOA_WIDTH];
+	unsigned int moves[SOA_WIDTH]; // per cube move counters
+	int count; // cubes in use; the rest of the lanes are ignored
+} soa_block_t;
+
+bool lockstep = false;
+
+// lane_bytes[b] expands the 8 lane bits of b into 8 bytes of 0x00/0xff
+uint64_t lane_bytes[256];
+
+void init_lane_bytes(void)
+{
+	for (int b = 0; b < 256; b++)
+	{
+		lane_bytes[b] = 0;
+		for (int j = 0; j < 8; j++)
+			if ((b >> j) & 1)
+				lane_bytes[b] |= 0xffULL << (j * 8);
+	}
+}
+
+// Fill a block with count solved cubes
+void soa_init_solved(soa_block_t *block, int count)
+{
+	for (int i = 0; i < NUM_FACELETS; i++)
+		memset(block->row[i], i / 9, SOA_WIDTH);
+	memset(block->moves, 0, sizeof(block->moves));
+	block->count = count;
+}
+
+// Transpose count cubes starting at cube[first] into a block
+void soa_load(soa_block_t *block, int first, int count)
+{
+	for (int j = 0; j < count; j++)
+	{
+		for (int i = 0; i < NUM_FACELETS; i++)
+			block->row[i][j] = cube[first + j].facelet[i];
+		block->moves[j] = cube[first + j].totalMoves;
+	}
+	block->count = count;
+}
+
+// Transpose a block back out to cube[first], along with its move counters
+void soa_store(const soa_block_t *block, int first)
+{
+	for (int j = 0; j < block->count; j++)
+	{
+		for (int i = 0; i < NUM_FACELETS; i++)
+			cube[first + j].facelet[i] = block->row[i][j];
+		cube[first + j].totalMoves = block->moves[j];
+	}
+}
+
+// Apply a permutation worth num_moves moves to the cubes of a block whose bit is set in lanes. The row loops
+// are plain C for the compiler to vectorize; target_clones builds them for each vector width and picks one at
+// load time via CPUID.
+#if HAVE_X86_KERNELS
+__attribute__((target_clones("avx2", "default")))
+#endif
+static void soa_apply_perm_masked(soa_block_t *block, int perm, unsigned int num_moves, uint64_t lanes)
+{
+	_Alignas(64) unsigned char save[NUM_FACELETS][SOA_WIDTH];
+	_Alignas(64) unsigned char take[SOA_WIDTH];
+	const unsigned char *dst = move_dst[perm];
+	const unsigned char *src = move_src[perm];
+	int moved = move_moved[perm];
+	
+	for (int i = 0; i < moved; i++)
+		memcpy(save[i], block->row[src[i]], SOA_WIDTH);
+	
+	if (lanes == ~0ULL)
+	{
+		for (int i = 0; i < moved; i++)
+			memcpy(block->row[dst[i]], save[i], SOA_WIDTH);
+		for (int j = 0; j < SOA_WIDTH; j++)
+			block->moves[j] += num_moves;
+	}
+	else
+	{
+		for (int j = 0; j < SOA_WIDTH / 8; j++)
+		{
+			uint64_t bytes = lane_bytes[(lanes >> (j * 8)) & 0xff];
+			memcpy(&take[j * 8], &bytes, 8);
+		}
+		for (int i = 0; i < moved; i++)
+		{
+			unsigned char *row = block->row[dst[i]];
+			for (int j = 0; j < SOA_WIDTH; j++)
+				row[j] = (row[j] & ~take[j]) | (save[i][j] & take[j]);
+		}
+		for (int j = 0; j < SOA_WIDTH; j++)
+			block->moves[j] += take[j] & num_moves;
+	}
+}
+
+// Apply one move to the cubes of a block whose bit is set in lanes
+void soa_apply_move_masked(soa_block_t *block, int rottype, uint64_t lanes)
+{
+	soa_apply_perm_masked(block, rottype, 1, lanes);
+}
+
+// Apply one move to every cube of a block
+void soa_apply_move(soa_block_t *block, int rottype)
+{
+	soa_apply_move_masked(block, rottype, ~0ULL);
+}
+
+// Replay a move sequence on the cubes of a block whose bit is set in lanes
+void soa_apply_sequence(soa_block_t *block, const unsigned char *moves, int num_moves, uint64_t lanes)
+{
+	for (int i = 0; i < num_moves; i++)
+		soa_apply_move_masked(block, moves[i], lanes);
+}
+
+// Give every cube of a block its own 40 random moves, the same ones scramble_cube would, numbering the block's
+// cubes from number. Each step draws a move per cube and then applies each of the 12 moves to the lanes that
+// drew it.
+void soa_scramble(soa_block_t *block, long number)
+{
+	rng_t rng[SOA_WIDTH];
+	for (int j = 0; j < block->count; j++)
+		rng_seed(&rng[j], scramble_seed, number + j);
+	
+	for (int step = 0; step < 40; step++)
+	{
+		uint64_t lanes[12] = { 0 };
+		for (int j = 0; j < block->count; j++)
+			lanes[rng_below(&rng[j], 12)] |= 1ULL << j;
+		for (int m = ROTU; m <= ROTDI; m++)
+			if (lanes[m] != 0)
+				soa_apply_move_masked(block, m, lanes[m]);
+	}
+	
+	// scrambling moves don't count
+	memset(block->moves, 0, sizeof(block->moves));
+}
+
+// Initialize and scramble count cubes starting at cube[first], uniformly or in lockstep blocks if enabled
+void scramble_cubes(int first, int count)
+{
+	if (uniform_scrambles)
+	{
+		for (int i = first; i < first + count; i++)
+		{
+			rng_t rng;
+			rng_seed(&rng, scramble_seed, cube_base + i);
+			init_cube(&cube[i]);
+			uniform_scramble_cube(&cube[i], &rng);
+		}
+	}
+	else if (lockstep)
+	{
+		soa_block_t block;
+		for (int i = first; i < first + count; i += SOA_WIDTH)
+		{
+			int n = (first + count - i < SOA_WIDTH) ? first + count - i : SOA_WIDTH;
+			soa_init_solved(&block, n);
+			soa_scramble(&block, cube_base + i);
+			soa_store(&block, i);
+			for (int j = i; j < i + n; j++)
+			{
+				cube[j].solveGreenCrossMoves = 0;
+				cube[j].solveGreenCornersMoves = 0;
+				cube[j].solveMiddleEdgesMoves = 0;
+				cube[j].solveBlueCrossMoves = 0;
+				cube[j].alignBlueCornersMoves = 0;
+			}
+		}
+	}
+	else
+	{
+		for (int i = first; i < first + count; i++)
+		{
+			rng_t rng;
+			rng_seed(&rng, scramble_seed, cube_base + i);
+			init_cube(&cube[i]);
+			scramble_cube(&cube[i], &rng);
+		}
+	}
+	
+	if (LOGGING)
+	{
+		for (int i = first; i < first + count; i++)
+		{
+			printf("*** Scrambled Cube\n");
+			show_cube(i);
+		}
+	}
+}
+
+// Batched Mode
+// Instead of running each stage's switch statements cube by cube, a block of cubes in lockstep runs a stage
+// in rounds. Every round, each cube still working on the stage is classified, which picks the next sequence
+// it needs; cubes are bucketed by sequence and each bucket is turned together with masked lockstep moves.
+// The stages are re-expressed as resumable lane programs that return the next sequence for one cube, and
+// make the same decisions, in the same order, as solve_green_cross and friends.
+#define STAGE_DONE -2
+
+typedef struct {
+	int pc; // where the cube is in its stage program
+	int step; // which piece it is working on
+	int count; // loop counter
+	int good_corner;
+	int bad_corners[4];
+	int num_bad_corners;
+	int look_at;
+} lane_state_t;
+
+typedef int (*lane_program_t)(const soa_block_t *block, int lane, lane_state_t *st);
+
+// bucket sizes, as histogram bins 1, 2-3, 4-7, ..., 64
+#define BUCKET_BINS 7
+
+typedef struct {
+	unsigned long rounds;
+	unsigned long buckets;
+	unsigned long lanes;
+	unsigned long histogram[BUCKET_BINS];
+} batch_stats_t;
+
+bool batched = false;
+
+#define LANE_TILE(block, lane, face, r, c) ((block)->row[FACELET(face, r, c)][lane])
+
+// block2_facelet and block3_facelet are the flattened locate tables
+int lane_locate_2block(const soa_block_t *block, int lane, int color1, int color2)
+{
+	int i;
+	
+	for (i = 0; i < 12; i++)
+	{
+		int a = block->row[block2_facelet[i][0]][lane];
+		int b = block->row[block2_facelet[i][1]][lane];
+		if (((a == color1) && (b == color2)) || ((a == color2) && (b == color1)))
+			break;
+	}
+	return i;
+}
+
+int lane_locate_3block(const soa_block_t *block, int lane, int color1, int color2, int color3)
+{
+	int i;
+	
+	for (i = 0; i < 8; i++)
+	{
+		int k;
+		for (k = 0; k < 3; k++)
+		{
+			int a = block->row[block3_facelet[i][k]][lane];
+			if ((a != color1) && (a != color2) && (a != color3))
+				break;
+		}
+		if (k == 3)
+			break;
+	}
+	return i;
+}
+
+// Green cross: bring each green edge to its cross slot, then flip it if it's upside down
+typedef struct {
+	int color1;
+	int color2;
+	const char *cases[12]; // by block2pair location
+	int check_face, check_row, check_col, check_color; // this tile is check_color if the edge is flipped
+	const char *flip;
+	int case_seq[12];
+	int flip_seq;
+} cross_step_t;
+
+// the _seq fields are filled in by init_batch_programs
+cross_step_t cross_steps[4] = {
+	{ .color1 = GRN, .color2 = WHT,
+		.cases = { "", "D", "D D", "Di", "Fi", "Li D", "R Di", "F", "F F", "L L D", "U U F F", "Ri Ri Di" },
+		.check_face = DOWN, .check_row = 0, .check_col = 1, .check_color = WHT, .flip = "Fi D Ri Di" },
+	{ .color1 = GRN, .color2 = ORG,
+		.cases = { "", "", "Bi Li", "Ri B B Li", "L", "Li", "B Ui L L", "R U U L L", "U L L", "L L", "Ui L L", "U U L L" },
+		.check_face = DOWN, .check_row = 1, .check_col = 0, .check_color = ORG, .flip = "Li D Fi Di" },
+	{ .color1 = GRN, .color2 = RED,
+		.cases = { "", "", "B R", "", "Li Ui L Ui Ri Ri", "Bi U Ri Ri", "R", "Ri", "Ui Ri Ri", "Ui Ui Ri Ri", "U Ri Ri", "Ri Ri" },
+		.check_face = DOWN, .check_row = 1, .check_col = 2, .check_color = RED, .flip = "Ri D Bi Di" },
+	{ .color1 = GRN, .color2 = YEL,
+		.cases = { "", "", "", "", "Li U L B B", "B", "Bi", "R Ui Ri B B", "U U B B", "U B B", "B B", "Ui B B" },
+		.check_face = DOWN, .check_row = 2, .check_col = 1, .check_color = YEL, .flip = "Bi D Li Di" }
+};
+
+int green_cross_program(const soa_block_t *block, int lane, lane_state_t *st)
+{
+	while (st->step < 4)
+	{
+		cross_step_t *cs = &cross_steps[st->step];
+		if (st->pc == 0)
+		{
+			st->pc = 1;
+			int seq = cs->case_seq[lane_locate_2block(block, lane, cs->color1, cs->color2)];
+			if (seq != SEQ_NONE)
+				return seq;
+		}
+		st->pc = 0;
+		st->step++;
+		if (LANE_TILE(block, lane, cs->check_face, cs->check_row, cs->check_col) == cs->check_color)
+			return cs->flip_seq;
+	}
+	return STAGE_DONE;
+}
+
+// Green corners: bring each green corner above or into its slot, then rdRD it up to 6 times until it's in
+typedef struct {
+	int color1, color2, color3;
+	const char *cases[8]; // by block3triplet location
+	int face1, row1, col1, color_1; // the corner is in when these three tiles match
+	int face2, row2, col2, color_2;
+	int face3, row3, col3, color_3;
+	const char *rdrd;
+	int case_seq[8];
+	int rdrd_seq;
+} corner_step_t;
+
+corner_step_t corner_steps[4] = {
+	{ .color1 = GRN, .color2 = ORG, .color3 = WHT, .cases = { "", "Bi Ui B", "B U U Bi", "R U Ri", "", "Ui", "Ui Ui", "U" },
+		.face1 = FRONT, .row1 = 2, .col1 = 0, .color_1 = WHT, .face2 = LEFT, .row2 = 2, .col2 = 2, .color_2 = ORG,
+		.face3 = DOWN, .row3 = 0, .col3 = 0, .color_3 = GRN, .rdrd = "Li Ui L U" },
+	{ .color1 = GRN, .color2 = ORG, .color3 = YEL, .cases = { "", "", "B U Bi U U", "R Ui Ui Ri", "U", "", "Ui", "U U" },
+		.face1 = BACK, .row1 = 2, .col1 = 2, .color_1 = YEL, .face2 = LEFT, .row2 = 2, .col2 = 0, .color_2 = ORG,
+		.face3 = DOWN, .row3 = 2, .col3 = 0, .color_3 = GRN, .rdrd = "Bi Ui B U" },
+	{ .color1 = GRN, .color2 = YEL, .color3 = RED, .cases = { "", "", "", "R U U Ri U", "U U", "U", "", "Ui" },
+		.face1 = BACK, .row1 = 2, .col1 = 0, .color_1 = YEL, .face2 = RIGHT, .row2 = 2, .col2 = 2, .color_2 = RED,
+		.face3 = DOWN, .row3 = 2, .col3 = 2, .color_3 = GRN, .rdrd = "Ri Ui R U" },
+	{ .color1 = GRN, .color2 = WHT, .color3 = RED, .cases = { "", "", "", "", "Ui", "U U", "U", "" },
+		.face1 = FRONT, .row1 = 2, .col1 = 2, .color_1 = WHT, .face2 = RIGHT, .row2 = 2, .col2 = 0, .color_2 = RED,
+		.face3 = DOWN, .row3 = 0, .col3 = 2, .color_3 = GRN, .rdrd = "Fi Ui F U" }
+};
+
+int green_corners_program(const soa_block_t *block, int lane, lane_state_t *st)
+{
+	while (st->step < 4)
+	{
+		corner_step_t *cs = &corner_steps[st->step];
+		if (st->pc == 0)
+		{
+			st->pc = 1;
+			st->count = 0;
+			int seq = cs->case_seq[lane_locate_3block(block, lane, cs->color1, cs->color2, cs->color3)];
+			if (seq != SEQ_NONE)
+				return seq;
+		}
+		if ((st->count < 6) &&
+			!((LANE_TILE(block, lane, cs->face1, cs->row1, cs->col1) == cs->color_1) &&
+			  (LANE_TILE(block, lane, cs->face2, cs->row2, cs->col2) == cs->color_2) &&
+			  (LANE_TILE(block, lane, cs->face3, cs->row3, cs->col3) == cs->color_3)))
+		{
+			st->count++;
+			return cs->rdrd_seq;
+		}
+		st->pc = 0;
+		st->step++;
+	}
+	return STAGE_DONE;
+}
+
+// Middle edges: unless an edge is already home, lift it out of the middle stack, swing it above its slot
+// and lay it down to the left or right depending on which way round it is
+typedef struct {
+	int color1, color2;
+	int face1, row1, col1; // the edge is home when this tile is color1...
+	int face2, row2, col2; // ...and this one is color2
+	const char *lift[12]; // by block2pair location
+	const char *align[12]; // by block2pair location, once it's on top
+	int lay_face, lay_row, lay_col; // lay_a if this tile is color1, lay_b otherwise
+	const char *lay_a;
+	const char *lay_b;
+	int lift_seq[12];
+	int align_seq[12];
+	int lay_a_seq;
+	int lay_b_seq;
+} middle_step_t;
+
+#define LEFT_LAY_FRONT "Ui Li U L U F Ui Fi"
+#define RIGHT_LAY_BACK "U L Ui Li Ui Bi U B"
+#define LEFT_LAY_BACK "Ui Ri U R U B Ui Bi"
+#define RIGHT_LAY_FRONT "U R Ui Ri Ui Fi U F"
+
+middle_step_t middle_steps[4] = {
+	{ .color1 = WHT, .color2 = ORG, .face1 = FRONT, .row1 = 1, .col1 = 0, .face2 = LEFT, .row2 = 1, .col2 = 2,
+		.lift = { "", "", "", "", LEFT_LAY_FRONT, RIGHT_LAY_BACK, LEFT_LAY_BACK, RIGHT_LAY_FRONT, "", "", "", "" },
+		.align = { "", "", "", "", "", "", "", "", "", "Ui", "U U", "U" },
+		.lay_face = FRONT, .lay_row = 0, .lay_col = 1, .lay_a = LEFT_LAY_FRONT, .lay_b = "U U F Ui Fi Ui Li U L" },
+	{ .color1 = WHT, .color2 = RED, .face1 = FRONT, .row1 = 1, .col1 = 2, .face2 = RIGHT, .row2 = 1, .col2 = 0,
+		.lift = { "", "", "", "", "", RIGHT_LAY_BACK, LEFT_LAY_BACK, RIGHT_LAY_FRONT, "", "", "", "" },
+		.align = { "", "", "", "", "", "", "", "", "", "Ui", "U U", "U" },
+		.lay_face = FRONT, .lay_row = 0, .lay_col = 1, .lay_a = RIGHT_LAY_FRONT, .lay_b = "Ui Ui Fi U F U R Ui Ri" },
+	{ .color1 = YEL, .color2 = ORG, .face1 = BACK, .row1 = 1, .col1 = 2, .face2 = LEFT, .row2 = 1, .col2 = 0,
+		.lift = { "", "", "", "", "", RIGHT_LAY_BACK, LEFT_LAY_BACK, "", "", "", "", "" },
+		.align = { "", "", "", "", "", "", "", "", "U U", "U", "", "Ui" },
+		.lay_face = BACK, .lay_row = 0, .lay_col = 1, .lay_a = RIGHT_LAY_BACK, .lay_b = "Ui Ui Bi U B U L Ui Li" },
+	{ .color1 = YEL, .color2 = RED, .face1 = BACK, .row1 = 1, .col1 = 0, .face2 = RIGHT, .row2 = 1, .col2 = 2,
+		.lift = { "", "", "", "", LEFT_LAY_BACK, LEFT_LAY_BACK, LEFT_LAY_BACK, LEFT_LAY_BACK, "", "", "", "" },
+		.align = { "", "", "", "", "", "", "", "", "U U", "U", "", "Ui" },
+		.lay_face = BACK, .lay_row = 0, .lay_col = 1, .lay_a = LEFT_LAY_BACK, .lay_b = "U U B Ui Bi Ui Ri U R" }
+};
+
+int middle_edges_program(const soa_block_t *block, int lane, lane_state_t *st)
+{
+	while (st->step < 4)
+	{
+		middle_step_t *ms = &middle_steps[st->step];
+		int seq;
+		switch (st->pc)
+		{
+			case 0:
+				if ((LANE_TILE(block, lane, ms->face1, ms->row1, ms->col1) == ms->color1) &&
+					(LANE_TILE(block, lane, ms->face2, ms->row2, ms->col2) == ms->color2))
+				{
+					st->step++;
+					continue;
+				}
+				st->pc = 1;
+				seq = ms->lift_seq[lane_locate_2block(block, lane, ms->color1, ms->color2)];
+				if (seq != SEQ_NONE)
+					return seq;
+				// fall through
+			case 1:
+				st->pc = 2;
+				seq = ms->align_seq[lane_locate_2block(block, lane, ms->color1, ms->color2)];
+				if (seq != SEQ_NONE)
+					return seq;
+				// fall through
+			case 2:
+				st->pc = 0;
+				st->step++;
+				return (LANE_TILE(block, lane, ms->lay_face, ms->lay_row, ms->lay_col) == ms->color1) ? ms->lay_a_seq : ms->lay_b_seq;
+		}
+	}
+	return STAGE_DONE;
+}
+
+// Blue cross
+const char *blue_cross_text[8] = {
+	"F R U Ri Ui Fi", "R B U Bi Ui Ri", "F R U Ri Ui Fi", "L F U Fi Ui Li", "B L U Li Ui Bi",
+	"F R U Ri Ui Fi", "L F U Fi Ui Li", ""
+};
+int blue_cross_seq[8];
+int seq_u;
+int seq_align_blu_red;
+int seq_fix_parity;
+
+int lane_blue_cross_state(const soa_block_t *block, int lane)
+{
+	bool back = (LANE_TILE(block, lane, UP, 0, 1) == BLU);
+	bool left = (LANE_TILE(block, lane, UP, 1, 0) == BLU);
+	bool right = (LANE_TILE(block, lane, UP, 1, 2) == BLU);
+	bool front = (LANE_TILE(block, lane, UP, 2, 1) == BLU);
+	
+	if (back && left && right && front)
+		return BLUECROSSSTATECROSS;
+	if (left && right)
+		return BLUECROSSSTATELINEH;
+	if (back && front)
+		return BLUECROSSSTATELINEV;
+	if (left && front)
+		return BLUECROSSSTATELFRONTLEFT;
+	if (left && back)
+		return BLUECROSSSTATELBACKLEFT;
+	if (back && right)
+		return BLUECROSSSTATELBACKRIGHT;
+	if (right && front)
+		return BLUECROSSSTATELFRONTRIGHT;
+	return BLUECROSSSTATENONE;
+}
+
+int blue_cross_program(const soa_block_t *block, int lane, lane_state_t *st)
+{
+	switch (st->pc)
+	{
+		case 0:
+		{
+			int state = lane_blue_cross_state(block, lane);
+			if (state != BLUECROSSSTATECROSS)
+				return blue_cross_seq[state];
+			st->pc = 1;
+		}
+			// fall through
+		case 1:
+			if (lane_locate_2block(block, lane, BLU, WHT) != BLUECROSSFRONT)
+				return seq_u;
+			st->pc = 2;
+			// fall through
+		case 2:
+			if (lane_locate_2block(block, lane, BLU, RED) != BLUECROSSRIGHT)
+				return seq_align_blu_red;
+			if (!((lane_locate_2block(block, lane, BLU, YEL) == BLUECROSSLEFT) && (lane_locate_2block(block, lane, BLU, ORG) == BLUECROSSBACK)))
+				return STAGE_DONE;
+			st->pc = 3;
+			// fall through
+		case 3:
+			if ((lane_locate_2block(block, lane, BLU, ORG) != BLUECROSSFRONT) ||
+				(lane_locate_2block(block, lane, BLU, WHT) != BLUECROSSRIGHT) ||
+				(lane_locate_2block(block, lane, BLU, RED) != BLUECROSSBACK))
+				return seq_fix_parity;
+			// and one final up-rotation to fix it
+			st->pc = 4;
+			return seq_u;
+	}
+	return STAGE_DONE;
+}
+
+// Blue corners
+const char *corner_cycle_text[8] = {
+	"", "", "", "",
+	"U F Ui Bi U Fi Ui B", "U L Ui Ri U Li Ui R", "U B Ui Fi U Bi Ui F", "U R Ui Li U Ri Ui L"
+};
+int corner_cycle_seq[8];
+
+const char *twist_text[6] = { "", "Li Di L D", "Fi Di F D", "Ri Di R D", "Bi Di B D", "" }; // by look_at face
+int twist_seq[6];
+
+int seq_ui[4]; // 0 to 3 inverted up turns
+
+// the side facelets of each blue corner, and the colors they show when piece_of_interest is twisted into it,
+// as in check_working_corner_alignment
+const unsigned char working_corner_facelet[8][3] = {
+	{ 0 }, { 0 }, { 0 }, { 0 },
+	{ FACELET(FRONT, 0, 0), FACELET(LEFT, 0, 2), FACELET(UP, 2, 0) },
+	{ FACELET(BACK, 0, 2), FACELET(LEFT, 0, 0), FACELET(UP, 0, 0) },
+	{ FACELET(BACK, 0, 0), FACELET(RIGHT, 0, 2), FACELET(UP, 0, 2) },
+	{ FACELET(FRONT, 0, 2), FACELET(RIGHT, 0, 0), FACELET(UP, 2, 2) }
+};
+
+const unsigned char working_corner_colors[8][8][2] = {
+	[BLUECORNERFRONTLEFT] = { [4] = { WHT, ORG }, [5] = { ORG, YEL }, [6] = { YEL, RED }, [7] = { RED, WHT } },
+	[BLUECORNERBACKLEFT] = { [4] = { ORG, WHT }, [5] = { YEL, ORG }, [6] = { RED, YEL }, [7] = { WHT, RED } },
+	[BLUECORNERBACKRIGHT] = { [4] = { WHT, ORG }, [5] = { ORG, YEL }, [6] = { YEL, RED }, [7] = { RED, WHT } },
+	[BLUECORNERFRONTRIGHT] = { [4] = { ORG, WHT }, [5] = { YEL, ORG }, [6] = { RED, YEL }, [7] = { WHT, RED } }
+};
+
+bool lane_working_corner_aligned(const soa_block_t *block, int lane, int working_corner, int piece_of_interest)
+{
+	return (block->row[working_corner_facelet[working_corner][0]][lane] == working_corner_colors[working_corner][piece_of_interest][0]) &&
+		(block->row[working_corner_facelet[working_corner][1]][lane] == working_corner_colors[working_corner][piece_of_interest][1]) &&
+		(block->row[working_corner_facelet[working_corner][2]][lane] == BLU);
+}
+
+bool lane_corner_placed(const soa_block_t *block, int lane, int corner)
+{
+	static const unsigned char corner_colors[8][3] = {
+		{ 0 }, { 0 }, { 0 }, { 0 },
+		{ BLU, WHT, ORG }, { BLU, YEL, ORG }, { BLU, YEL, RED }, { BLU, WHT, RED }
+	};
+	return lane_locate_3block(block, lane, corner_colors[corner][0], corner_colors[corner][1], corner_colors[corner][2]) == corner;
+}
+
+int blue_corners_program(const soa_block_t *block, int lane, lane_state_t *st)
+{
+	switch (st->pc)
+	{
+		case 0:
+			// cycle corners until at least one is in the right spot, then remember the first one that is
+			st->good_corner = -1;
+			for (int c = BLUECORNERFRONTLEFT; c <= BLUECORNERFRONTRIGHT; c++)
+			{
+				if (lane_corner_placed(block, lane, c))
+				{
+					st->good_corner = c;
 					break;
-			} // switch
-			// locate the piece again since we moved it. it should be on top now.
-			wo2blockloc = locate_2block(index, WHT, ORG);
-			if (LOGGING)
-				printf("solve_middle_edges: WHT/ORG 2-block now at block2pair %d.\n", wo2blockloc);
-		} // if block is in middle stack
-		// if block is not at BLUECROSSFRONT, flip it around so it is
-		if (wo2blockloc != BLUECROSSFRONT)
+				}
+			}
+			if (st->good_corner < 0)
+				return corner_cycle_seq[BLUECORNERFRONTRIGHT];
+			st->pc = 1;
+			// fall through
+		case 1:
+			for (int c = BLUECORNERFRONTLEFT; c <= BLUECORNERFRONTRIGHT; c++)
+				if (!lane_corner_placed(block, lane, c))
+					return corner_cycle_seq[st->good_corner];
+			
+			// find the twiddled corners
+			st->num_bad_corners = 0;
+			for (int c = BLUECORNERFRONTLEFT; c <= BLUECORNERFRONTRIGHT; c++)
+				if (!lane_working_corner_aligned(block, lane, c, c))
+					st->bad_corners[st->num_bad_corners++] = c;
+			if (st->num_bad_corners == 0)
+				return STAGE_DONE;
+			switch (st->bad_corners[0])
+			{
+				case BLUECORNERFRONTLEFT: st->look_at = LEFT; break;
+				case BLUECORNERBACKLEFT: st->look_at = BACK; break;
+				case BLUECORNERBACKRIGHT: st->look_at = RIGHT; break;
+				case BLUECORNERFRONTRIGHT: st->look_at = FRONT; break;
+			}
+			st->step = 0;
+			st->pc = 2;
+			// fall through
+		case 2:
+			// rdRD the working corner until the corner of interest is untwiddled in it, then bring up the next one
+			while (st->step < st->num_bad_corners)
+			{
+				if (!lane_working_corner_aligned(block, lane, st->bad_corners[0], st->bad_corners[st->step]))
+					return twist_seq[st->look_at];
+				st->step++;
+				if (st->step < st->num_bad_corners)
+					return seq_ui[st->bad_corners[st->step] - st->bad_corners[st->step - 1]];
+			}
+			st->pc = 3;
+			// fall through
+		case 3:
+			// if the top layer is shifted, fix it
+			if (LANE_TILE(block, lane, FRONT, 0, 1) != WHT)
+				return seq_u;
+			return STAGE_DONE;
+	}
+	return STAGE_DONE;
+}
+
+// With --green-cross, the green cross stage walks the green cross table instead, a turn at a time
+int cross_turn_seq[12];
+
+int green_cross_table_program(const soa_block_t *block, int lane, lane_state_t *st)
+{
+	(void)st; // the table is the state
+	unsigned char facelet[NUM_FACELETS];
+	cubie_t state;
+	unsigned char loc[4];
+	for (int i = 0; i < NUM_FACELETS; i++)
+		facelet[i] = block->row[i][lane];
+	facelets_to_cubie(facelet, &state);
+	cross_state(&state, loc);
+	int q = cross_step(loc);
+	return (q < 0) ? STAGE_DONE : cross_turn_seq[q];
+}
+
+// With --last-layer, the last two stages walk the last layer table instead
+int lane_last_layer_step(const soa_block_t *block, int lane, bool edges_only)
+{
+	unsigned char facelet[NUM_FACELETS];
+	cubie_t state;
+	for (int i = 0; i < NUM_FACELETS; i++)
+		facelet[i] = block->row[i][lane];
+	facelets_to_cubie(facelet, &state);
+	int g = ll_step(&state, edges_only);
+	return (g < 0) ? STAGE_DONE : ll_generator_seq[g];
+}
+
+int last_layer_cross_program(const soa_block_t *block, int lane, lane_state_t *st)
+{
+	(void)st; // the table is the state
+	return lane_last_layer_step(block, lane, true);
+}
+
+int last_layer_corners_program(const soa_block_t *block, int lane, lane_state_t *st)
+{
+	(void)st; // the table is the state
+	return lane_last_layer_step(block, lane, false);
+}
+
+lane_program_t stage_programs[5] = {
+	green_cross_program, green_corners_program, middle_edges_program, blue_cross_program, blue_corners_program
+};
+
+void init_batch_programs(void)
+{
+	for (int s = 0; s < 4; s++)
+	{
+		for (int i = 0; i < 12; i++)
 		{
-			if (LOGGING)
-				printf("solve_middle_edges: move WHT/ORG 2-block to BLUECROSSFRONT.\n");
-			switch (wo2blockloc)
+			cross_steps[s].case_seq[i] = intern_sequence(cross_steps[s].cases[i]);
+			middle_steps[s].lift_seq[i] = intern_sequence(middle_steps[s].lift[i]);
+			middle_steps[s].align_seq[i] = intern_sequence(middle_steps[s].align[i]);
+		}
+		cross_steps[s].flip_seq = intern_sequence(cross_steps[s].flip);
+		middle_steps[s].lay_a_seq = intern_sequence(middle_steps[s].lay_a);
+		middle_steps[s].lay_b_seq = intern_sequence(middle_steps[s].lay_b);
+		for (int i = 0; i < 8; i++)
+			corner_steps[s].case_seq[i] = intern_sequence(corner_steps[s].cases[i]);
+		corner_steps[s].rdrd_seq = intern_sequence(corner_steps[s].rdrd);
+	}
+	
+	for (int i = 0; i < 8; i++)
+	{
+		blue_cross_seq[i] = intern_sequence(blue_cross_text[i]);
+		corner_cycle_seq[i] = intern_sequence(corner_cycle_text[i]);
+	}
+	for (int i = 0; i < 6; i++)
+		twist_seq[i] = intern_sequence(twist_text[i]);
+	seq_u = intern_sequence("U");
+	for (int q = ROTU; q <= ROTDI; q++)
+		cross_turn_seq[q] = intern_sequence(move_notation[q]);
+	seq_align_blu_red = intern_sequence("R U Ri U R U U Ri");
+	seq_fix_parity = intern_sequence("F U Fi U F U U Fi");
+	seq_ui[0] = SEQ_NONE;
+	seq_ui[1] = intern_sequence("Ui");
+	seq_ui[2] = intern_sequence("Ui Ui");
+	seq_ui[3] = intern_sequence("Ui Ui Ui");
+}
+
+// most sequences one cube can take in a stage, when recording solutions
+#define MAX_STAGE_STEPS 256
+
+// Run one stage over a block in rounds, bucketing the cubes by the sequence they need next. If steps isn't
+// NULL, the sequences each cube takes are listed in steps[lane], num_steps[lane] of them.
+void run_batched_stage(soa_block_t *block, lane_program_t program, batch_stats_t *stats,
+					   unsigned char (*steps)[MAX_STAGE_STEPS], unsigned int *num_steps)
+{
+	lane_state_t state[SOA_WIDTH];
+	uint64_t active = (block->count == SOA_WIDTH) ? ~0ULL : ((1ULL << block->count) - 1);
+	uint64_t bucket_lanes[MAX_SEQUENCES];
+	int bucket_seq[SOA_WIDTH];
+	signed char bucket_of[MAX_SEQUENCES];
+	
+	memset(state, 0, sizeof(state));
+	memset(bucket_of, -1, sizeof(bucket_of));
+	
+	while (active != 0)
+	{
+		// classify
+		int num_buckets = 0;
+		for (uint64_t lanes = active; lanes != 0; lanes &= lanes - 1)
+		{
+			int lane = __builtin_ctzll(lanes);
+			int seq = program(block, lane, &state[lane]);
+			if (seq == STAGE_DONE)
+			{
+				active &= ~(1ULL << lane);
+				continue;
+			}
+			if (steps != NULL)
 			{
-				case BLUECROSSFRONT:
-					// do nothing
-					break;
-				case BLUECROSSLEFT:
-					abs_rotui(index);
-					break;
-				case BLUECROSSBACK:
-					abs_rotu(index);
-					abs_rotu(index);
-					break;
-				case BLUECROSSRIGHT:
-					abs_rotu(index);
-					break;
+				if (num_steps[lane] == MAX_STAGE_STEPS)
+				{
+					printf("Too many steps in a batched stage!\n");
+					exit(-1);
+				}
+				steps[lane][num_steps[lane]++] = seq;
 			}
+			if (bucket_of[seq] < 0)
+			{
+				bucket_of[seq] = num_buckets;
+				bucket_seq[num_buckets] = seq;
+				bucket_lanes[num_buckets] = 0;
+				num_buckets++;
+			}
+			bucket_lanes[(int)bucket_of[seq]] |= 1ULL << lane;
 		}
-		// lay the square down into place according to it's orientation
-		if (LOGGING)
-			printf("solve_middle_edges: lay WHT/ORG 2-block down into place.\n");
-		if (cube[index].face[FRONT].tile[0][1] == WHT)
-		{
-			// lay it down to the left
-			abs_rotui(index);
-			abs_rotli(index);
-			abs_rotu(index);
-			abs_rotl(index);
-			abs_rotu(index);
-			abs_rotf(index);
-			abs_rotui(index);
-			abs_rotfi(index);
-		}
-		else
+		
+		// and turn each bucket together, with the sequence's macro permutation
+		for (int b = 0; b < num_buckets; b++)
 		{
-			// lay it down to the right from orange side
-			abs_rotu(index);
-			abs_rotu(index);
-			abs_rotf(index);
-			abs_rotui(index);
-			abs_rotfi(index);
-			abs_rotui(index);
-			abs_rotli(index);
-			abs_rotu(index);
-			abs_rotl(index);			
+			soa_apply_perm_masked(block, MACRO_BASE + bucket_seq[b], sequences[bucket_seq[b]].length, bucket_lanes[b]);
+			bucket_of[bucket_seq[b]] = -1;
+			
+			int size = __builtin_popcountll(bucket_lanes[b]);
+			stats->buckets++;
+			stats->lanes += size;
+			stats->histogram[63 - __builtin_clzll((uint64_t)size)]++;
 		}
+		if (num_buckets > 0)
+			stats->rounds++;
 	}
+}
 
-	// locate WHT/RED piece
-	int wr2blockloc = locate_2block(index, WHT, RED);
-	if (LOGGING)
-		printf("solve_middle_edges: solve WHT/RED: 2-block found at block2pair #%d.\n", wr2blockloc);
-	// if it's not magically in place, then we need to process it
-	if (!((cube[index].face[FRONT].tile[1][2] == WHT) && (cube[index].face[RIGHT].tile[1][0] == RED)))
+// Solve count scrambled cubes starting at cube[first] a block at a time, stage by stage
+void solve_cubes_batched(int first, int count, batch_stats_t stats[5])
+{
+	soa_block_t block;
+	unsigned int stage_moves[5][SOA_WIDTH];
+	unsigned char steps[SOA_WIDTH][MAX_STAGE_STEPS];
+	unsigned int num_steps[SOA_WIDTH];
+	
+	for (int i = first; i < first + count; i += SOA_WIDTH)
 	{
-		// if the desired block is in the middle stack, we need to get it up top.
-		if ((wr2blockloc >= MIDDLEFRONTLEFT) && (wr2blockloc <= MIDDLEFRONTRIGHT))
+		int n = (first + count - i < SOA_WIDTH) ? first + count - i : SOA_WIDTH;
+		soa_load(&block, i, n);
+		for (int s = 0; s < 5; s++)
 		{
-			if (LOGGING)
-				printf("solve_middle_edges: move WHT/RED 2-block to top stack.\n");
-			switch (wr2blockloc)
-			{
-				case MIDDLEBACKLEFT:
-					// right-lay facing back
-					abs_rotu(index);
-					abs_rotl(index);
-					abs_rotui(index);
-					abs_rotli(index);
-					abs_rotui(index);
-					abs_rotbi(index);
-					abs_rotu(index);
-					abs_rotb(index);
-					break;
-				case MIDDLEBACKRIGHT:
-					// left-lay facing back
-					abs_rotui(index);
-					abs_rotri(index);
-					abs_rotu(index);
-					abs_rotr(index);
-					abs_rotu(index);
-					abs_rotb(index);
-					abs_rotui(index);
-					abs_rotbi(index);
-					break;
-				case MIDDLEFRONTRIGHT:
-					// right-lay facing front
-					abs_rotu(index);
-					abs_rotr(index);
-					abs_rotui(index);
-					abs_rotri(index);
-					abs_rotui(index);
-					abs_rotfi(index);
-					abs_rotu(index);
-					abs_rotf(index);
-					break;
-			} // switch
-			// locate the piece again since we moved it. it should be on top now.
-			wr2blockloc = locate_2block(index, WHT, RED);
-			if (LOGGING)
-				printf("solve_middle_edges: WHT/RED 2-block now at block2pair %d.\n", wr2blockloc);
-		} // if block is in middle stack
-		// if block is not at BLUECROSSFRONT, flip it around so it is
-		if (wr2blockloc != BLUECROSSFRONT)
-		{
-			if (LOGGING)
-				printf("solve_middle_edges: move WHT/RED 2-block to BLUECROSSFRONT.\n");
-			switch (wr2blockloc)
+			unsigned int before[SOA_WIDTH];
+			memcpy(before, block.moves, sizeof(before));
+			memset(num_steps, 0, sizeof(num_steps));
+			run_batched_stage(&block, stage_programs[s], &stats[s], record_solutions ? steps : NULL, num_steps);
+			for (int j = 0; j < n; j++)
+				stage_moves[s][j] = block.moves[j] - before[j];
+			
+			// the cubes' sequences were interleaved, so write each one's stage out in one go now
+			if (record_solutions)
 			{
-				case BLUECROSSFRONT:
-					// do nothing
-					break;
-				case BLUECROSSLEFT:
-					abs_rotui(index);
-					break;
-				case BLUECROSSBACK:
-					abs_rotu(index);
-					abs_rotu(index);
-					break;
-				case BLUECROSSRIGHT:
-					abs_rotu(index);
-					break;
+				for (int j = 0; j < n; j++)
+				{
+					move_arena_begin_span(thread_arena);
+					for (unsigned int k = 0; k < num_steps[j]; k++)
+					{
+						const move_seq_t *seq = &sequences[steps[j][k]];
+						for (int m = 0; m < seq->length; m++)
+							move_arena_put(thread_arena, seq->moves[m]);
+					}
+					move_arena_end_span(thread_arena, &solutions[i + j].stage[s]);
+				}
 			}
 		}
-		// lay the square down into place according to it's orientation
-		if (LOGGING)
-			printf("solve_middle_edges: lay WHT/RED 2-block down into place.\n");
-		if (cube[index].face[FRONT].tile[0][1] == WHT)
+		soa_store(&block, i);
+		for (int j = 0; j < n; j++)
 		{
-			// lay it down to the right
-			abs_rotu(index);
-			abs_rotr(index);
-			abs_rotui(index);
-			abs_rotri(index);
-			abs_rotui(index);
-			abs_rotfi(index);
-			abs_rotu(index);
-			abs_rotf(index);
+			cube[i + j].solveGreenCrossMoves = stage_moves[0][j];
+			cube[i + j].solveGreenCornersMoves = stage_moves[1][j];
+			cube[i + j].solveMiddleEdgesMoves = stage_moves[2][j];
+			cube[i + j].solveBlueCrossMoves = stage_moves[3][j];
+			cube[i + j].alignBlueCornersMoves = stage_moves[4][j];
+			if (LOGGING)
+				show_solved_cube(i + j);
 		}
-		else
+	}
+}
+
+// per-thread move count accumulators, reduced in main once all workers are done
+typedef struct {
+	unsigned long totalMoves;
+	unsigned long solveGreenCrossMoves;
+	unsigned long solveGreenCornersMoves;
+	unsigned long solveMiddleEdgesMoves;
+	unsigned long solveBlueCrossMoves;
+	unsigned long alignBlueCornersMoves;
+	unsigned long unsolvedCubes;
+	unsigned long optimizedMoves[5]; // per stage, with --optimize
+	unsigned long cubes;
+} move_totals_t;
+
+// with --input or --states, cubes come from the input instead of being scrambled; ones that aren't a valid
+// cube are loaded as a solved cube, solved along with the rest but left out of the totals
+bool streaming = false; // --input
+bool input_cubes = false; // --input or --states
+bool *cube_invalid = NULL; // one per cube array slot
+
+// Allocate the cube array and its companions for capacity cubes
+void alloc_cubes(int capacity)
+{
+	cube = calloc(capacity, sizeof(cube_t));
+	solutions = calloc(capacity, sizeof(solution_t));
+	cube_invalid = calloc(capacity, sizeof(bool));
+	if ((cube == NULL) || (solutions == NULL) || (cube_invalid == NULL))
+	{
+		printf("Unable to allocate %d cubes!\n", capacity);
+		exit(-1);
+	}
+	cube_capacity = capacity;
+}
+
+void free_cubes(void)
+{
+	free(cube);
+	free(solutions);
+	free(cube_invalid);
+	cube = NULL;
+	solutions = NULL;
+	cube_invalid = NULL;
+	cube_capacity = 0;
+}
+
+// where the run's report goes; stderr when solutions are written to stdout
+FILE *report;
+
+// Binary Batch Files
+// For big corpora, cube states and solutions can be kept in fixed layout binary files that are mmapped
+// rather than read and written as text. Both start with a 64 byte header. A states file is followed by
+// count 16 byte records, each a cube's cubie_t (corners, then edges, as native 64 bit words); workers convert
+// their own slices of the mapping straight into the cube array. A solutions file is followed by an index of
+// count + 1 64 bit offsets and then the solutions themselves, packed back to back at 4 bits per move like
+// the move arenas, with STAGE_MARK after each stage's moves. Offsets count nibbles from the start of the
+// data, so solution i is nibbles offset[i] to offset[i + 1]; an invalid cube's solution is empty. Each chunk
+// of the cube array is appended to the data by mapping just the new part of the file.
+#define STATES_MAGIC "RBXSTATE"
+#define SOLUTIONS_MAGIC "RBXSOLNS"
+#define BATCH_FILE_VERSION 1
+#define STAGE_MARK 0x0f
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size; // bytes per record: 16 for states, 8 per index entry for solutions
+	uint64_t count;
+	uint64_t data_offset; // solutions only: where the packed moves start
+	unsigned char reserved[32];
+} batch_header_t;
+
+_Static_assert(sizeof(batch_header_t) == 64, "batch file headers are 64 bytes");
+
+// the mapped states file, when solving one, and the record that cube[0] currently holds
+const cubie_t *mapped_states = NULL;
+uint64_t mapped_first = 0;
+
+// Load count cubes starting at cube[first] from the mapped states
+void load_mapped_cubes(int first, int count)
+{
+	for (int i = first; i < first + count; i++)
+	{
+		// every piece has to be in a real slot before it's safe to draw the facelets; drawing them and reading
+		// them back then checks the rest
+		const cubie_t *record = &mapped_states[mapped_first + i];
+		cube_invalid[i] = false;
+		for (int p = URF; p <= DRB; p++)
+			cube_invalid[i] |= (cubie_corner(record, p) >= 24);
+		for (int p = UR; p <= BR; p++)
+			cube_invalid[i] |= (cubie_edge(record, p) >= 24);
+		cube_invalid[i] |= ((record->corners >> (8 * CUBIE_BITS)) != 0) || ((record->edges >> (12 * CUBIE_BITS)) != 0);
+		
+		cubie_t check;
+		if (!cube_invalid[i])
 		{
-			// lay it down to the left from red side
-			abs_rotui(index);
-			abs_rotui(index);
-			abs_rotfi(index);
-			abs_rotu(index);
-			abs_rotf(index);
-			abs_rotu(index);
-			abs_rotr(index);
-			abs_rotui(index);
-			abs_rotri(index);			
+			cubie_to_facelets(record, cube[i].facelet);
+			cube_invalid[i] = !facelets_to_cubie(cube[i].facelet, &check) || (check.corners != record->corners) ||
+				(check.edges != record->edges);
 		}
+		if (cube_invalid[i])
+			init_cube(&cube[i]);
+		cube[i].totalMoves = 0;
+		cube[i].solveGreenCrossMoves = 0;
+		cube[i].solveGreenCornersMoves = 0;
+		cube[i].solveMiddleEdgesMoves = 0;
+		cube[i].solveBlueCrossMoves = 0;
+		cube[i].alignBlueCornersMoves = 0;
 	}
+}
 
-	// locate YEL/ORG piece
-	int yo2blockloc = locate_2block(index, YEL, ORG);
-	if (LOGGING)
-		printf("solve_middle_edges: solve YEL/ORG: 2-block found at block2pair #%d.\n", yo2blockloc);
-	// if it's not magically in place, then we need to process it
-	if (!((cube[index].face[BACK].tile[1][2] == YEL) && (cube[index].face[LEFT].tile[1][0] == ORG)))
+// Map a whole file read only, exiting if we can't
+void *map_file(const char *path, size_t *size)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || (fstat(fd, &st) != 0))
 	{
-		// if the desired block is in the middle stack, we need to get it up top.
-		if ((yo2blockloc >= MIDDLEFRONTLEFT) && (yo2blockloc <= MIDDLEFRONTRIGHT))
+		printf("Unable to open %s for reading!\n", path);
+		exit(-1);
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		printf("Unable to map %s!\n", path);
+		exit(-1);
+	}
+	*size = st.st_size;
+	return map;
+}
+
+// Map a states file and check its header; returns the records
+const cubie_t *map_states_file(const char *path, uint64_t *count, size_t *size)
+{
+	const batch_header_t *header = map_file(path, size);
+	if ((*size < sizeof(batch_header_t)) || (memcmp(header->magic, STATES_MAGIC, 8) != 0) ||
+		(header->version != BATCH_FILE_VERSION) || (header->record_size != sizeof(cubie_t)) ||
+		(*size < sizeof(batch_header_t) + header->count * sizeof(cubie_t)))
+	{
+		printf("%s is not a cube states file!\n", path);
+		exit(-1);
+	}
+	*count = header->count;
+	return (const cubie_t *)(header + 1);
+}
+
+// Write count scrambled cubes to a new states file, a chunk of the cube array at a time
+void make_states_file(const char *path, uint64_t count)
+{
+	size_t size = sizeof(batch_header_t) + count * sizeof(cubie_t);
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if ((fd < 0) || (ftruncate(fd, size) != 0))
+	{
+		printf("Unable to create %s!\n", path);
+		exit(-1);
+	}
+	batch_header_t *header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (header == MAP_FAILED)
+	{
+		printf("Unable to map %s!\n", path);
+		exit(-1);
+	}
+	
+	memset(header, 0, sizeof(batch_header_t));
+	memcpy(header->magic, STATES_MAGIC, 8);
+	header->version = BATCH_FILE_VERSION;
+	header->record_size = sizeof(cubie_t);
+	header->count = count;
+	cubie_t *records = (cubie_t *)(header + 1);
+	for (uint64_t i = 0; i < count; i += cube_capacity)
+	{
+		int n = (count - i < (uint64_t)cube_capacity) ? (int)(count - i) : cube_capacity;
+		cube_base = i;
+		scramble_cubes(0, n);
+		for (int j = 0; j < n; j++)
+			facelets_to_cubie(cube[j].facelet, &records[i + j]);
+	}
+	munmap(header, size);
+}
+
+typedef struct {
+	int fd;
+	uint64_t count;
+	uint64_t *index; // mapped offsets, count + 1 of them
+	size_t index_size; // bytes mapped for the header and index
+	uint64_t data_offset; // bytes
+	uint64_t next; // nibbles of data written so far
+	uint64_t written; // solutions written so far
+} solutions_file_t;
+
+// Create a solutions file for count cubes, with its header and index mapped
+void create_solutions_file(solutions_file_t *file, const char *path, uint64_t count)
+{
+	file->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	file->count = count;
+	file->data_offset = (sizeof(batch_header_t) + (count + 1) * sizeof(uint64_t) + 63) & ~(uint64_t)63;
+	file->index_size = file->data_offset;
+	file->next = 0;
+	file->written = 0;
+	if ((file->fd < 0) || (ftruncate(file->fd, file->data_offset) != 0))
+	{
+		printf("Unable to create %s!\n", path);
+		exit(-1);
+	}
+	batch_header_t *header = mmap(NULL, file->index_size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+	if (header == MAP_FAILED)
+	{
+		printf("Unable to map %s!\n", path);
+		exit(-1);
+	}
+	memset(header, 0, sizeof(batch_header_t));
+	memcpy(header->magic, SOLUTIONS_MAGIC, 8);
+	header->version = BATCH_FILE_VERSION;
+	header->record_size = sizeof(uint64_t);
+	header->count = count;
+	header->data_offset = file->data_offset;
+	file->index = (uint64_t *)(header + 1);
+	file->index[0] = 0;
+}
+
+// Append the solutions of the count cubes in the cube array: index them, grow the file to fit, and pack them
+// into the newly mapped tail
+void append_solutions(solutions_file_t *file, int count)
+{
+	// a chunk carries on from the nibble the last one ended on, which may be the high half of a byte
+	uint64_t start = file->next;
+	uint64_t end = start;
+	for (int i = 0; i < count; i++)
+	{
+		if (!cube_invalid[i])
+			end += solution_length(&solutions[i]) + 5;
+		file->index[file->written + i + 1] = end;
+	}
+	
+	uint64_t first_byte = file->data_offset + start / 2;
+	uint64_t last_byte = file->data_offset + (end + 1) / 2;
+	if (ftruncate(file->fd, last_byte) != 0)
+	{
+		printf("Unable to grow the solutions file!\n");
+		exit(-1);
+	}
+	if (last_byte > first_byte)
+	{
+		uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+		uint64_t map_start = first_byte & ~(page - 1);
+		unsigned char *map = mmap(NULL, last_byte - map_start, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, map_start);
+		if (map == MAP_FAILED)
 		{
-			if (LOGGING)
-				printf("solve_middle_edges: move YEL/ORG 2-block to top stack.\n");
-			switch (yo2blockloc)
-			{
-				case MIDDLEBACKLEFT:
-					// right-lay facing back
-					abs_rotu(index);
-					abs_rotl(index);
-					abs_rotui(index);
-					abs_rotli(index);
-					abs_rotui(index);
-					abs_rotbi(index);
-					abs_rotu(index);
-					abs_rotb(index);
-					break;
-				case MIDDLEBACKRIGHT:
-					// left-lay facing back
-					abs_rotui(index);
-					abs_rotri(index);
-					abs_rotu(index);
-					abs_rotr(index);
-					abs_rotu(index);
-					abs_rotb(index);
-					abs_rotui(index);
-					abs_rotbi(index);
-					break;
-			} // switch
-			// locate the piece again since we moved it. it should be on top now.
-			yo2blockloc = locate_2block(index, YEL, ORG);
-			if (LOGGING)
-				printf("solve_middle_edges: YEL/ORG 2-block now at block2pair %d.\n", yo2blockloc);
-		} // if block is in middle stack
-		// if block is not at BLUECROSSBACK, flip it around so it is
-		if (yo2blockloc != BLUECROSSBACK)
+			printf("Unable to map the solutions file!\n");
+			exit(-1);
+		}
+		// the low half of a shared first byte is the last chunk's; its high half is still zero
+		unsigned char *data = map + (first_byte - map_start);
+		memset(data + (start & 1), 0, last_byte - first_byte - (start & 1));
+		uint64_t nibble = start & 1;
+		for (int i = 0; i < count; i++)
 		{
-			if (LOGGING)
-				printf("solve_middle_edges: move YEL/ORG 2-block to BLUECROSSBACK.\n");
-			switch (yo2blockloc)
+			if (cube_invalid[i])
+				continue;
+			for (int s = 0; s < 5; s++)
 			{
-				case BLUECROSSFRONT:
-					abs_rotu(index);
-					abs_rotu(index);
-					break;
-				case BLUECROSSLEFT:
-					abs_rotu(index);
-					break;
-				case BLUECROSSBACK:
-					// do nothing
-					break;
-				case BLUECROSSRIGHT:
-					abs_rotui(index);
-					break;
+				const move_span_t *span = &solutions[i].stage[s];
+				for (unsigned int k = 0; k <= span->length; k++, nibble++)
+				{
+					int code = (k < span->length) ? move_span_get(span, k) : STAGE_MARK;
+					data[nibble / 2] |= code << ((nibble & 1) * 4);
+				}
 			}
 		}
-		// lay the square down into place according to it's orientation
-		if (LOGGING)
-			printf("solve_middle_edges: lay YEL/ORG 2-block down into place.\n");
-		if (cube[index].face[BACK].tile[0][1] == YEL)
+		munmap(map, last_byte - map_start);
+	}
+	
+	file->next = end;
+	file->written += count;
+}
+
+void close_solutions_file(solutions_file_t *file)
+{
+	munmap((unsigned char *)file->index - sizeof(batch_header_t), file->index_size);
+	close(file->fd);
+}
+
+// Print a binary solutions file as text, one solution per line like write_solution does
+void dump_solutions_file(const char *path)
+{
+	size_t size;
+	const batch_header_t *header = map_file(path, &size);
+	if ((size < sizeof(batch_header_t)) || (memcmp(header->magic, SOLUTIONS_MAGIC, 8) != 0) ||
+		(header->version != BATCH_FILE_VERSION) || (size < header->data_offset))
+	{
+		printf("%s is not a solutions file!\n", path);
+		exit(-1);
+	}
+	const uint64_t *index = (const uint64_t *)(header + 1);
+	const unsigned char *data = (const unsigned char *)header + header->data_offset;
+	for (uint64_t i = 0; i < header->count; i++)
+	{
+		if (index[i] == index[i + 1])
 		{
-			// lay it down to the right
-			abs_rotu(index);
-			abs_rotl(index);
-			abs_rotui(index);
-			abs_rotli(index);
-			abs_rotui(index);
-			abs_rotbi(index);
-			abs_rotu(index);
-			abs_rotb(index);
+			printf("INVALID\n");
+			continue;
 		}
-		else
+		for (uint64_t nibble = index[i]; nibble < index[i + 1]; nibble++)
 		{
-			// lay it down to the left from orange side
-			abs_rotui(index);
-			abs_rotui(index);
-			abs_rotbi(index);
-			abs_rotu(index);
-			abs_rotb(index);
-			abs_rotu(index);
-			abs_rotl(index);
-			abs_rotui(index);
-			abs_rotli(index);			
+			int code = (data[nibble / 2] >> ((nibble & 1) * 4)) & 0x0f;
+			if (code != STAGE_MARK)
+				printf((nibble == index[i]) ? "%s" : " %s", move_notation[code]);
+			else if (nibble + 1 < index[i + 1])
+				printf(" /");
 		}
+		printf("\n");
 	}
+	munmap((void *)header, size);
+}
+
+// a worker solves the contiguous slice [first_cube, last_cube) of the cube array
+typedef struct {
+	pthread_t thread;
+	int first_cube;
+	int last_cube;
+	move_totals_t totals;
+	batch_stats_t batch_stats[5];
+} worker_t;
+
+// Run one stage of a cube's solve, recording its moves as a span of arena if there's a solution to record
+void solve_stage(cube_t *c, int stage, void (*stage_fn)(cube_t *), move_arena_t *arena, solution_t *solution)
+{
+	if (solution == NULL)
+	{
+		stage_fn(c);
+		return;
+	}
+	move_arena_begin_span(arena);
+	c->recording = arena;
+	stage_fn(c);
+	c->recording = NULL;
+	move_arena_end_span(arena, &solution->stage[stage]);
+}
+
+// Solve a scrambled cube
+void solve_cube(cube_t *c, move_arena_t *arena, solution_t *solution)
+{
+	if ((fast_path_depth > 0) && solve_fast_path(c, arena, solution))
+		return;
+	if (solve_engine == ENGINE_TWO_PHASE)
+	{
+		solve_cube_two_phase(c, two_phase_target, arena, solution);
+		return;
+	}
+	if (solve_engine == ENGINE_OPTIMAL)
+	{
+		solve_cube_optimal(c, optimal_threads, arena, solution);
+		return;
+	}
+	solve_stage(c, 0, solve_green_cross, arena, solution);
+	solve_stage(c, 1, solve_green_corners, arena, solution);
+	solve_stage(c, 2, solve_middle_edges, arena, solution);
+	solve_stage(c, 3, solve_blue_cross, arena, solution);
+	solve_stage(c, 4, align_blue_corners, arena, solution);
+}
+
+void accumulate_moves(move_totals_t *totals, int index)
+{
+	if (input_cubes && cube_invalid[index])
+		return;
 	
-	// locate YEL/RED piece
-	int yr2blockloc = locate_2block(index, YEL, RED);
-	if (LOGGING)
-		printf("solve_middle_edges: solve YEL/RED: 2-block found at block2pair #%d.\n", yr2blockloc);
-	// if it's not magically in place, then we need to process it
-	if (!((cube[index].face[BACK].tile[1][0] == YEL) && (cube[index].face[RIGHT].tile[1][2] == RED)))
+	totals->cubes++;
+	totals->totalMoves += cube[index].totalMoves;
+	totals->solveGreenCrossMoves += cube[index].solveGreenCrossMoves;
+	totals->solveGreenCornersMoves += cube[index].solveGreenCornersMoves;
+	totals->solveMiddleEdgesMoves += cube[index].solveMiddleEdgesMoves;
+	totals->solveBlueCrossMoves += cube[index].solveBlueCrossMoves;
+	totals->alignBlueCornersMoves += cube[index].alignBlueCornersMoves;
+	
+	// check the solver's work
+	cubie_t check;
+	if (!facelets_to_cubie(cube[index].facelet, &check) || !cubie_solved(&check))
+		totals->unsolvedCubes++;
+	
+	if (optimize_solutions)
+		for (int s = 0; s < 5; s++)
+			totals->optimizedMoves[s] += solutions[index].stage[s].length;
+}
+
+void reduce_moves(move_totals_t *dst, const move_totals_t *src)
+{
+	dst->totalMoves += src->totalMoves;
+	dst->solveGreenCrossMoves += src->solveGreenCrossMoves;
+	dst->solveGreenCornersMoves += src->solveGreenCornersMoves;
+	dst->solveMiddleEdgesMoves += src->solveMiddleEdgesMoves;
+	dst->solveBlueCrossMoves += src->solveBlueCrossMoves;
+	dst->alignBlueCornersMoves += src->alignBlueCornersMoves;
+	dst->unsolvedCubes += src->unsolvedCubes;
+	dst->cubes += src->cubes;
+	for (int s = 0; s < 5; s++)
+		dst->optimizedMoves[s] += src->optimizedMoves[s];
+}
+
+void *solve_worker(void *arg)
+{
+	worker_t *w = (worker_t *)arg;
+	
+	// accumulate into a local so workers don't false-share the worker array
+	move_totals_t totals;
+	memset(&totals, 0, sizeof(totals));
+	if (record_solutions)
+		create_thread_arena();
+	
+	// scramble a block's worth of cubes at a time, then solve them while they're still in cache
+	for (int i = w->first_cube; i < w->last_cube; i += SOA_WIDTH)
 	{
-		// if the desired block is in the middle stack, we need to get it up top.
-		if ((yr2blockloc >= MIDDLEFRONTLEFT) && (yr2blockloc <= MIDDLEFRONTRIGHT))
-		{
-			if (LOGGING)
-				printf("solve_middle_edges: move YEL/RED 2-block to top stack.\n");
-			// left-lay facing back
-			abs_rotui(index);
-			abs_rotri(index);
-			abs_rotu(index);
-			abs_rotr(index);
-			abs_rotu(index);
-			abs_rotb(index);
-			abs_rotui(index);
-			abs_rotbi(index);
-			// locate the piece again since we moved it. it should be on top now.
-			yr2blockloc = locate_2block(index, YEL, RED);
-			if (LOGGING)
-				printf("solve_middle_edges: YEL/RED 2-block now at block2pair %d.\n", yr2blockloc);
-		} // if block is in middle stack
-		// if block is not at BLUECROSSBACK, flip it around so it is
-		if (yr2blockloc != BLUECROSSBACK)
+		int count = (w->last_cube - i < SOA_WIDTH) ? w->last_cube - i : SOA_WIDTH;
+		if (mapped_states != NULL)
+			load_mapped_cubes(i, count);
+		else if (!input_cubes)
+			scramble_cubes(i, count);
+		if (batched)
+			solve_cubes_batched(i, count, w->batch_stats);
+		for (int j = i; j < i + count; j++)
 		{
-			if (LOGGING)
-				printf("solve_middle_edges: move YEL/RED 2-block to BLUECROSSBACK.\n");
-			switch (yr2blockloc)
+			if (!batched)
 			{
-				case BLUECROSSFRONT:
-					abs_rotu(index);
-					abs_rotu(index);
-					break;
-				case BLUECROSSLEFT:
-					abs_rotu(index);
-					break;
-				case BLUECROSSBACK:
-					// do nothing
-					break;
-				case BLUECROSSRIGHT:
-					abs_rotui(index);
-					break;
+				if (piece_index)
+					index_pieces(&cube[j]);
+				solve_cube(&cube[j], thread_arena, record_solutions ? &solutions[j] : NULL);
+				if (LOGGING)
+					show_solved_cube(j);
 			}
+			if (optimize_solutions)
+				optimize_solution(&solutions[j], thread_arena);
+			accumulate_moves(&totals, j);
 		}
-		// lay the square down into place according to it's orientation
-		if (LOGGING)
-			printf("solve_middle_edges: lay YEL/RED 2-block down into place.\n");
-		if (cube[index].face[BACK].tile[0][1] == YEL)
+	}
+	
+	w->totals = totals;
+	return NULL;
+}
+
+// Run the batch of the first num_cubes cubes on num_threads workers, each solving a contiguous slice of the cube
+// array. In batched mode the workers' bucket statistics are summed into batch_stats.
+void run_threaded(int num_threads, int num_cubes, move_totals_t *totals, batch_stats_t batch_stats[5])
+{
+	// partition the batch into contiguous slices, one per worker. the first (num_cubes % num_threads)
+	// workers get one extra cube each.
+	if (num_threads > num_cubes)
+		num_threads = num_cubes;
+	worker_t *workers = calloc(num_threads, sizeof(worker_t));
+	if (workers == NULL)
+	{
+		printf("Unable to allocate workers!\n");
+		exit(-1);
+	}
+	int next_cube = 0;
+	for (int t = 0; t < num_threads; t++)
+	{
+		workers[t].first_cube = next_cube;
+		next_cube += num_cubes / num_threads + ((t < num_cubes % num_threads) ? 1 : 0);
+		workers[t].last_cube = next_cube;
+	}
+	
+	// worker 0 runs on the main thread, so the single threaded case never spawns anything
+	for (int t = 1; t < num_threads; t++)
+	{
+		if (pthread_create(&workers[t].thread, NULL, solve_worker, &workers[t]) != 0)
 		{
-			// lay it down to the left
-			abs_rotui(index);
-			abs_rotri(index);
-			abs_rotu(index);
-			abs_rotr(index);
-			abs_rotu(index);
-			abs_rotb(index);
-			abs_rotui(index);
-			abs_rotbi(index);
+			printf("Unable to create worker thread %d!\n", t);
+			exit(-1);
 		}
-		else
+	}
+	solve_worker(&workers[0]);
+	for (int t = 1; t < num_threads; t++)
+		pthread_join(workers[t].thread, NULL);
+	
+	for (int t = 0; t < num_threads; t++)
+	{
+		reduce_moves(totals, &workers[t].totals);
+		for (int s = 0; s < 5; s++)
 		{
-			// lay it down to the right from red side
-			abs_rotu(index);
-			abs_rotu(index);
-			abs_rotb(index);
-			abs_rotui(index);
-			abs_rotbi(index);
-			abs_rotui(index);
-			abs_rotri(index);
-			abs_rotu(index);
-			abs_rotr(index);			
+			batch_stats[s].rounds += workers[t].batch_stats[s].rounds;
+			batch_stats[s].buckets += workers[t].batch_stats[s].buckets;
+			batch_stats[s].lanes += workers[t].batch_stats[s].lanes;
+			for (int b = 0; b < BUCKET_BINS; b++)
+				batch_stats[s].histogram[b] += workers[t].batch_stats[s].histogram[b];
 		}
 	}
-	
-	cube[index].solveMiddleEdgesMoves = cube[index].totalMoves - cube[index].solveGreenCornersMoves - cube[index].solveGreenCrossMoves;
+	free(workers);
+}
 
-	if (LOGGING)
-		printf("solve_middle_edges: solved middle edges and bottom/middle stacks of cube.\n");
+// Pipeline mode
+// Each of the five solver stages runs on its own thread(s). Cube indices flow from stage to stage through
+// bounded single-producer/single-consumer rings: every producer replica owns one ring to every consumer
+// replica of the next stage, so no ring ever has more than one thread on either end.
+#define PIPELINE_STAGES 5
+#define PIPELINE_END -1 // sentinel pushed by a producer once it has no more cubes
+
+typedef void (*stage_fn_t)(cube_t *c);
+
+stage_fn_t pipeline_stage_fn[PIPELINE_STAGES] = {
+	solve_green_cross, solve_green_corners, solve_middle_edges, solve_blue_cross, align_blue_corners
+};
+
+const char *pipeline_stage_name[PIPELINE_STAGES] = {
+	"Solve Green Cross", "Solve Green Corners", "Solve Middle Edges", "Solve Blue Cross", "Align Blue Corners"
+};
+
+typedef struct {
+	// consumer side
+	_Alignas(64) atomic_uint head;
+	// producer side, plus the producer's occupancy statistics
+	_Alignas(64) atomic_uint tail;
+	unsigned long pushes;
+	unsigned long depth_sum; // queue depth sampled at every push
+	unsigned int max_depth;
+	unsigned long full_waits; // times the producer found the ring full
+	// read-only after setup
+	_Alignas(64) unsigned int mask;
+	int *slot;
+} spsc_queue_t;
+
+void spsc_init(spsc_queue_t *q, unsigned int capacity)
+{
+	// capacity must be a power of two
+	memset(q, 0, sizeof(spsc_queue_t));
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+	q->mask = capacity - 1;
+	q->slot = malloc(capacity * sizeof(int));
+	if (q->slot == NULL)
+	{
+		printf("Unable to allocate pipeline queue!\n");
+		exit(-1);
+	}
 }
 
-int identify_blue_cross_state(int index)
+void spsc_push(spsc_queue_t *q, int value)
 {
-	// identify if we have an L, a line, or a cross, and which way they are pointing.
-	
-	if ((cube[index].face[UP].tile[0][1] == BLU) && (cube[index].face[UP].tile[1][0] == BLU) && (cube[index].face[UP].tile[1][2] == BLU) && (cube[index].face[UP].tile[2][1] == BLU))
-		return BLUECROSSSTATECROSS;
-	
-	if ((cube[index].face[UP].tile[1][0] == BLU) && (cube[index].face[UP].tile[1][2] == BLU))
-		return BLUECROSSSTATELINEH;
-	
-	if ((cube[index].face[UP].tile[0][1] == BLU) && (cube[index].face[UP].tile[2][1] == BLU))
-		return BLUECROSSSTATELINEV;
+	unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	unsigned int head;
 	
-	if ((cube[index].face[UP].tile[1][0] == BLU) && (cube[index].face[UP].tile[2][1] == BLU))
-		return BLUECROSSSTATELFRONTLEFT;
+	// wait for the consumer to make room
+	while (tail - (head = atomic_load_explicit(&q->head, memory_order_acquire)) > q->mask)
+	{
+		q->full_waits++;
+		sched_yield();
+	}
 	
-	if ((cube[index].face[UP].tile[1][0] == BLU) && (cube[index].face[UP].tile[0][1] == BLU))
-		return BLUECROSSSTATELBACKLEFT;
+	unsigned int depth = tail - head + 1;
+	q->pushes++;
+	q->depth_sum += depth;
+	if (depth > q->max_depth)
+		q->max_depth = depth;
 	
-	if ((cube[index].face[UP].tile[0][1] == BLU) && (cube[index].face[UP].tile[1][2] == BLU))
-		return BLUECROSSSTATELBACKRIGHT;
+	q->slot[tail & q->mask] = value;
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+bool spsc_pop(spsc_queue_t *q, int *value)
+{
+	unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
 	
-	if ((cube[index].face[UP].tile[1][2] == BLU) && (cube[index].face[UP].tile[2][1] == BLU))
-		return BLUECROSSSTATELFRONTRIGHT;
+	if (head == atomic_load_explicit(&q->tail, memory_order_acquire))
+		return false;
 	
-	return BLUECROSSSTATENONE;
+	*value = q->slot[head & q->mask];
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+	return true;
 }
 
-void solve_blue_cross(int index)
+typedef struct {
+	pthread_t thread;
+	int stage;
+	int num_inputs;
+	spsc_queue_t **inputs;
+	int num_outputs; // zero for the last stage
+	spsc_queue_t **outputs;
+	unsigned long cubes;
+	unsigned long idle_waits; // times every input ring was empty
+	move_totals_t totals; // only filled in by the last stage
+} stage_worker_t;
+
+// how full the rings feeding a stage ran, summed over its rings and over every chunk of the batch
+typedef struct {
+	unsigned long pushes;
+	unsigned long depth_sum;
+	unsigned int max_depth;
+	unsigned long full_waits;
+	unsigned long idle_waits;
+} pipeline_stats_t;
+
+void *stage_worker(void *arg)
 {
-	if (LOGGING)
-		printf("solve_blue_cross: solving blue cross:\n");
+	stage_worker_t *w = (stage_worker_t *)arg;
+	int open_inputs = w->num_inputs;
+	int next_input = 0;
+	int next_output = 0;
+	move_totals_t totals;
+	memset(&totals, 0, sizeof(totals));
+	if (record_solutions)
+		create_thread_arena();
 	
-	int bluecrosstype = identify_blue_cross_state(index);
-	while (bluecrosstype != BLUECROSSSTATECROSS)
+	while (open_inputs > 0)
 	{
-		if (LOGGING)
-			printf("solve_blue_cross: found blue cross state to be %d.\n", bluecrosstype);
-		switch (bluecrosstype)
+		// poll our inputs round-robin so no producer starves
+		int index;
+		int from = -1;
+		for (int polled = 0; polled < w->num_inputs; polled++)
 		{
-			case BLUECROSSSTATENONE:
-				abs_rotf(index);
-				abs_rotr(index);
-				abs_rotu(index);
-				abs_rotri(index);
-				abs_rotui(index);
-				abs_rotfi(index);
-				break;
-			case BLUECROSSSTATELFRONTLEFT:
-				abs_rotr(index);
-				abs_rotb(index);
-				abs_rotu(index);
-				abs_rotbi(index);
-				abs_rotui(index);
-				abs_rotri(index);
-				break;
-			case BLUECROSSSTATELBACKLEFT:
-				abs_rotf(index);
-				abs_rotr(index);
-				abs_rotu(index);
-				abs_rotri(index);
-				abs_rotui(index);
-				abs_rotfi(index);
-				break;
-			case BLUECROSSSTATELBACKRIGHT:
-				abs_rotl(index);
-				abs_rotf(index);
-				abs_rotu(index);
-				abs_rotfi(index);
-				abs_rotui(index);
-				abs_rotli(index);
-				break;
-			case BLUECROSSSTATELFRONTRIGHT:
-				abs_rotb(index);
-				abs_rotl(index);
-				abs_rotu(index);
-				abs_rotli(index);
-				abs_rotui(index);
-				abs_rotbi(index);
-				break;
-			case BLUECROSSSTATELINEH:
-				abs_rotf(index);
-				abs_rotr(index);
-				abs_rotu(index);
-				abs_rotri(index);
-				abs_rotui(index);
-				abs_rotfi(index);
-				break;
-			case BLUECROSSSTATELINEV:
-				abs_rotl(index);
-				abs_rotf(index);
-				abs_rotu(index);
-				abs_rotfi(index);
-				abs_rotui(index);
-				abs_rotli(index);
+			int i = next_input;
+			next_input = (next_input + 1) % w->num_inputs;
+			if ((w->inputs[i] != NULL) && spsc_pop(w->inputs[i], &index))
+			{
+				from = i;
 				break;
+			}
+		}
+		if (from < 0)
+		{
+			w->idle_waits++;
+			sched_yield();
+			continue;
 		}
 		
-		// get it again now that we twiddled it
-		bluecrosstype = identify_blue_cross_state(index);
-	}
-	
-	// get the blue/white piece in front and aligned
-	while (locate_2block(index, BLU, WHT) != BLUECROSSFRONT)
-		abs_rotu(index);
-	
-	// get the blu/red piece in it's proper spot on the left
-	while (locate_2block(index, BLU, RED) != BLUECROSSRIGHT)
-	{
-		if (LOGGING)
-			printf("solve_blue_cross: aligning BLU/RED piece.\n");
-		abs_rotr(index);
-		abs_rotu(index);
-		abs_rotri(index);
-		abs_rotu(index);
-		abs_rotr(index);
-		abs_rotu(index);
-		abs_rotu(index);
-		abs_rotri(index);
-	}
-	
-	// if blu/yel and blu/org are in a parity state around the left and back, then we want to
-	// repeat previous algorithm looking at the orange side (blu/white and blu/red facing the adjusted "back right corner")
-	// do this until the white, red, yellow and orange pieces line up in sequence (but not necessarily in the right spots)
-	// the yellow piece will stay put (in it's wrong spot) on the left (orange) side, while the white, red and orange pieces will cascade
-	// around the front, right and back. When they are in order of yellow, orange, white and red (going CCW) starting on the left,
-	// then we will give it one final up-rotation to align them.
-	if ((locate_2block(index, BLU, YEL) == BLUECROSSLEFT) && (locate_2block(index, BLU, ORG) == BLUECROSSBACK))
-	{
-		while ((locate_2block(index, BLU, ORG) != BLUECROSSFRONT) ||
-			   (locate_2block(index, BLU, WHT) != BLUECROSSRIGHT) ||
-			   (locate_2block(index, BLU, RED) != BLUECROSSBACK))
+		if (index == PIPELINE_END)
+		{
+			// that producer is done; stop polling its ring
+			w->inputs[from] = NULL;
+			open_inputs--;
+			continue;
+		}
+		
+		solve_stage(&cube[index], w->stage, pipeline_stage_fn[w->stage], thread_arena, record_solutions ? &solutions[index] : NULL);
+		w->cubes++;
+		
+		if (w->num_outputs > 0)
+		{
+			spsc_push(w->outputs[next_output], index);
+			next_output = (next_output + 1) % w->num_outputs;
+		}
+		else
 		{
 			if (LOGGING)
-				printf("solve_blue_cross: fixing BLU/YEL and BLU/ORG parity.\n");
-			abs_rotf(index);
-			abs_rotu(index);
-			abs_rotfi(index);
-			abs_rotu(index);
-			abs_rotf(index);
-			abs_rotu(index);
-			abs_rotu(index);
-			abs_rotfi(index);
+				show_solved_cube(index);
+			if (optimize_solutions)
+				optimize_solution(&solutions[index], thread_arena);
+			accumulate_moves(&totals, index);
 		}
-		// and one final up-rotation to fix it
-		abs_rotu(index);
 	}
 	
-	cube[index].solveBlueCrossMoves = cube[index].totalMoves - cube[index].solveMiddleEdgesMoves - cube[index].solveGreenCornersMoves - cube[index].solveGreenCrossMoves;
+	// pass the end of stream along to every consumer downstream
+	for (int o = 0; o < w->num_outputs; o++)
+		spsc_push(w->outputs[o], PIPELINE_END);
 	
-	if (LOGGING)
-		printf("solve_blue_cross: solved blue cross.\n");
+	w->totals = totals;
+	return NULL;
 }
 
-bool check_blue_corner_alignment(int index, int corner)
+// Run the batch of the first num_cubes cubes as a five-stage pipeline. The main thread initializes and
+// scrambles cubes and feeds them to the first stage; replicas[s] threads work on stage s. The rings' counts
+// are added to stats.
+void run_pipeline(const int replicas[PIPELINE_STAGES], unsigned int queue_depth, int num_cubes, move_totals_t *totals,
+				  pipeline_stats_t stats[PIPELINE_STAGES])
 {
-	// returns TRUE if the specified corner is aligned properly with all the colors pointing the right way
-	bool retval = false;
+	// queues[s] holds the rings feeding stage s, indexed [producer * replicas[s] + consumer]
+	spsc_queue_t *queues[PIPELINE_STAGES];
+	int producers[PIPELINE_STAGES];
+	stage_worker_t *workers[PIPELINE_STAGES];
 	
-	switch (corner)
+	for (int s = 0; s < PIPELINE_STAGES; s++)
 	{
-		case BLUECORNERFRONTLEFT:
-			if ((cube[index].face[FRONT].tile[0][0] == WHT) && (cube[index].face[LEFT].tile[0][2] == ORG) && (cube[index].face[UP].tile[2][0] == BLU))
-				retval = true;
-			break;
-		case BLUECORNERBACKLEFT:
-			if ((cube[index].face[BACK].tile[0][2] == YEL) && (cube[index].face[LEFT].tile[0][0] == ORG) && (cube[index].face[UP].tile[0][0] == BLU))
-				retval = true;
-			break;
-		case BLUECORNERBACKRIGHT:
-			if ((cube[index].face[BACK].tile[0][0] == YEL) && (cube[index].face[RIGHT].tile[0][2] == RED) && (cube[index].face[UP].tile[0][2] == BLU))
-				retval = true;
-			break;
-		case BLUECORNERFRONTRIGHT:
-			if ((cube[index].face[FRONT].tile[0][2] == WHT) && (cube[index].face[RIGHT].tile[0][0] == RED) && (cube[index].face[UP].tile[2][2] == BLU))
-				retval = true;
-			break;
+		producers[s] = (s == 0) ? 1 : replicas[s - 1];
+		// calloc doesn't honour the rings' cache line alignment, which keeps head and tail apart
+		queues[s] = aligned_alloc(64, producers[s] * replicas[s] * sizeof(spsc_queue_t));
+		workers[s] = calloc(replicas[s], sizeof(stage_worker_t));
+		if ((queues[s] == NULL) || (workers[s] == NULL))
+		{
+			printf("Unable to allocate pipeline!\n");
+			exit(-1);
+		}
+		memset(queues[s], 0, producers[s] * replicas[s] * sizeof(spsc_queue_t));
+		for (int q = 0; q < producers[s] * replicas[s]; q++)
+			spsc_init(&queues[s][q], queue_depth);
 	}
-	return retval;
-}
-
-bool check_working_corner_alignment(int index, int working_corner, int piece_of_interest)
-{
-	// this function checks corner working_corner for a proper alignment of piece_of_interest, as the top later
-	// is rotated during the final solve. piece_of_interest is the corner where the proper color normally resides.
-	// for instance, if we call this function with working_corner = BLUECORNERFRONTLEFT and piece_of_interest is
-	// BLUECORNERBACKRIGHT, it will check the front-left corner for a proper alignment of the red/yellow/blue piece,
-	// if it were rotated into position into the front-left corner.
-	
-	// returns TRUE if the specified corner is aligned properly with all the colors pointing the right way
-	bool retval = false;
 	
-	switch (working_corner)
+	// wire each replica to its input rings and to its output rings in the next stage
+	for (int s = 0; s < PIPELINE_STAGES; s++)
 	{
-		case BLUECORNERFRONTLEFT:
-			switch (piece_of_interest)
-			{
-				case BLUECORNERFRONTLEFT:
-					if ((cube[index].face[FRONT].tile[0][0] == WHT) && (cube[index].face[LEFT].tile[0][2] == ORG) && (cube[index].face[UP].tile[2][0] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERBACKLEFT:
-					if ((cube[index].face[FRONT].tile[0][0] == ORG) && (cube[index].face[LEFT].tile[0][2] == YEL) && (cube[index].face[UP].tile[2][0] == BLU))
-						retval = true;
-					break;					
-				case BLUECORNERBACKRIGHT:
-					if ((cube[index].face[FRONT].tile[0][0] == YEL) && (cube[index].face[LEFT].tile[0][2] == RED) && (cube[index].face[UP].tile[2][0] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERFRONTRIGHT:
-					if ((cube[index].face[FRONT].tile[0][0] == RED) && (cube[index].face[LEFT].tile[0][2] == WHT) && (cube[index].face[UP].tile[2][0] == BLU))
-						retval = true;
-					break;					
-			}
-			break;
-		case BLUECORNERBACKLEFT:
-			switch (piece_of_interest)
-			{
-				case BLUECORNERFRONTLEFT:
-					if ((cube[index].face[BACK].tile[0][2] == ORG) && (cube[index].face[LEFT].tile[0][0] == WHT) && (cube[index].face[UP].tile[0][0] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERBACKLEFT:
-					if ((cube[index].face[BACK].tile[0][2] == YEL) && (cube[index].face[LEFT].tile[0][0] == ORG) && (cube[index].face[UP].tile[0][0] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERBACKRIGHT:
-					if ((cube[index].face[BACK].tile[0][2] == RED) && (cube[index].face[LEFT].tile[0][0] == YEL) && (cube[index].face[UP].tile[0][0] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERFRONTRIGHT:
-					if ((cube[index].face[BACK].tile[0][2] == WHT) && (cube[index].face[LEFT].tile[0][0] == RED) && (cube[index].face[UP].tile[0][0] == BLU))
-						retval = true;
-					break;
-			}
-			break;
-		case BLUECORNERBACKRIGHT:
-			switch (piece_of_interest)
+		for (int r = 0; r < replicas[s]; r++)
+		{
+			stage_worker_t *w = &workers[s][r];
+			w->stage = s;
+			w->num_inputs = producers[s];
+			w->inputs = calloc(producers[s], sizeof(spsc_queue_t *));
+			for (int p = 0; p < producers[s]; p++)
+				w->inputs[p] = &queues[s][p * replicas[s] + r];
+			w->num_outputs = (s + 1 < PIPELINE_STAGES) ? replicas[s + 1] : 0;
+			w->outputs = calloc(w->num_outputs + 1, sizeof(spsc_queue_t *));
+			for (int c = 0; c < w->num_outputs; c++)
+				w->outputs[c] = &queues[s + 1][r * replicas[s + 1] + c];
+			if ((w->inputs == NULL) || (w->outputs == NULL))
 			{
-				case BLUECORNERFRONTLEFT:
-					if ((cube[index].face[BACK].tile[0][0] == WHT) && (cube[index].face[RIGHT].tile[0][2] == ORG) && (cube[index].face[UP].tile[0][2] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERBACKLEFT:
-					if ((cube[index].face[BACK].tile[0][0] == ORG) && (cube[index].face[RIGHT].tile[0][2] == YEL) && (cube[index].face[UP].tile[0][2] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERBACKRIGHT:
-					if ((cube[index].face[BACK].tile[0][0] == YEL) && (cube[index].face[RIGHT].tile[0][2] == RED) && (cube[index].face[UP].tile[0][2] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERFRONTRIGHT:
-					if ((cube[index].face[BACK].tile[0][0] == RED) && (cube[index].face[RIGHT].tile[0][2] == WHT) && (cube[index].face[UP].tile[0][2] == BLU))
-						retval = true;
-					break;
+				printf("Unable to allocate pipeline!\n");
+				exit(-1);
 			}
-			break;
-		case BLUECORNERFRONTRIGHT:
-			switch (piece_of_interest)
+			if (pthread_create(&w->thread, NULL, stage_worker, w) != 0)
 			{
-				case BLUECORNERFRONTLEFT:
-					if ((cube[index].face[FRONT].tile[0][2] == ORG) && (cube[index].face[RIGHT].tile[0][0] == WHT) && (cube[index].face[UP].tile[2][2] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERBACKLEFT:
-					if ((cube[index].face[FRONT].tile[0][2] == YEL) && (cube[index].face[RIGHT].tile[0][0] == ORG) && (cube[index].face[UP].tile[2][2] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERBACKRIGHT:
-					if ((cube[index].face[FRONT].tile[0][2] == RED) && (cube[index].face[RIGHT].tile[0][0] == YEL) && (cube[index].face[UP].tile[2][2] == BLU))
-						retval = true;
-					break;
-				case BLUECORNERFRONTRIGHT:
-					if ((cube[index].face[FRONT].tile[0][2] == WHT) && (cube[index].face[RIGHT].tile[0][0] == RED) && (cube[index].face[UP].tile[2][2] == BLU))
-						retval = true;
-					break;
+				printf("Unable to create pipeline thread for stage %d!\n", s);
+				exit(-1);
 			}
-			break;
+		}
+	}
+	
+	// feed the first stage round-robin, a block of scrambled cubes at a time
+	for (int i = 0; i < num_cubes; i += SOA_WIDTH)
+	{
+		int count = (num_cubes - i < SOA_WIDTH) ? num_cubes - i : SOA_WIDTH;
+		if (mapped_states != NULL)
+			load_mapped_cubes(i, count);
+		else if (!input_cubes)
+			scramble_cubes(i, count);
+		for (int j = i; j < i + count; j++)
+		{
+			if (piece_index)
+				index_pieces(&cube[j]);
+			spsc_push(&queues[0][j % replicas[0]], j);
+		}
+	}
+	for (int r = 0; r < replicas[0]; r++)
+		spsc_push(&queues[0][r], PIPELINE_END);
+	
+	for (int s = 0; s < PIPELINE_STAGES; s++)
+		for (int r = 0; r < replicas[s]; r++)
+			pthread_join(workers[s][r].thread, NULL);
+	
+	for (int r = 0; r < replicas[PIPELINE_STAGES - 1]; r++)
+		reduce_moves(totals, &workers[PIPELINE_STAGES - 1][r].totals);
+	
+	for (int s = 0; s < PIPELINE_STAGES; s++)
+	{
+		for (int q = 0; q < producers[s] * replicas[s]; q++)
+		{
+			stats[s].pushes += queues[s][q].pushes;
+			stats[s].depth_sum += queues[s][q].depth_sum;
+			stats[s].full_waits += queues[s][q].full_waits;
+			if (queues[s][q].max_depth > stats[s].max_depth)
+				stats[s].max_depth = queues[s][q].max_depth;
+		}
+		for (int r = 0; r < replicas[s]; r++)
+			stats[s].idle_waits += workers[s][r].idle_waits;
+	}
+	
+	for (int s = 0; s < PIPELINE_STAGES; s++)
+	{
+		for (int q = 0; q < producers[s] * replicas[s]; q++)
+			free(queues[s][q].slot);
+		for (int r = 0; r < replicas[s]; r++)
+		{
+			free(workers[s][r].inputs);
+			free(workers[s][r].outputs);
+		}
+		free(queues[s]);
+		free(workers[s]);
 	}
-	return retval;
 }
 
-void align_blue_corners(int index)
+// Streaming Input
+// With --input, cube states are read as facelet strings, one cube per line: the 54 tile colors as BYOWRG
+// letters, face by face in the order UP, BACK, LEFT, FRONT, RIGHT, DOWN, each row by row as show_cube draws
+// it. Spaces are ignored and blank lines and # comments skipped. The cube array is used as a window: up to
+// a chunk of cubes is read, solved by the threaded or pipeline machinery, and their solutions written in input
+// order before the next chunk is read, so memory stays bounded whatever the size of the input.
+
+// Parse a facelet string into a cube's facelets; returns false unless it's a legal, solvable cube
+bool parse_facelets(const char *line, unsigned char *facelet)
 {
-	if (LOGGING)
-		printf("align_blue_corners: aligning blue corners:\n");
-	
-	// repeat the corner alignment algorithm until we have at least one corner piece in the right spot (although not necessarily flipped the right way)
-	while (!((locate_3block(index, BLU, WHT, ORG) == BLUECORNERFRONTLEFT) ||
-		   (locate_3block(index, BLU, YEL, ORG) == BLUECORNERBACKLEFT) ||
-		   (locate_3block(index, BLU, YEL, RED) == BLUECORNERBACKRIGHT) ||
-		   (locate_3block(index, BLU, WHT, RED) == BLUECORNERFRONTRIGHT)))
+	int n = 0;
+	for (const char *p = line; (*p != '\0') && (*p != '\n') && (*p != '\r'); p++)
 	{
-		if (LOGGING)
-			printf("align_blue_corners: no corners aligned; trying to get initial corner piece aligned\n");
-		abs_rotu(index);
-		abs_rotr(index);
-		abs_rotui(index);
-		abs_rotli(index);
-		abs_rotu(index);
-		abs_rotri(index);
-		abs_rotui(index);
-		abs_rotl(index);
+		if ((*p == ' ') || (*p == '\t'))
+			continue;
+		const char *color = strchr(colors, *p);
+		if ((color == NULL) || (n == NUM_FACELETS))
+			return false;
+		facelet[n++] = color - colors;
 	}
 	
-	// now, at least one of the corners is in the right spot. take a walk around the top of the cube and find one.
-	int good_corner = -1;
-	
-	if (locate_3block(index, BLU, WHT, ORG) == BLUECORNERFRONTLEFT)
-		good_corner = BLUECORNERFRONTLEFT;
-	else if (locate_3block(index, BLU, YEL, ORG) == BLUECORNERBACKLEFT)
-		good_corner = BLUECORNERBACKLEFT;
-	else if (locate_3block(index, BLU, YEL, RED) == BLUECORNERBACKRIGHT)
-		good_corner = BLUECORNERBACKRIGHT;
-	else if (locate_3block(index, BLU, WHT, RED) == BLUECORNERFRONTRIGHT)
-		good_corner = BLUECORNERFRONTRIGHT;
+	cubie_t check;
+	return (n == NUM_FACELETS) && facelets_to_cubie(facelet, &check);
+}
+
+// Read up to a chunk of cubes from in into the cube array; returns how many were read
+int read_cubes(FILE *in, long *line_number)
+{
+	static char *line = NULL;
+	static size_t line_size = 0;
+	int count = 0;
 	
-	// repeat corner alignment again, this time with the good corner in the front right while facing the appropriate side
-	// do it until all four corners are in the right spots
-	while (!((locate_3block(index, BLU, WHT, ORG) == BLUECORNERFRONTLEFT) &&
-			 (locate_3block(index, BLU, YEL, ORG) == BLUECORNERBACKLEFT) &&
-			 (locate_3block(index, BLU, YEL, RED) == BLUECORNERBACKRIGHT) &&
-			 (locate_3block(index, BLU, WHT, RED) == BLUECORNERFRONTRIGHT)))
+	while ((count < cube_capacity) && (getline(&line, &line_size, in) != -1))
 	{
-		if (LOGGING)
-			printf("align_blue_corners: trying to get corner pieces in the right spots\n");
-		switch (good_corner)
+		(*line_number)++;
+		const char *p = line + strspn(line, " \t\r\n");
+		if ((*p == '\0') || (*p == '#'))
+			continue;
+		
+		cube_invalid[count] = !parse_facelets(p, cube[count].facelet);
+		if (cube_invalid[count])
 		{
-			case BLUECORNERFRONTLEFT:
-				abs_rotu(index);
-				abs_rotf(index);
-				abs_rotui(index);
-				abs_rotbi(index);
-				abs_rotu(index);
-				abs_rotfi(index);
-				abs_rotui(index);
-				abs_rotb(index);
-				break;
-			case BLUECORNERBACKLEFT:
-				abs_rotu(index);
-				abs_rotl(index);
-				abs_rotui(index);
-				abs_rotri(index);
-				abs_rotu(index);
-				abs_rotli(index);
-				abs_rotui(index);
-				abs_rotr(index);
-				break;
-			case BLUECORNERBACKRIGHT:
-				abs_rotu(index);
-				abs_rotb(index);
-				abs_rotui(index);
-				abs_rotfi(index);
-				abs_rotu(index);
-				abs_rotbi(index);
-				abs_rotui(index);
-				abs_rotf(index);
-				break;
-			case BLUECORNERFRONTRIGHT:
-				abs_rotu(index);
-				abs_rotr(index);
-				abs_rotui(index);
-				abs_rotli(index);
-				abs_rotu(index);
-				abs_rotri(index);
-				abs_rotui(index);
-				abs_rotl(index);
-				break;
+			fprintf(stderr, "Line %ld is not a solvable cube!\n", *line_number);
+			init_cube(&cube[count]);
 		}
+		cube[count].totalMoves = 0;
+		cube[count].solveGreenCrossMoves = 0;
+		cube[count].solveGreenCornersMoves = 0;
+		cube[count].solveMiddleEdgesMoves = 0;
+		cube[count].solveBlueCrossMoves = 0;
+		cube[count].alignBlueCornersMoves = 0;
+		count++;
+	}
+	return count;
+}
+
+// Library API
+// rubiks.h exposes the solver for linking into other programs (make lib builds librubiks.a and librubiks.so,
+// without main). Everything the solver touches is reached through the cube_t, arena and solution_t it's
+// handed; the tables init_solver builds are read-only afterwards, so any number of threads can solve their
+// own cubes at once.
+pthread_once_t solver_once = PTHREAD_ONCE_INIT;
+
+void init_solver_tables(void)
+{
+	init_move_tables();
+	init_macro_moves();
+	init_move_kernel();
+	init_cubie_tables();
+	init_locate_tables();
+}
+
+void init_solver(void)
+{
+	pthread_once(&solver_once, init_solver_tables);
+}
+
+bool load_cube(cube_t *c, const char *facelets)
+{
+	memset(c, 0, sizeof(cube_t));
+	return parse_facelets(facelets, c->facelet);
+}
+
+// Microbenchmark the move kernels: apply the same stream of moves to a small set of cubes with each kernel,
+// report ns/move and check the kernels agree with the scalar one
+#define BENCH_CUBES 256
+#define BENCH_MOVE_LIST 4096
+
+void bench_move_kernels(long moves)
+{
+	cube_t *bench = malloc(2 * BENCH_CUBES * sizeof(cube_t));
+	unsigned char *move_list = malloc(BENCH_MOVE_LIST);
+	if ((bench == NULL) || (move_list == NULL))
+	{
+		printf("Unable to allocate benchmark cubes!\n");
+		exit(-1);
 	}
+	cube_t *reference = bench + BENCH_CUBES;
 	
-	// find out how many, and which blue corners, are twiddled
-	int bad_corners[4]; // array to hold corner tags
-	int num_bad_corners = -1; // zero based
-	for (int i = BLUECORNERFRONTLEFT; i <= BLUECORNERFRONTRIGHT; i++)
+	rng_t rng;
+	rng_seed(&rng, scramble_seed, 0);
+	for (int i = 0; i < BENCH_MOVE_LIST; i++)
+		move_list[i] = rng_below(&rng, 12);
+	
+	printf("Benchmarking %ld moves per kernel over %d cubes:\n", moves, BENCH_CUBES);
+	for (int k = 0; k < NUM_MOVE_KERNELS; k++)
 	{
-		if (!check_blue_corner_alignment(index, i))
+		if (!move_kernels[k].supported)
 		{
-			num_bad_corners++;
-			bad_corners[num_bad_corners] = i;
+			printf("--> %-6s: not supported on this CPU.\n", move_kernels[k].name);
+			continue;
 		}
+		
+		// every cube starts out labelled with its facelet positions
+		memset(bench, 0, BENCH_CUBES * sizeof(cube_t));
+		for (int c = 0; c < BENCH_CUBES; c++)
+			for (int i = 0; i < NUM_FACELETS; i++)
+				bench[c].facelet[i] = i;
+		
+		move_kernel_t fn = move_kernels[k].fn;
+		struct timeval start_time, end_time;
+		gettimeofday(&start_time, NULL);
+		for (long i = 0; i < moves; i++)
+			fn(bench[i % BENCH_CUBES].facelet, move_list[i % BENCH_MOVE_LIST]);
+		gettimeofday(&end_time, NULL);
+		
+		double usecs = (double)(end_time.tv_sec - start_time.tv_sec) * 1000000.0 + (double)(end_time.tv_usec - start_time.tv_usec);
+		bool agrees = true;
+		if (k == 0)
+			memcpy(reference, bench, BENCH_CUBES * sizeof(cube_t));
+		else
+			agrees = (memcmp(reference, bench, BENCH_CUBES * sizeof(cube_t)) == 0);
+		printf("--> %-6s: %.2f ns/move%s%s\n", move_kernels[k].name, usecs * 1000.0 / (double)moves,
+			   agrees ? "" : " (DISAGREES WITH SCALAR!)", (move_kernels[k].fn == move_kernel) ? " (selected)" : "");
 	}
 	
-	if (LOGGING)
+	// lockstep: replay 64 move slices of the same stream on whole blocks, and check a few lanes against the
+	// scalar kernel
+	int num_blocks = BENCH_CUBES / SOA_WIDTH;
+	soa_block_t *blocks = aligned_alloc(64, num_blocks * sizeof(soa_block_t)); // the row loops need its alignment
+	if (blocks == NULL)
 	{
-		printf("align_blue_corners: %d twiddled blue corners.\n", num_bad_corners + 1);
-		for (int i = 0; i <= num_bad_corners; i++)
-			printf("align_blue_corners: --> corner %d is twiddled.\n", bad_corners[i]);
+		printf("Unable to allocate benchmark blocks!\n");
+		exit(-1);
 	}
+	for (int b = 0; b < num_blocks; b++)
+		soa_init_solved(&blocks[b], SOA_WIDTH);
 	
-	// if there are no twiddled corners, the puzzle is solved! however, if there are,
-	// enter our "final solution" loop
-	if (num_bad_corners > -1)
+	long slices = moves / SOA_WIDTH / SOA_WIDTH;
+	if (slices < 1)
+		slices = 1;
+	struct timeval start_time, end_time;
+	gettimeofday(&start_time, NULL);
+	for (long s = 0; s < slices; s++)
+		soa_apply_sequence(&blocks[s % num_blocks], move_list + (s * SOA_WIDTH) % BENCH_MOVE_LIST, SOA_WIDTH, ~0ULL);
+	gettimeofday(&end_time, NULL);
+	
+	for (int b = 0; b < num_blocks; b++)
 	{
-		// look at the side face with the first twiddled corner in the top right.
-		// do a series rdRD's until the corner is untwiddled.
-		// advance to the next twiddled corner (still looking at the first side face) by rotating up-inverted until the next
-		// twiddled face is in the top right. continue doing this until we are out of twiddled corners.
-		
-		// find out which way to look
-		int look_at;
-		switch (bad_corners[0])
+		for (int i = 0; i < NUM_FACELETS; i++)
+			reference[b].facelet[i] = i / 9;
+		for (long s = b; s < slices; s += num_blocks)
+			for (int i = 0; i < SOA_WIDTH; i++)
+				move_kernel_scalar(reference[b].facelet, move_list[(s * SOA_WIDTH + i) % BENCH_MOVE_LIST]);
+	}
+	bool agrees = true;
+	for (int b = 0; b < num_blocks; b++)
+		for (int i = 0; i < NUM_FACELETS; i++)
+			if ((blocks[b].row[i][0] != reference[b].facelet[i]) || (blocks[b].row[i][SOA_WIDTH - 1] != reference[b].facelet[i]))
+				agrees = false;
+	
+	double usecs = (double)(end_time.tv_sec - start_time.tv_sec) * 1000000.0 + (double)(end_time.tv_usec - start_time.tv_usec);
+	printf("--> %-6s: %.2f ns/move per cube, %d cubes per move%s\n", "lockstep", usecs * 1000.0 / (double)(slices * SOA_WIDTH * SOA_WIDTH),
+		   SOA_WIDTH, agrees ? "" : " (DISAGREES WITH SCALAR!)");
+	
+	free(blocks);
+	free(move_list);
+	free(bench);
+}
+
+#ifndef RUBIKS_LIBRARY
+void usage(const char *progname)
+{
+	printf("usage: %s [options]\n", progname);
+	printf("  -n, --cubes N         scramble and solve N cubes (default %d)\n", NUM_CUBES);
+	printf("  -c, --chunk N         hold N cubes in memory at once, solving the batch or input a chunk at a time\n");
+	printf("                        (default %d, or --cubes if fewer)\n", CUBE_CHUNK);
+	printf("  -t, --threads N       solve the batch on N threads (0 = one per online CPU, default 1)\n");
+	printf("  -p, --pipeline        solve the batch as a five-stage pipeline, one thread per stage replica (ignores --threads)\n");
+	printf("  -r, --replicas LIST   comma separated replica count for each pipeline stage (default 1,1,1,1,1)\n");
+	printf("  -q, --queue-depth N   capacity of each pipeline ring, rounded up to a power of two (default 64)\n");
+	printf("  -k, --kernel NAME     force the move kernel: scalar, ssse3, avx2 or vbmi (default: best the CPU supports)\n");
+	printf("  -l, --lockstep        scramble cubes %d at a time in structure-of-arrays blocks\n", SOA_WIDTH);
+	printf("  -u, --uniform         scramble by drawing uniformly random states instead of 40 random moves (ignores --lockstep)\n");
+	printf("  -x, --index           keep an index of every cube's pieces, updated by each move, so they're found by lookup\n");
+	printf("  -G, --green-cross     solve the green cross in the fewest moves from a table of the cross edges; the table is\n");
+	printf("                        built by breadth first search at startup, which adds milliseconds before the first cube\n");
+	printf("  -L, --last-layer      finish the blue cross and blue corners from a precomputed table of the top layer\n");
+	printf("  -e, --engine NAME     solve with the layers method (default), two-phase (Kociemba's two-phase algorithm) or\n");
+	printf("                        optimal (fewest face turns, each cube searched on --threads threads)\n");
+	printf("  -T, --target N        two-phase: stop looking for shorter solutions once one is N moves or fewer (default %u)\n",
+		   two_phase_target);
+	printf("  -F, --fast-path N     first look for an optimal solution within N moves (1-%d), from both ends at once\n", MAX_FAST_PATH);
+	printf("  -P, --tables DIR      keep the last layer, two-phase, optimal and window tables in DIR: build and save them\n");
+	printf("                        the first time, map them from there after that\n");
+	printf("  -g, --batched         solve each block stage by stage, turning cubes that need the same sequence together\n");
+	printf("  -s, --solutions FILE  record every cube's solution and write them to FILE, one per line (- for stdout)\n");
+	printf("  -o, --optimize        record solutions and run the peephole optimizer over them; --solutions writes the optimized ones\n");
+	printf("  -w, --window N        also replace stretches of solutions by shortest sequences of up to N moves (1-%d), implies --optimize\n", MAX_WINDOW_DEPTH);
+	printf("  -i, --input FILE      solve the facelet strings in FILE (- for stdin), one cube per line, instead of scrambles;\n");
+	printf("                        solutions go to --solutions, or stdout\n");
+	printf("  -m, --states FILE     solve the cubes in binary states FILE; solutions go to --solutions FILE in binary\n");
+	printf("  -M, --make-states N   write N scrambled cubes to the --states FILE, then exit\n");
+	printf("  -d, --dump FILE       print the binary solutions in FILE as text, then exit\n");
+	printf("  -b, --bench-moves N   time N moves with each move kernel and in lockstep, then exit\n");
+	printf("  -S, --seed N          seed the scrambles, so cube i of every run with seed N gets the same one (default: the clock)\n");
+	printf("  -h, --help            show this help\n");
+}
+
+int main (int argc, char * const argv[])
+{
+	long num_cubes = NUM_CUBES;
+	int chunk = 0;
+	int num_threads = 1;
+	bool pipeline = false;
+	int replicas[PIPELINE_STAGES] = { 1, 1, 1, 1, 1 };
+	unsigned int queue_depth = 64;
+	const char *kernel = NULL;
+	const char *solutions_path = NULL;
+	const char *input_path = NULL;
+	const char *states_path = NULL;
+	const char *dump_path = NULL;
+	long make_states = 0;
+	int window = 0;
+	long bench_moves = 0;
+	bool seeded = false;
+	
+	static struct option long_options[] = {
+		{ "cubes", required_argument, NULL, 'n' },
+		{ "chunk", required_argument, NULL, 'c' },
+		{ "threads", required_argument, NULL, 't' },
+		{ "pipeline", no_argument, NULL, 'p' },
+		{ "replicas", required_argument, NULL, 'r' },
+		{ "queue-depth", required_argument, NULL, 'q' },
+		{ "kernel", required_argument, NULL, 'k' },
+		{ "lockstep", no_argument, NULL, 'l' },
+		{ "batched", no_argument, NULL, 'g' },
+		{ "solutions", required_argument, NULL, 's' },
+		{ "optimize", no_argument, NULL, 'o' },
+		{ "window", required_argument, NULL, 'w' },
+		{ "input", required_argument, NULL, 'i' },
+		{ "states", required_argument, NULL, 'm' },
+		{ "make-states", required_argument, NULL, 'M' },
+		{ "dump", required_argument, NULL, 'd' },
+		{ "bench-moves", required_argument, NULL, 'b' },
+		{ "uniform", no_argument, NULL, 'u' },
+		{ "index", no_argument, NULL, 'x' },
+		{ "green-cross", no_argument, NULL, 'G' },
+		{ "last-layer", no_argument, NULL, 'L' },
+		{ "engine", required_argument, NULL, 'e' },
+		{ "target", required_argument, NULL, 'T' },
+		{ "tables", required_argument, NULL, 'P' },
+		{ "fast-path", required_argument, NULL, 'F' },
+		{ "seed", required_argument, NULL, 'S' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	
+	int opt;
+	while ((opt = getopt_long(argc, argv, "n:c:t:pr:q:k:luxGLe:T:P:F:gs:ow:i:m:M:d:b:S:h", long_options, NULL)) != -1)
+	{
+		switch (opt)
 		{
-			case BLUECORNERFRONTLEFT:
-				look_at = LEFT;
+			case 'n':
+				num_cubes = atol(optarg);
+				if (num_cubes < 1)
+				{
+					printf("Cube count must be positive!\n");
+					exit(-1);
+				}
 				break;
-			case BLUECORNERBACKLEFT:
-				look_at = BACK;
+			case 'c':
+				chunk = atoi(optarg);
+				if (chunk < 1)
+				{
+					printf("Chunk size must be positive!\n");
+					exit(-1);
+				}
 				break;
-			case BLUECORNERBACKRIGHT:
-				look_at = RIGHT;
+			case 't':
+				num_threads = atoi(optarg);
+				if (num_threads < 0)
+				{
+					printf("Thread count must not be negative!\n");
+					exit(-1);
+				}
 				break;
-			case BLUECORNERFRONTRIGHT:
-				look_at = FRONT;
+			case 'p':
+				pipeline = true;
 				break;
-		}
-		
-		for (int i = 0; i <= num_bad_corners; i++)
-		{
-			if (LOGGING)
-			{
-				printf("align_blue_corners: fixing twiddle on corner %d.\n", bad_corners[i]);
-			}
-			
-			// rdRD the working corner (bad_corners[0]) until it's in proper alignment
-			while (!check_working_corner_alignment(index, bad_corners[0], bad_corners[i]))
+			case 'r':
 			{
-				switch (look_at)
+				char *p = optarg;
+				for (int s = 0; s < PIPELINE_STAGES; s++)
 				{
-					case LEFT:
-						abs_rotfi(index);
-						abs_rotdi(index);
-						abs_rotf(index);
-						abs_rotd(index);
-						break;
-					case BACK:
-						abs_rotli(index);
-						abs_rotdi(index);
-						abs_rotl(index);
-						abs_rotd(index);
-						break;
-					case RIGHT:
-						abs_rotbi(index);
-						abs_rotdi(index);
-						abs_rotb(index);
-						abs_rotd(index);
-						break;
-					case FRONT:
-						abs_rotri(index);
-						abs_rotdi(index);
-						abs_rotr(index);
-						abs_rotd(index);
-						break;
+					replicas[s] = (int)strtol(p, &p, 10);
+					if ((replicas[s] < 1) || ((s < PIPELINE_STAGES - 1) && (*p++ != ',')))
+					{
+						printf("--replicas needs %d positive counts separated by commas!\n", PIPELINE_STAGES);
+						exit(-1);
+					}
 				}
+				if (*p != '\0')
+				{
+					printf("--replicas needs %d positive counts separated by commas!\n", PIPELINE_STAGES);
+					exit(-1);
+				}
+				break;
 			}
-			
-			// if bad corners remain, rotate up-inverted (the next corner # - the current corner #) times.
-			if (i < num_bad_corners)
+			case 'q':
 			{
-				for (int j = bad_corners[i]; j < bad_corners[i + 1]; j++)
-					abs_rotui(index);
+				int depth = atoi(optarg);
+				if (depth < 1)
+				{
+					printf("Queue depth must be positive!\n");
+					exit(-1);
+				}
+				for (queue_depth = 1; queue_depth < (unsigned int)depth; queue_depth <<= 1)
+					;
+				break;
 			}
-		} // for int i = 0 to <= num_bad_corners
-		
-		// if the top layers is shifted, fix it
-		while (cube[index].face[FRONT].tile[0][1] != WHT)
-			abs_rotu(index);
-	} // if num_bad_corners > -1
+			case 'k':
+				kernel = optarg;
+				break;
+			case 'l':
+				lockstep = true;
+				break;
+			case 'u':
+				uniform_scrambles = true;
+				break;
+			case 'x':
+				piece_index = true;
+				break;
+			case 'G':
+				green_cross_table = true;
+				break;
+			case 'L':
+				last_layer_table = true;
+				break;
+			case 'e':
+				if (strcmp(optarg, "layers") == 0)
+					solve_engine = ENGINE_LAYERS;
+				else if (strcmp(optarg, "two-phase") == 0)
+					solve_engine = ENGINE_TWO_PHASE;
+				else if (strcmp(optarg, "optimal") == 0)
+					solve_engine = ENGINE_OPTIMAL;
+				else
+				{
+					printf("Unknown engine %s!\n", optarg);
+					exit(-1);
+				}
+				break;
+			case 'T':
+				if (atoi(optarg) < 1)
+				{
+					printf("Target length must be positive!\n");
+					exit(-1);
+				}
+				two_phase_target = atoi(optarg);
+				break;
+			case 'P':
+				use_table_dir(optarg);
+				break;
+			case 'F':
+				fast_path_depth = atoi(optarg);
+				if ((fast_path_depth < 1) || (fast_path_depth > MAX_FAST_PATH))
+				{
+					printf("Fast path depth must be between 1 and %d!\n", MAX_FAST_PATH);
+					exit(-1);
+				}
+				break;
+			case 'g':
+				batched = true;
+				break;
+			case 's':
+				solutions_path = optarg;
+				record_solutions = true;
+				break;
+			case 'o':
+				optimize_solutions = true;
+				record_solutions = true;
+				break;
+			case 'w':
+				window = atoi(optarg);
+				if ((window < 1) || (window > MAX_WINDOW_DEPTH))
+				{
+					printf("Window depth must be between 1 and %d!\n", MAX_WINDOW_DEPTH);
+					exit(-1);
+				}
+				optimize_solutions = true;
+				record_solutions = true;
+				break;
+			case 'i':
+				input_path = optarg;
+				streaming = true;
+				input_cubes = true;
+				record_solutions = true;
+				break;
+			case 'm':
+				states_path = optarg;
+				break;
+			case 'M':
+				make_states = atol(optarg);
+				if (make_states < 1)
+				{
+					printf("Cube count must be positive!\n");
+					exit(-1);
+				}
+				break;
+			case 'd':
+				dump_path = optarg;
+				break;
+			case 'b':
+				bench_moves = atol(optarg);
+				if (bench_moves < 1)
+				{
+					printf("Benchmark move count must be positive!\n");
+					exit(-1);
+				}
+				break;
+			case 'S':
+				scramble_seed = strtoull(optarg, NULL, 0);
+				seeded = true;
+				break;
+			case 'h':
+				usage(argv[0]);
+				return 0;
+			default:
+				usage(argv[0]);
+				exit(-1);
+		}
+	}
 	
-	cube[index].alignBlueCornersMoves = cube[index].totalMoves - cube[index].solveBlueCrossMoves - cube[index].solveMiddleEdgesMoves - cube[index].solveGreenCornersMoves - cube[index].solveGreenCrossMoves;
+	if (batched && pipeline)
+	{
+		printf("--batched runs whole stages per block and can't be combined with --pipeline!\n");
+		exit(-1);
+	}
+	if ((fast_path_depth > 0) && (batched || pipeline))
+	{
+		printf("--fast-path solves whole cubes and can't be combined with --batched or --pipeline!\n");
+		exit(-1);
+	}
+	if ((solve_engine != ENGINE_LAYERS) && (batched || pipeline))
+	{
+		printf("The %s engine has no stages to batch or pipeline!\n", (solve_engine == ENGINE_TWO_PHASE) ? "two-phase" : "optimal");
+		exit(-1);
+	}
+	if (num_threads == 0)
+		num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads < 1)
+		num_threads = 1;
+	if (solve_engine == ENGINE_OPTIMAL)
+	{
+		// the threads go to each cube's search; cubes are taken one at a time
+		optimal_threads = num_threads;
+		num_threads = 1;
+	}
 	
-	if (LOGGING)
-		printf("align_blue_corners: aligned blue corners and solved cube.\n");
-}
-
-// Initialize a cube
-void init_cube(int index)
-{
-	// clear the faces
-	for (int i = 0; i < 6; i++)
-		for (int j = 0; j < 3; j++)
-			for (int k = 0; k < 3; k++)
-				cube[index].face[i].tile[j][k] = i;	
-}
-
-// Scramble
-void scramble_cube(int index)
-{
-	if (LOGGING)
-		printf("scramble_cube:\n");
+	// setup
+	if (!seeded)
+	{
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		scramble_seed = ((uint64_t)now.tv_sec << 20) ^ (uint64_t)now.tv_usec ^ ((uint64_t)getpid() << 40);
+	}
+	init_solver();
+	init_lane_bytes();
+	init_batch_programs();
+	if (green_cross_table)
+	{
+		init_green_cross_table();
+		stage_programs[0] = green_cross_table_program;
+	}
+	if (last_layer_table)
+	{
+		init_last_layer_table();
+		stage_programs[3] = last_layer_cross_program;
+		stage_programs[4] = last_layer_corners_program;
+	}
+	if (solve_engine == ENGINE_TWO_PHASE)
+		init_two_phase();
+	if (solve_engine == ENGINE_OPTIMAL)
+		init_optimal();
+	if ((kernel != NULL) && !select_move_kernel(kernel))
+	{
+		printf("Move kernel %s is unknown or not supported on this CPU!\n", kernel);
+		exit(-1);
+	}
 	
-	// 40 random moves
-	for (int i = 0; i < 40; i++)
-		abs_rot_indrot(index, random() % 12);
+	// scrambles only need as many slots as there are cubes; input of unknown length gets a full chunk
+	if (chunk == 0)
+		chunk = (!streaming && (states_path == NULL) && (num_cubes < CUBE_CHUNK)) ? (int)num_cubes : CUBE_CHUNK;
+	alloc_cubes(chunk);
 	
-	// set up move counters
-	cube[index].totalMoves = 0;
-	cube[index].solveGreenCrossMoves = 0;
-	cube[index].solveGreenCornersMoves = 0;
-	cube[index].solveMiddleEdgesMoves = 0;
-	cube[index].solveBlueCrossMoves = 0;
-	cube[index].alignBlueCornersMoves = 0;
-}
-
-// Display a cube
-void show_cube(int index)
-{
-	printf("Cube %03d --------------------\n", index);
+	if (bench_moves > 0)
+	{
+		bench_move_kernels(bench_moves);
+		return 0;
+	}
+	if (dump_path != NULL)
+	{
+		dump_solutions_file(dump_path);
+		return 0;
+	}
+	if (make_states > 0)
+	{
+		if (states_path == NULL)
+		{
+			printf("--make-states needs a --states file to write!\n");
+			exit(-1);
+		}
+		make_states_file(states_path, make_states);
+		return 0;
+	}
 	
-	// show UP
-	for (int row = 0; row < 3; row++)
+	// solving a states file writes a binary solutions file
+	solutions_file_t solutions_file;
+	const cubie_t *states = NULL;
+	uint64_t num_states = 0;
+	size_t states_size = 0;
+	if (states_path != NULL)
 	{
-		printf("                ");
-		for (int j = 0; j < 3; j++)
-			printf("%c ", colors[cube[index].face[UP].tile[row][j]]);
-		printf("\n");
+		if (streaming || (solutions_path == NULL))
+		{
+			printf("--states needs a --solutions file and can't be combined with --input!\n");
+			exit(-1);
+		}
+		states = map_states_file(states_path, &num_states, &states_size);
+		create_solutions_file(&solutions_file, solutions_path, num_states);
+		input_cubes = true;
+		record_solutions = true;
 	}
-	printf("                | | |\n");
 	
-	// show back, left, front, right
-	for (int row = 0; row < 3; row++)
+	// solutions, if we're writing them, and the report, which moves out of their way if they go to stdout
+	if (streaming && (solutions_path == NULL))
+		solutions_path = "-";
+	FILE *out = NULL;
+	if ((solutions_path != NULL) && (states == NULL))
 	{
-		for (int i = BACK; i <= RIGHT; i++)
+		out = (strcmp(solutions_path, "-") == 0) ? stdout : fopen(solutions_path, "w");
+		if (out == NULL)
 		{
-			for (int j = 0; j < 3; j++)
-				printf("%c ", colors[cube[index].face[i].tile[row][j]]);
-			if (i != RIGHT) // suppress dash at end
-				printf("- ");
+			printf("Unable to open %s for writing!\n", solutions_path);
+			exit(-1);
 		}
-		printf("\n");
 	}
-
-	// show DOWN
-	printf("                | | |\n");
-	for (int row = 0; row < 3; row++)
+	report = (out == stdout) ? stderr : stdout;
+	FILE *in = NULL;
+	if (streaming)
 	{
-		printf("                ");
-		for (int j = 0; j < 3; j++)
-			printf("%c ", colors[cube[index].face[DOWN].tile[row][j]]);
-		printf("\n");
+		in = (strcmp(input_path, "-") == 0) ? stdin : fopen(input_path, "r");
+		if (in == NULL)
+		{
+			printf("Unable to open %s for reading!\n", input_path);
+			exit(-1);
+		}
+	}
+	
+	// the window and the fast path share a table, deep enough for both; the fast path meets it halfway
+	int table_depth = (window > (fast_path_depth + 1) / 2) ? window : (fast_path_depth + 1) / 2;
+	if (table_depth > 0)
+	{
+		window_depth = window;
+		init_short_table(table_depth);
+		fprintf(report, "Short sequence table: %lu positions within %d moves.\n", short_table_entries, table_depth);
 	}
-}
-
-int main (int argc, char * const argv[])
-{
-	// setup
-	srandom(time(NULL));
 	
 	// police our average move counts for each function
-	unsigned int totalMoves = 0;
-	unsigned int solveGreenCrossMoves = 0;
-	unsigned int solveGreenCornersMoves = 0;
-	unsigned int solveMiddleEdgesMoves = 0;
-	unsigned int solveBlueCrossMoves = 0;
-	unsigned int alignBlueCornersMoves = 0;
+	move_totals_t totals;
+	memset(&totals, 0, sizeof(totals));
+	batch_stats_t batch_stats[5];
+	memset(batch_stats, 0, sizeof(batch_stats));
+	pipeline_stats_t pipeline_stats[PIPELINE_STAGES];
+	memset(pipeline_stats, 0, sizeof(pipeline_stats));
 	
 	// keep track of our time
 	struct timeval start_time, end_time;
 	gettimeofday(&start_time, NULL);
 	
-	printf("Solving %d cubes...\n", NUM_CUBES);
-	
-	for (int i = 0; i < NUM_CUBES; i++)
+	fprintf(report, "Using the %s move kernel.\n", move_kernel_name);
+	if (streaming)
 	{
-		init_cube(i);
-		scramble_cube(i);
-		if (LOGGING)
+		// a window of cubes at a time, each written out before the next is read
+		fprintf(report, "Solving cubes from %s, %d at a time%s...\n", input_path, cube_capacity, pipeline ? " in a pipeline" : "");
+		long line_number = 0;
+		int count;
+		while ((count = read_cubes(in, &line_number)) > 0)
 		{
-			printf("*** Scrambled Cube\n");
-			show_cube(i);
+			if (pipeline)
+				run_pipeline(replicas, queue_depth, count, &totals, pipeline_stats);
+			else
+				run_threaded(num_threads, count, &totals, batch_stats);
+			for (int i = 0; i < count; i++)
+			{
+				if (cube_invalid[i])
+					fprintf(out, "INVALID\n");
+				else
+					write_solution(out, &solutions[i]);
+			}
+			fflush(out);
+			free_move_arenas();
 		}
-	
-		// solve it!
-		solve_green_cross(i);
-		solve_green_corners(i);
-		solve_middle_edges(i);
-		solve_blue_cross(i);
-		align_blue_corners(i);
-
-		if (LOGGING)
+		if (in != stdin)
+			fclose(in);
+	}
+	else if (states != NULL)
+	{
+		// a window of cubes at a time, each slice converted by its worker straight from the mapping
+		fprintf(report, "Solving %lu cubes from %s, %d at a time%s...\n", (unsigned long)num_states, states_path, cube_capacity,
+				pipeline ? " in a pipeline" : "");
+		mapped_states = states;
+		for (mapped_first = 0; mapped_first < num_states; mapped_first += cube_capacity)
 		{
-			printf("*** Solved Cube in %d moves.\n", cube[i].totalMoves);
-			show_cube(i);
+			int count = (num_states - mapped_first < (uint64_t)cube_capacity) ? (int)(num_states - mapped_first) : cube_capacity;
+			if (pipeline)
+				run_pipeline(replicas, queue_depth, count, &totals, pipeline_stats);
+			else
+				run_threaded(num_threads, count, &totals, batch_stats);
+			append_solutions(&solutions_file, count);
+			free_move_arenas();
+		}
+		close_solutions_file(&solutions_file);
+		munmap((void *)((const batch_header_t *)states - 1), states_size);
+	}
+	else
+	{
+		// a chunk of scrambles at a time, their solutions written before the next chunk is scrambled
+		fprintf(report, "Scramble seed %lu.\n", (unsigned long)scramble_seed);
+		if (pipeline)
+			fprintf(report, "Solving %ld cubes in a %d stage pipeline, %d at a time...\n", num_cubes, PIPELINE_STAGES, cube_capacity);
+		else
+			fprintf(report, "Solving %ld cubes on %d thread%s, %d at a time...\n", num_cubes, num_threads, (num_threads == 1) ? "" : "s",
+					cube_capacity);
+		for (long done = 0; done < num_cubes; done += cube_capacity)
+		{
+			int count = (num_cubes - done < cube_capacity) ? (int)(num_cubes - done) : cube_capacity;
+			cube_base = done;
+			if (pipeline)
+				run_pipeline(replicas, queue_depth, count, &totals, pipeline_stats);
+			else
+				run_threaded(num_threads, count, &totals, batch_stats);
+			if (out != NULL)
+			{
+				for (int i = 0; i < count; i++)
+					write_solution(out, &solutions[i]);
+			}
+			free_move_arenas();
 		}
-		
-		totalMoves += cube[i].totalMoves;
-		solveGreenCrossMoves += cube[i].solveGreenCrossMoves;
-		solveGreenCornersMoves += cube[i].solveGreenCornersMoves;
-		solveMiddleEdgesMoves += cube[i].solveMiddleEdgesMoves;
-		solveBlueCrossMoves += cube[i].solveBlueCrossMoves;
-		alignBlueCornersMoves += cube[i].alignBlueCornersMoves;
 	}
 	
-	double averageTotalMoves = (double)totalMoves / (double)NUM_CUBES;
-	double averageSolveGreenCrossMoves = (double)solveGreenCrossMoves / (double)NUM_CUBES;
-	double averageSolveGreenCornersMoves = (double)solveGreenCornersMoves / (double)NUM_CUBES;
-	double averageSolveMiddleEdgesMoves = (double)solveMiddleEdgesMoves / (double)NUM_CUBES;
-	double averageSolveBlueCrossMoves = (double)solveBlueCrossMoves / (double)NUM_CUBES;
-	double averageAlignBlueCornersMoves = (double)alignBlueCornersMoves / (double)NUM_CUBES;
+	double cubes = (totals.cubes > 0) ? (double)totals.cubes : 1.0;
+	double averageTotalMoves = (double)totals.totalMoves / cubes;
+	double averageSolveGreenCrossMoves = (double)totals.solveGreenCrossMoves / cubes;
+	double averageSolveGreenCornersMoves = (double)totals.solveGreenCornersMoves / cubes;
+	double averageSolveMiddleEdgesMoves = (double)totals.solveMiddleEdgesMoves / cubes;
+	double averageSolveBlueCrossMoves = (double)totals.solveBlueCrossMoves / cubes;
+	double averageAlignBlueCornersMoves = (double)totals.alignBlueCornersMoves / cubes;
 
 	gettimeofday(&end_time, NULL);
 
-	printf("Solved %d cubes.\n", NUM_CUBES);
-	printf("Move count averages:\n");
-	printf("--> Total Moves        : %f.\n", averageTotalMoves);
-	printf("--> Solve Green Cross  : %f.\n", averageSolveGreenCrossMoves);
-	printf("--> Solve Green Corners: %f.\n", averageSolveGreenCornersMoves);
-	printf("--> Solve Middle Edges : %f.\n", averageSolveMiddleEdgesMoves);
-	printf("--> Solve Blue Cross   : %f.\n", averageSolveBlueCrossMoves);
-	printf("--> Align Blue Corners : %f.\n", averageAlignBlueCornersMoves);
-	printf("\nElapsed time: %ld seconds %ld usecs.\n",
+	fprintf(report, "Solved %lu cubes.\n", totals.cubes);
+	if (totals.unsolvedCubes > 0)
+		fprintf(report, "WARNING: %lu cubes failed to verify as solved!\n", totals.unsolvedCubes);
+	fprintf(report, "Move count averages:\n");
+	fprintf(report, "--> Total Moves        : %f.\n", averageTotalMoves);
+	if (solve_engine == ENGINE_TWO_PHASE)
+	{
+		// the two phases are credited to the first two stages
+		fprintf(report, "--> Phase 1            : %f.\n", averageSolveGreenCrossMoves);
+		fprintf(report, "--> Phase 2            : %f.\n", averageSolveGreenCornersMoves);
+	}
+	else if (solve_engine == ENGINE_OPTIMAL)
+	{
+		double usecs = (optimal_usecs > 0) ? (double)optimal_usecs : 1.0;
+		fprintf(report, "--> Face Turns         : %f.\n", (double)optimal_face_turns / cubes);
+		fprintf(report, "Optimal search: %lu nodes in %.3f seconds on %d thread%s, %.0f nodes/s.\n", (unsigned long)optimal_nodes,
+				usecs / 1000000.0, optimal_threads, (optimal_threads == 1) ? "" : "s", (double)optimal_nodes * 1000000.0 / usecs);
+	}
+	else
+	{
+		fprintf(report, "--> Solve Green Cross  : %f.\n", averageSolveGreenCrossMoves);
+		fprintf(report, "--> Solve Green Corners: %f.\n", averageSolveGreenCornersMoves);
+		fprintf(report, "--> Solve Middle Edges : %f.\n", averageSolveMiddleEdgesMoves);
+		fprintf(report, "--> Solve Blue Cross   : %f.\n", averageSolveBlueCrossMoves);
+		fprintf(report, "--> Align Blue Corners : %f.\n", averageAlignBlueCornersMoves);
+	}
+	if (fast_path_depth > 0)
+		fprintf(report, "Fast path: %lu of %lu cubes solved optimally within %d moves.\n", (unsigned long)fast_path_cubes, totals.cubes,
+				fast_path_depth);
+	if (optimize_solutions)
+	{
+		static const char *layer_stage_name[5] = { "Green Cross", "Green Corners", "Middle Edges", "Blue Cross", "Blue Corners" };
+		static const char *phase_name[5] = { "Phase 1", "Phase 2", "", "", "" };
+		static const char *optimal_name[5] = { "Optimal", "", "", "", "" };
+		const char **stage_name = layer_stage_name;
+		int stages = 5;
+		if (solve_engine == ENGINE_TWO_PHASE)
+		{
+			stage_name = phase_name;
+			stages = 2;
+		}
+		else if (solve_engine == ENGINE_OPTIMAL)
+		{
+			stage_name = optimal_name;
+			stages = 1;
+		}
+		unsigned long raw[5] = { totals.solveGreenCrossMoves, totals.solveGreenCornersMoves, totals.solveMiddleEdgesMoves,
+			totals.solveBlueCrossMoves, totals.alignBlueCornersMoves };
+		unsigned long optimized = 0;
+		fprintf(report, "Peephole optimized averages (raw -> optimized):\n");
+		for (int s = 0; s < stages; s++)
+		{
+			fprintf(report, "--> %-19s: %f -> %f.\n", stage_name[s], (double)raw[s] / cubes, (double)totals.optimizedMoves[s] / cubes);
+			optimized += totals.optimizedMoves[s];
+		}
+		fprintf(report, "--> %-19s: %f -> %f.\n", "Total Moves", averageTotalMoves, (double)optimized / cubes);
+	}
+	if (batched)
+	{
+		static const char *stage_name[5] = { "Green Cross", "Green Corners", "Middle Edges", "Blue Cross", "Blue Corners" };
+		fprintf(report, "Batched stages (rounds, buckets, average cubes per bucket, bucket sizes 1 2-3 4-7 8-15 16-31 32-63 64):\n");
+		for (int s = 0; s < 5; s++)
+		{
+			fprintf(report, "--> %-13s: %lu rounds, %lu buckets, %.2f cubes/bucket,", stage_name[s], batch_stats[s].rounds, batch_stats[s].buckets,
+				   (batch_stats[s].buckets > 0) ? (double)batch_stats[s].lanes / (double)batch_stats[s].buckets : 0.0);
+			for (int b = 0; b < BUCKET_BINS; b++)
+				fprintf(report, " %lu", batch_stats[s].histogram[b]);
+			fprintf(report, "\n");
+		}
+	}
+	if (pipeline)
+	{
+		// how full the rings feeding each stage ran; a stage whose input stays full is the bottleneck
+		fprintf(report, "Pipeline stage statistics (queue capacity %u):\n", queue_depth);
+		for (int s = 0; s < PIPELINE_STAGES; s++)
+		{
+			pipeline_stats_t *ps = &pipeline_stats[s];
+			double avg_depth = (ps->pushes > 0) ? (double)ps->depth_sum / (double)ps->pushes : 0.0;
+			fprintf(report, "--> %-19s: %d replica%s, avg depth %.2f, max depth %u, occupancy %.1f%%, producer stalls %lu, idle polls %lu.\n",
+				   pipeline_stage_name[s], replicas[s], (replicas[s] == 1) ? "" : "s", avg_depth, ps->max_depth,
+				   100.0 * avg_depth / (double)queue_depth, ps->full_waits, ps->idle_waits);
+		}
+	}
+	fprintf(report, "\nElapsed time: %ld seconds %ld usecs.\n",
 		   end_time.tv_sec - start_time.tv_sec - ((end_time.tv_usec - start_time.tv_usec < 0) ? 1 : 0), // subtract 1 if there was a usec rollover
 		   end_time.tv_usec - start_time.tv_usec + ((end_time.tv_usec - start_time.tv_usec < 0) ? 1000000 : 0) // bump usecs by 1 million usec for rollover
 	);
 	
+	if ((out != NULL) && (out != stdout))
+		fclose(out);
+	free_move_arenas();
+	free_cubes();
+	
     return 0;
 }
+#endif
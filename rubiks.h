@@ -0,0 +1,128 @@
+/******************************************
+ Rubik's Cube Puzzle Solver - library API
+
+ Build librubiks.a or librubiks.so with
+ "make lib" and include this header to
+ solve cubes from your own program.
+
+ Every call works on the cube_t, arena and
+ solution_t it is handed, so independent
+ cubes can be solved from as many threads
+ at once as you like. The only shared
+ state is the move tables, which
+ init_solver builds once and which are
+ read-only from then on.
+ ******************************************/
+
+#ifndef RUBIKS_H
+#define RUBIKS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// the library is built with every other symbol hidden, so these are all it exports
+#define RUBIKS_API __attribute__((visibility("default")))
+
+// tile colors, as the letters in colors[]; facing white with blue top:
+enum { BLU, YEL, ORG, WHT, RED, GRN };
+enum { UP, BACK, LEFT, FRONT, RIGHT, DOWN };
+
+// move list
+enum { ROTU, ROTUI, ROTB, ROTBI, ROTL, ROTLI, ROTF, ROTFI, ROTR, ROTRI, ROTD, ROTDI };
+
+// one byte per tile; the six faces pack into 54 contiguous bytes, so a cube can be addressed
+// either as face[f].tile[row][col] or as the flat facelet[f * 9 + row * 3 + col]
+#define NUM_FACELETS 54
+
+typedef struct {
+	unsigned char tile[3][3];
+} face_t;
+
+// where each corner and edge piece sits and how it's turned, 5 bits per piece (see Cubie Representation)
+typedef struct {
+	uint64_t corners;
+	uint64_t edges;
+} cubie_t;
+
+// a growable store of recorded moves, packed 4 bits per move
+typedef struct move_arena move_arena_t;
+
+typedef struct {
+	union {
+		face_t face[6];
+		unsigned char facelet[NUM_FACELETS];
+	};
+	unsigned int totalMoves; // keep track of total moves
+	// and moves for each function
+	unsigned int solveGreenCrossMoves;
+	unsigned int solveGreenCornersMoves;
+	unsigned int solveMiddleEdgesMoves;
+	unsigned int solveBlueCrossMoves;
+	unsigned int alignBlueCornersMoves;
+	move_arena_t *recording; // where moves are recorded while a stage is being solved, or NULL
+	bool indexed; // pieces is kept up to date by every move
+	cubie_t pieces;
+} cube_t;
+
+// a run of recorded moves, and a cube's solution as one run per stage
+typedef struct {
+	const unsigned char *bytes; // first byte of the span, moves packed low nibble first
+	unsigned int length; // moves
+} move_span_t;
+
+typedef struct {
+	move_span_t stage[5];
+} solution_t;
+
+extern RUBIKS_API char colors[]; // "BYOWRG"
+extern RUBIKS_API const char *move_notation[12]; // "U", "Ui", ... by move
+
+// Build the move tables; call once before anything else (later calls do nothing)
+RUBIKS_API void init_solver(void);
+
+// Load a cube from 54 color letters, face by face in the order UP, BACK, LEFT, FRONT, RIGHT, DOWN, each
+// row by row (spaces are ignored); returns false unless it's a legal, solvable cube
+RUBIKS_API bool load_cube(cube_t *c, const char *facelets);
+
+// Index c's pieces, so the solver finds them with a lookup instead of a scan of the facelets; the index is
+// kept up to date by every move until the cube is reloaded
+RUBIKS_API void index_pieces(cube_t *c);
+
+// Solve c, crediting the move counters in c. If solution is not NULL, the moves are also recorded in arena,
+// one span per stage, and stay valid until the arena is reset or freed.
+RUBIKS_API void solve_cube(cube_t *c, move_arena_t *arena, solution_t *solution);
+
+// Keep the tables that are slow to build in files under dir, building and saving them the first time and
+// mapping them read only after that; call before init_two_phase or init_optimal
+RUBIKS_API void use_table_dir(const char *dir);
+
+// Build the two-phase engine's move and pruning tables; call once, after init_solver, before solving with it
+// (later calls do nothing)
+RUBIKS_API void init_two_phase(void);
+
+// Solve c with Kociemba's two-phase algorithm instead of the layers method, searching until a solution of at
+// most target quarter turns turns up or no shorter one can. Phase 1 and phase 2 are credited to, and recorded
+// as, the first two stages; the other three are left empty.
+RUBIKS_API void solve_cube_two_phase(cube_t *c, unsigned int target, move_arena_t *arena, solution_t *solution);
+
+// Build the optimal solver's move tables and pattern databases (about 150 MB, and some 15 seconds to build, so
+// worth a table directory); call once, after init_solver, before solving with it (later calls do nothing)
+RUBIKS_API void init_optimal(void);
+
+// Solve c in the fewest face turns, searching on threads threads. The solution is credited to, and recorded
+// as, the first stage, with half turns written as two quarter turns; the other four are left empty.
+RUBIKS_API void solve_cube_optimal(cube_t *c, int threads, move_arena_t *arena, solution_t *solution);
+
+// Shorten a recorded solution, rewriting it as new spans of arena
+RUBIKS_API void optimize_solution(solution_t *solution, move_arena_t *arena);
+
+RUBIKS_API move_arena_t *move_arena_create(void);
+RUBIKS_API void move_arena_reset(move_arena_t *arena); // forget every recorded move, keeping one chunk for reuse
+RUBIKS_API void move_arena_free(move_arena_t *arena);
+
+RUBIKS_API unsigned int solution_length(const solution_t *solution);
+RUBIKS_API unsigned int solution_stage_moves(const solution_t *solution, int stage, unsigned char *moves);
+RUBIKS_API void write_solution(FILE *out, const solution_t *solution);
+
+#endif